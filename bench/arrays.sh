@@ -0,0 +1,11 @@
+#!/bin/sh
+# Times the array fill and sum benchmarks (10M elements each).
+# Usage: bench/arrays.sh [path/to/Interpreter]
+interpreter=${1:-build/Interpreter}
+dir=$(dirname "$0")
+for name in array_fill array_sum; do
+    start=$(date +%s%N)
+    result=$("$interpreter" --no-cache "$dir/$name.clang") || exit 1
+    end=$(date +%s%N)
+    echo "$name: $(( (end - start) / 1000000 ))ms (result $result)"
+done
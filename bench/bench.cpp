@@ -0,0 +1,285 @@
+// InterpreterBench: times scanning, parsing and running each program of a
+// corpus, repeated, and writes the results as JSON. Given a baseline written
+// by an earlier run, it also exits with 1 if any phase got significantly
+// slower - ctest runs it that way against bench/baseline.json.
+//
+//   InterpreterBench [--corpus DIR] [--repeat N] [--json FILE]
+//                    [--baseline FILE] [--tolerance FRACTION]
+//
+// JSON goes to --json, or to stdout when there is no baseline to compare.
+//
+// Besides the .clang files in the corpus there is one generated program,
+// a large script of small functions, for scan/parse throughput.
+//
+// Times from different machines or build flags aren't comparable, so every
+// run also times a fixed C++ workload (string hashing and map updates, like
+// the interpreter's own inner loop). Comparisons use times divided by that
+// calibration time.
+
+#include "scanner.hpp"
+#include "parser.hpp"
+#include "interpreter.hpp"
+#include "stmt.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double millisSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct Program {
+    std::string name;
+    std::string source;
+};
+
+// Fastest and median of the repetitions of one phase.
+struct Timing {
+    double min = 0;
+    double median = 0;
+};
+
+Timing summarize(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    return {samples.front(), samples[samples.size() / 2]};
+}
+
+struct Result {
+    std::string name;
+    size_t bytes = 0;
+    uint64_t steps = 0;
+    Timing scan;
+    Timing parse;
+    Timing execute;
+};
+
+const char* const kPhases[] = {"scan", "parse", "execute"};
+
+const Timing& phase(const Result& result, int i) {
+    return i == 0 ? result.scan : i == 1 ? result.parse : result.execute;
+}
+
+std::string generatedScript() {
+    std::string source;
+    for (int i = 0; i < 2000; ++i) {
+        std::string n = std::to_string(i);
+        source += "function helper" + n + "(a, b) {\n"
+                  "    let total = a * " + n + " + b;\n"
+                  "    if (total > 100) { total = total - 100; } else { total = total + 1; }\n"
+                  "    while (total > 10) { total = total / 2; }\n"
+                  "    let label = \"helper\" + \"-" + n + "\";\n"
+                  "    return total;\n"
+                  "}\n";
+    }
+    source += "let sum = 0;\n";
+    for (int i = 0; i < 2000; i += 50) {
+        source += "sum = sum + helper" + std::to_string(i) + "(1, 2);\n";
+    }
+    source += "print sum;\n";
+    return source;
+}
+
+std::vector<Program> loadCorpus(const std::string& dir) {
+    std::vector<Program> programs;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.path().extension() != ".clang") continue;
+        std::ifstream in(entry.path(), std::ios::binary);
+        std::ostringstream text;
+        text << in.rdbuf();
+        programs.push_back({entry.path().stem().string(), text.str()});
+    }
+    std::sort(programs.begin(), programs.end(),
+              [](const Program& a, const Program& b) { return a.name < b.name; });
+    programs.push_back({"generated_functions", generatedScript()});
+    return programs;
+}
+
+Result measure(const Program& program, int repeat) {
+    Result result{program.name, program.source.size(), 0, {}, {}, {}};
+    std::vector<double> scan, parse, execute;
+    for (int r = 0; r < repeat; ++r) {
+        auto start = Clock::now();
+        Scanner scanner(program.source);
+        auto tokens = std::make_shared<const std::vector<Token>>(scanner.scanTokens());
+        scan.push_back(millisSince(start));
+
+        start = Clock::now();
+        Parser parser(tokens, ParseMode::Eager);
+        auto statements = parser.parse();
+        parse.push_back(millisSince(start));
+
+        std::ostringstream out;
+        Interpreter interpreter(out);
+        start = Clock::now();
+        interpreter.interpret(statements);
+        execute.push_back(millisSince(start));
+        result.steps = interpreter.steps;
+    }
+    result.scan = summarize(scan);
+    result.parse = summarize(parse);
+    result.execute = summarize(execute);
+    return result;
+}
+
+// The workload only takes a few milliseconds in an optimized build, so its
+// fastest time is taken over many more runs than the benchmarks get.
+double calibrate(int repeat) {
+    std::vector<double> samples;
+    for (int r = 0; r < std::max(repeat, 25); ++r) {
+        auto start = Clock::now();
+        std::unordered_map<std::string, double> vars;
+        const std::string names[] = {"i", "sum", "total", "product", "x"};
+        for (int i = 0; i < 200000; ++i) {
+            const std::string& name = names[i % 5];
+            vars[name] = vars[name] * 0.5 + i;
+        }
+        volatile double sink = vars["sum"];
+        (void)sink;
+        samples.push_back(millisSince(start));
+    }
+    return summarize(samples).min;
+}
+
+void writeJson(std::ostream& out, double calibration, int repeat, const std::vector<Result>& results) {
+    out << "{\n  \"calibration_ms\": " << calibration << ",\n  \"repeat\": " << repeat
+        << ",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        // one benchmark per line, which is what readBaseline relies on
+        out << "    {\"name\": \"" << r.name << "\", \"bytes\": " << r.bytes << ", \"steps\": " << r.steps;
+        for (int p = 0; p < 3; ++p) {
+            out << ", \"" << kPhases[p] << "_ms\": " << phase(r, p).min << ", \"" << kPhases[p]
+                << "_median_ms\": " << phase(r, p).median;
+        }
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+// Reads `"key": number` from one line of our own JSON output.
+bool numberField(const std::string& line, const std::string& key, double& value) {
+    size_t at = line.find("\"" + key + "\": ");
+    if (at == std::string::npos) return false;
+    value = std::strtod(line.c_str() + at + key.size() + 4, nullptr);
+    return true;
+}
+
+struct Baseline {
+    double calibration = 0;
+    std::map<std::string, std::string> lines;  // benchmark name -> its JSON line
+};
+
+bool readBaseline(const std::string& path, Baseline& baseline) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        numberField(line, "calibration_ms", baseline.calibration);
+        size_t name = line.find("\"name\": \"");
+        if (name == std::string::npos) continue;
+        size_t begin = name + 9;
+        baseline.lines[line.substr(begin, line.find('"', begin) - begin)] = line;
+    }
+    return baseline.calibration > 0;
+}
+
+// A phase regresses when its calibrated time grew by more than `tolerance`
+// and by more than a millisecond's worth, so tiny phases can't fail on noise.
+bool compare(const std::vector<Result>& results, double calibration, const Baseline& baseline,
+             double tolerance) {
+    bool ok = true;
+    double scale = calibration / baseline.calibration;
+    std::printf("%-22s %-8s %12s %12s %8s\n", "benchmark", "phase", "baseline", "now", "change");
+    for (const Result& r : results) {
+        auto it = baseline.lines.find(r.name);
+        if (it == baseline.lines.end()) {
+            std::printf("%-22s (not in baseline)\n", r.name.c_str());
+            continue;
+        }
+        double steps;
+        if (numberField(it->second, "steps", steps) && static_cast<uint64_t>(steps) != r.steps) {
+            std::printf("%-22s steps changed: %.0f -> %llu (update the baseline?)\n", r.name.c_str(), steps,
+                        static_cast<unsigned long long>(r.steps));
+        }
+        for (int p = 0; p < 3; ++p) {
+            double before;
+            if (!numberField(it->second, std::string(kPhases[p]) + "_ms", before)) continue;
+            double expected = before * scale;
+            double now = phase(r, p).min;
+            bool slower = now > expected * (1 + tolerance) && now - expected > scale;
+            std::printf("%-22s %-8s %10.3fms %10.3fms %+7.0f%%%s\n", r.name.c_str(), kPhases[p], expected, now,
+                        expected > 0 ? (now / expected - 1) * 100 : 0.0, slower ? "  REGRESSION" : "");
+            if (slower) ok = false;
+        }
+    }
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string corpus = "bench/corpus";
+    std::string jsonPath;
+    std::string baselinePath;
+    double tolerance = 0.5;
+    int repeat = 5;
+    for (int arg = 1; arg < argc; ++arg) {
+        bool hasValue = arg + 1 < argc;
+        if (std::strcmp(argv[arg], "--corpus") == 0 && hasValue) {
+            corpus = argv[++arg];
+        } else if (std::strcmp(argv[arg], "--repeat") == 0 && hasValue) {
+            repeat = std::max(1, std::atoi(argv[++arg]));
+        } else if (std::strcmp(argv[arg], "--json") == 0 && hasValue) {
+            jsonPath = argv[++arg];
+        } else if (std::strcmp(argv[arg], "--baseline") == 0 && hasValue) {
+            baselinePath = argv[++arg];
+        } else if (std::strcmp(argv[arg], "--tolerance") == 0 && hasValue) {
+            tolerance = std::strtod(argv[++arg], nullptr);
+        } else {
+            std::cerr << "usage: InterpreterBench [--corpus DIR] [--repeat N] [--json FILE]"
+                         " [--baseline FILE] [--tolerance FRACTION]\n";
+            return 2;
+        }
+    }
+
+    std::vector<Result> results;
+    double calibration;
+    try {
+        calibration = calibrate(repeat);
+        for (const Program& program : loadCorpus(corpus)) results.push_back(measure(program, repeat));
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
+    }
+
+    if (jsonPath.empty()) {
+        if (baselinePath.empty()) writeJson(std::cout, calibration, repeat, results);
+    } else {
+        std::ofstream out(jsonPath);
+        writeJson(out, calibration, repeat, results);
+    }
+
+    if (baselinePath.empty()) return 0;
+    Baseline baseline;
+    if (!readBaseline(baselinePath, baseline)) {
+        std::cerr << "Error: could not read baseline '" << baselinePath << "'\n";
+        return 2;
+    }
+    if (compare(results, calibration, baseline, tolerance)) return 0;
+    std::printf("slower than the baseline by more than %.0f%%\n", tolerance * 100);
+    return 1;
+}
@@ -0,0 +1,13 @@
+#!/bin/sh
+# Times 200k calls each of sqrt and abs written in Codelang and as built-ins.
+# The script sqrt runs 20 Newton steps, so the two totals agree to the digits
+# print shows.
+# Usage: bench/builtins.sh [path/to/Interpreter]
+interpreter=${1:-build/Interpreter}
+dir=$(dirname "$0")
+for name in builtins_script builtins_native; do
+    start=$(date +%s%N)
+    result=$("$interpreter" --no-cache "$dir/$name.clang" | tr '\n' ' ') || exit 1
+    end=$(date +%s%N)
+    echo "$name: $(( (end - start) / 1000000 ))ms (result $result)"
+done
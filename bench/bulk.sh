@@ -0,0 +1,14 @@
+#!/bin/sh
+# Times sum/dot/scale over 1M elements as script loops and as built-ins.
+# Both scripts build the same array first, so the difference between the
+# two times is the cost of the loops. Sums can differ in the last digits:
+# the built-ins add in a fixed lane order, not left to right.
+# Usage: bench/bulk.sh [path/to/Interpreter]
+interpreter=${1:-build/Interpreter}
+dir=$(dirname "$0")
+for name in bulk_loop bulk_builtins; do
+    start=$(date +%s%N)
+    result=$("$interpreter" --no-cache "$dir/$name.clang" | tr '\n' ' ') || exit 1
+    end=$(date +%s%N)
+    echo "$name: $(( (end - start) / 1000000 ))ms (result $result)"
+done
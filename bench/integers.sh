@@ -0,0 +1,17 @@
+#!/bin/sh
+# Times bench/integer_loop.clang with the tree walker and with --stackless.
+# Compare two builds by passing each one's Interpreter in turn.
+# Usage: bench/integers.sh [path/to/Interpreter]
+interpreter=${1:-build/Interpreter}
+dir=$(dirname "$0")
+for mode in "" --stackless; do
+    best=
+    for run in 1 2 3 4 5; do
+        start=$(date +%s%N)
+        result=$("$interpreter" --no-cache $mode "$dir/integer_loop.clang" | tr '\n' ' ') || exit 1
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then best=$ms; fi
+    done
+    echo "integer_loop ${mode:-tree}: ${best}ms best of 5 (result $result)"
+done
@@ -0,0 +1,9 @@
+#!/bin/sh
+# Times 1M map inserts and lookups.
+# Usage: bench/maps.sh [path/to/Interpreter]
+interpreter=${1:-build/Interpreter}
+script=$(dirname "$0")/map_insert_lookup.clang
+start=$(date +%s%N)
+result=$("$interpreter" --no-cache "$script" | tr '\n' ' ') || exit 1
+end=$(date +%s%N)
+echo "map_insert_lookup: $(( (end - start) / 1000000 ))ms (result $result)"
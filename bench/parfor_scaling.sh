@@ -0,0 +1,11 @@
+#!/bin/sh
+# Times bench/parfor_sum.clang with 1, 2, 4 and 8 task threads.
+# Usage: bench/parfor_scaling.sh [path/to/Interpreter]
+interpreter=${1:-build/Interpreter}
+script=$(dirname "$0")/parfor_sum.clang
+for threads in 1 2 4 8; do
+    start=$(date +%s%N)
+    result=$("$interpreter" --no-cache --task-threads "$threads" "$script") || exit 1
+    end=$(date +%s%N)
+    echo "$threads threads: $(( (end - start) / 1000000 ))ms (result $result)"
+done
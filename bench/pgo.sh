@@ -0,0 +1,21 @@
+#!/bin/sh
+# Profile-guided optimization: builds an instrumented Release binary
+# (preset pgo-generate), runs the programs in bench/training with it, then
+# builds the optimized binaries (preset pgo) from the collected profiles.
+# Run from anywhere; the result is out/build/pgo/Interpreter.
+set -e
+cd "$(dirname "$0")/.."
+profiles=out/pgo-profile
+rm -rf "$profiles"
+cmake --preset pgo-generate
+cmake --build --preset pgo-generate --target Interpreter
+for program in bench/training/*.clang; do
+    echo "training: $program"
+    out/build/pgo-generate/Interpreter --no-cache "$program" > /dev/null
+done
+# Clang writes raw profiles that have to be merged first.
+if ls "$profiles"/*.profraw > /dev/null 2>&1; then
+    llvm-profdata merge -o "$profiles/codelang.profdata" "$profiles"/*.profraw
+fi
+cmake --preset pgo
+cmake --build --preset pgo
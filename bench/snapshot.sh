@@ -0,0 +1,42 @@
+#!/bin/sh
+# Times starting a short script that needs a 10k-line prelude: prelude and
+# script run from source, from the program cache (prelude still executed),
+# and from a snapshot of the globals the prelude left behind.
+# Usage: bench/snapshot.sh [path/to/Interpreter]
+interpreter=${1:-build/Interpreter}
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+
+# 2400 four-line helpers, 400 constants and a lookup table built by a loop
+awk 'BEGIN {
+    for (i = 0; i < 2400; i++) {
+        printf "function helper%d(x) {\n", i
+        printf "    let y = x * %d + 1;\n", i
+        printf "    return y / 2;\n"
+        printf "}\n"
+    }
+    for (i = 0; i < 400; i++) printf "let constant%d = \"value %d\";\n", i, i
+    print "let table = [];"
+    print "for (let i = 0; i < 20000; i++) { push(table, i * i); }"
+}' > "$work/prelude.clang"
+echo 'print helper7(3) + helper2399(1) + table[100] + len(constant399);' > "$work/main.clang"
+cat "$work/prelude.clang" "$work/main.clang" > "$work/whole.clang"
+"$interpreter" --write-snapshot "$work/prelude.img" "$work/prelude.clang" || exit 1
+"$interpreter" --cache-dir "$work/cache" "$work/whole.clang" > /dev/null || exit 1  # warms the program cache
+
+# fastest of 5 runs, in ms
+time_run() {
+    best=
+    for run in 1 2 3 4 5; do
+        start=$(date +%s%N)
+        result=$("$interpreter" "$@") || exit 1
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then best=$ms; fi
+    done
+    echo "${best}ms (result $result)"
+}
+echo "lines: $(wc -l < "$work/prelude.clang") prelude, snapshot $(wc -c < "$work/prelude.img") bytes"
+echo "source:        $(time_run --no-cache "$work/whole.clang")"
+echo "program cache: $(time_run --cache-dir "$work/cache" "$work/whole.clang")"
+echo "snapshot:      $(time_run --no-cache --snapshot "$work/prelude.img" "$work/main.clang")"
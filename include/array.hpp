@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "memory_charge.hpp"
+#include "value.hpp"
+
+// A growable array value. Arrays are handles like channels: copies of the
+// value (including those handed to tasks and parfor chunks) share the same
+// elements, and every operation locks, so shared arrays are safe to use from
+// several threads.
+//
+// Elements live in a contiguous vector<double> while every one of them is a
+// number (integers are stored, and read back, as doubles), and move to a
+// vector<Value> the first time anything else is stored.
+//
+// The elements count against the memory cap of the interpreter passed to
+// charge(), set() or push() (see MemoryCharge) until the array is destroyed.
+class Array {
+public:
+    Array() = default;
+    explicit Array(std::vector<Value> elements);
+    explicit Array(std::vector<double> numbers) : numbers(std::move(numbers)) {}
+
+    size_t size() const;
+    // Approximate bytes held by the elements, for the memory cap.
+    size_t bytes() const;
+    bool numeric() const;
+
+    // Charges the elements held now to `interpreter`, e.g. for a new array.
+    void charge(Interpreter* interpreter);
+
+    // `index` is checked: it must be a whole number within the array.
+    Value get(double index) const;
+    void set(double index, Value value, Interpreter* interpreter = nullptr);
+    // Appends `value` and returns the new size.
+    size_t push(Value value, Interpreter* interpreter = nullptr);
+    Value pop();
+
+    // A copy of the elements, e.g. for printing.
+    std::vector<Value> elements() const;
+
+    // Calls `f(data, size)` on the numeric store with the array locked, or
+    // returns false without calling it if not every element is a number.
+    template <typename F>
+    bool readNumbers(F&& f) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!allNumbers) return false;
+        f(numbers.data(), numbers.size());
+        return true;
+    }
+
+    // The same for two arrays at once, which may be the same array:
+    // `f(aData, aSize, bData, bSize)`.
+    template <typename F>
+    static bool readNumbers(const Array& a, const Array& b, F&& f) {
+        if (&a == &b) {
+            return a.readNumbers([&](const double* data, size_t n) { f(data, n, data, n); });
+        }
+        std::scoped_lock lock(a.mutex, b.mutex);
+        if (!a.allNumbers || !b.allNumbers) return false;
+        f(a.numbers.data(), a.numbers.size(), b.numbers.data(), b.numbers.size());
+        return true;
+    }
+
+private:
+    size_t position(double index) const;
+    void makeGeneric();
+    size_t storedBytes() const;
+
+    mutable std::mutex mutex;
+    bool allNumbers = true;
+    std::vector<double> numbers;
+    std::vector<Value> values;
+    MemoryCharge charged;
+};
+
+// Bulk numeric built-ins over arrays of numbers (sum, min, max, dot,
+// prefix_sum, map_add, map_mul and scale), on already evaluated arguments.
+// New arrays are charged to `interpreter`'s memory cap, if there is one.
+Value arraySum(const Value& array);
+Value arrayMin(const Value& array);
+Value arrayMax(const Value& array);
+Value arrayDot(const Value& a, const Value& b);
+Value arrayPrefixSum(const Value& array, Interpreter* interpreter);
+// `operand` is a number or an array of the same length.
+Value arrayMapAdd(const Value& array, const Value& operand, Interpreter* interpreter);
+Value arrayMapMul(const Value& array, const Value& operand, Interpreter* interpreter);
+Value arrayScale(const Value& array, const Value& factor, Interpreter* interpreter);
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "value.hpp"
+
+// A function implemented in C++. A call checks the argument count against
+// `arity` before evaluating anything, then hands the evaluated arguments to
+// `function`, which may move from them. Embedders add their own by storing
+// one in a global (it is a Value like any function); those that need state
+// derive from Native and cast `self` back.
+struct Native {
+    using Function = Value (*)(const Native& self, Value* args, Environment& env);
+
+    Native(std::string name, size_t arity, Function function)
+        : name(std::move(name)), arity(arity), function(function) {}
+
+    std::string name;
+    size_t arity;
+    Function function;
+};
+
+// Fails with "<name>() expects N arguments." unless a call passes `count`.
+void checkArity(const Native& native, size_t count);
+
+// The built-in named `name`, or null. The table never changes, so Call nodes
+// look theirs up once, when they are built; a script function or global of
+// the same name still takes precedence at run time.
+const std::shared_ptr<const Native>& findBuiltin(const std::string& name);
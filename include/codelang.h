@@ -0,0 +1,102 @@
+/* C API for embedding Codelang.
+ *
+ * A context holds run settings and the last error. A program is compiled
+ * once and can be run any number of times; every run starts from fresh
+ * globals, so runs never see each other's variables. A program is never
+ * modified by running it, so several threads may run the same program at
+ * once, each through its own context; a context is not thread-safe.
+ *
+ *     codelang_context* ctx = codelang_context_new();
+ *     codelang_program* prog = codelang_compile(ctx, src, strlen(src));
+ *     if (!prog) fprintf(stderr, "%s\n", codelang_last_error(ctx));
+ *     else if (codelang_run(ctx, prog, write_fn, user) != CODELANG_OK)
+ *         fprintf(stderr, "%s\n", codelang_last_error(ctx));
+ *     codelang_program_free(prog);
+ *     codelang_context_free(ctx);
+ */
+#ifndef CODELANG_H
+#define CODELANG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct codelang_context codelang_context;
+typedef struct codelang_program codelang_program;
+
+/* Receives program output in chunks; `data` is not NUL-terminated. */
+typedef void (*codelang_output_fn)(void* user_data, const char* data, size_t length);
+
+/* Results of codelang_run (same values as the CLI's exit codes). */
+enum {
+    CODELANG_OK = 0,
+    CODELANG_ERROR = 1,        /* syntax or runtime error */
+    CODELANG_LIMIT = 2,        /* step budget or memory cap exceeded */
+    CODELANG_OUTPUT_LIMIT = 3  /* output limit reached */
+};
+
+codelang_context* codelang_context_new(void);
+void codelang_context_free(codelang_context* ctx);
+
+/* Limits applied to every following run; 0 means unlimited. */
+void codelang_set_step_budget(codelang_context* ctx, uint64_t max_steps);
+void codelang_set_memory_limit(codelang_context* ctx, size_t max_bytes);
+void codelang_set_output_limit(codelang_context* ctx, size_t max_bytes);
+
+/* Returns NULL on a syntax error; the message is in codelang_last_error. */
+codelang_program* codelang_compile(codelang_context* ctx, const char* source, size_t length);
+void codelang_program_free(codelang_program* program);
+
+/* Runs `program`, passing everything it prints to `output` (may be NULL to
+ * discard it). Returns one of the CODELANG_* results. */
+int codelang_run(codelang_context* ctx, const codelang_program* program,
+                 codelang_output_fn output, void* user_data);
+
+/* Native functions. A script calls one like any other function, with
+ * exactly `arity` arguments; the callback reads them and sets the result
+ * through `call`, which is only valid until it returns (the result is 0 if
+ * it sets none). Callbacks of a script that spawns tasks may run on the
+ * task threads. */
+typedef struct codelang_call codelang_call;
+typedef void (*codelang_native_fn)(void* user_data, codelang_call* call);
+
+/* Types of arguments. */
+enum {
+    CODELANG_NUMBER = 0,
+    CODELANG_STRING = 1,
+    CODELANG_OTHER = 2  /* function, array, map, task or channel */
+};
+
+/* Defines the global function `name` in every following run, replacing any
+ * earlier definition of that name on `ctx`. Like any global, a script can
+ * redefine it. */
+void codelang_define_function(codelang_context* ctx, const char* name, size_t arity,
+                              codelang_native_fn fn, void* user_data);
+
+int codelang_arg_type(const codelang_call* call, size_t index);
+/* 0 if the argument is not a number. */
+double codelang_arg_number(const codelang_call* call, size_t index);
+/* NULL if the argument is not a string. Not NUL-terminated; `length` may be
+ * NULL. */
+const char* codelang_arg_string(const codelang_call* call, size_t index, size_t* length);
+void codelang_return_number(codelang_call* call, double value);
+/* Copies `length` bytes of `data`. */
+void codelang_return_string(codelang_call* call, const char* data, size_t length);
+/* Fails the call: the run stops with CODELANG_ERROR and `message`. */
+void codelang_fail(codelang_call* call, const char* message);
+
+/* Steps taken by the last run (loop iterations plus calls). */
+uint64_t codelang_last_steps(const codelang_context* ctx);
+
+/* Message of the last failed compile or run; "" if it succeeded. The pointer
+ * stays valid until the next call on `ctx`. */
+const char* codelang_last_error(const codelang_context* ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
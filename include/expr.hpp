@@ -2,28 +2,55 @@
 #define EXPR_HPP
 
 #pragma once
+#include <cmath>
 #include <memory>
 #include <string>
 #include <vector>
 #include <stdexcept>
 #include "value.hpp"
 #include "token.hpp"
+#include "interpreter.hpp"
+#include "builtins.hpp"
 
 struct Stmt;
 struct FunctionStmt; 
 
+// Conditions hold for any number but 0, and never for other values.
+inline bool isTruthy(const Value& value) {
+    if (auto integer = std::get_if<int64_t>(&value)) return *integer != 0;
+    return std::holds_alternative<double>(value) && std::get<double>(value) != 0.0;
+}
+
+// `out = a * b` for integers, or false if the product is out of range (and
+// the caller redoes it in doubles). Sums and differences of integers in range
+// can't overflow an int64_t, so they only need the range check.
+inline bool multiplyInts(int64_t a, int64_t b, int64_t& out) {
+#if defined(__GNUC__) || defined(__clang__)
+    return !__builtin_mul_overflow(a, b, &out) && isExactInteger(out);
+#else
+    // rounding can't take a product of at least 2^53 below it
+    if (std::fabs(static_cast<double>(a) * static_cast<double>(b)) >= static_cast<double>(kMaxExactInteger))
+        return false;
+    out = a * b;
+    return true;
+#endif
+}
+
 struct Expr {
     virtual ~Expr() = default;
-    virtual Value evaluate(Environment& env) = 0;
+    virtual Value evaluate(Environment& env) const = 0;
+    int line = 0;  // of its operator or first token, 0 if unknown
 };
 
 struct Literal : public Expr {
     Value value;
 
     Literal(double val) : value(val) {}
+    Literal(int64_t val) : value(val) {}
     Literal(const std::string& val) : value(val) {}
 
-    Value evaluate(Environment&) override {
+    Value evaluate(Environment& env) const override {
+        countNode(env, NodeKind::Literal);
         return value;
     }
 };
@@ -33,9 +60,13 @@ struct Variable : public Expr {
 
     Variable(const std::string& name) : name(name) {}
 
-    Value evaluate(Environment& env) override {
+    Value evaluate(Environment& env) const override {
+        countNode(env, NodeKind::Variable);
+        countLookup(env);
         auto it = env.find(name);
         if (it == env.end()) {
+            // built-ins are values too, e.g. `let root = sqrt;`
+            if (const auto& builtin = findBuiltin(name)) return builtin;
             throw std::runtime_error("Undefined variable: " + name);
         }
         return it->second;
@@ -49,9 +80,10 @@ struct Assign : public Expr {
     Assign(const std::string& name, std::shared_ptr<Expr> value)
         : name(name), valueExpr(value) {}
 
-    Value evaluate(Environment& env) override {
+    Value evaluate(Environment& env) const override {
+        countNode(env, NodeKind::Assign);
         Value val = valueExpr->evaluate(env);
-        env[name] = val;
+        setVariable(env, name, val);
         return val;
     }
 };
@@ -64,69 +96,115 @@ struct Binary : public Expr {
     Binary(std::shared_ptr<Expr> left, const std::string& op, std::shared_ptr<Expr> right)
         : left(left), op(op), right(right) {}
 
-    Value evaluate(Environment& env) override {
+    Value evaluate(Environment& env) const override {
+        countNode(env, NodeKind::Binary);
         Value l = left->evaluate(env);
         Value r = right->evaluate(env);
+        return apply(op, l, r, env.interpreter);
+    }
 
+    // `l op r`; also used to combine parfor reductions. Integers stay
+    // integers unless the result is out of range, -0 or, for '/', not whole.
+    static Value apply(const std::string& op, const Value& l, const Value& r, Interpreter* interpreter) {
+        const int64_t* li = std::get_if<int64_t>(&l);
+        const int64_t* ri = std::get_if<int64_t>(&r);
+        bool ints = li && ri;
+        bool numbers = ints || (isNumber(l) && isNumber(r));
+        int64_t result;
         if (op == "+") {
+            if (ints && isExactInteger(result = *li + *ri)) return result;
             if (std::holds_alternative<std::string>(l) && std::holds_alternative<std::string>(r)) {
-                return std::get<std::string>(l) + std::get<std::string>(r);
-            }
-            if (std::holds_alternative<double>(l) && std::holds_alternative<double>(r)) {
-                return std::get<double>(l) + std::get<double>(r);
+                const std::string& ls = std::get<std::string>(l);
+                const std::string& rs = std::get<std::string>(r);
+                if (interpreter) {
+                    interpreter->checkAllocation(ls.size() + rs.size());
+                    interpreter->count([&](Stats& stats) {
+                        stats.strings++;
+                        stats.stringBytes += ls.size() + rs.size();
+                    });
+                }
+                return ls + rs;
             }
+            if (numbers) return asDouble(l) + asDouble(r);
             throw std::runtime_error("Type error: '+' operator requires both operands of same type");
         }
         else if (op == "-") {
-            if (std::holds_alternative<double>(l) && std::holds_alternative<double>(r)) {
-                return std::get<double>(l) - std::get<double>(r);
-            }
+            if (ints && isExactInteger(result = *li - *ri)) return result;
+            if (numbers) return asDouble(l) - asDouble(r);
             throw std::runtime_error("Type error: '-' operator requires numbers");
         }
         else if (op == "*") {
-            if (std::holds_alternative<double>(l) && std::holds_alternative<double>(r)) {
-                return std::get<double>(l) * std::get<double>(r);
+            if (ints && multiplyInts(*li, *ri, result)) {
+                // 0 times a negative number is -0 in doubles, which prints
+                if (result == 0 && (*li < 0 || *ri < 0)) return -0.0;
+                return result;
             }
+            if (numbers) return asDouble(l) * asDouble(r);
             throw std::runtime_error("Type error: '*' operator requires numbers");
         }
         else if (op == "/") {
-            if (std::holds_alternative<double>(l) && std::holds_alternative<double>(r)) {
-                double divisor = std::get<double>(r);
+            if (numbers) {
+                double divisor = asDouble(r);
                 if (divisor == 0) throw std::runtime_error("Division by zero");
-                return std::get<double>(l) / divisor;
+                if (ints && *li % *ri == 0) {
+                    if (*li == 0 && *ri < 0) return -0.0;
+                    return *li / *ri;
+                }
+                return asDouble(l) / divisor;
             }
             throw std::runtime_error("Type error: '/' operator requires numbers");
         }
         else if (op == "==") {
-            return l == r ? 1.0 : 0.0;
+            return valuesEqual(l, r) ? 1.0 : 0.0;
         }
         else if (op == "!=") {
-            return l != r ? 1.0 : 0.0;
+            return valuesEqual(l, r) ? 0.0 : 1.0;
         }
         else if (op == "<") {
-            if (std::holds_alternative<double>(l) && std::holds_alternative<double>(r))
-                return std::get<double>(l) < std::get<double>(r) ? 1.0 : 0.0;
+            if (ints) return *li < *ri ? 1.0 : 0.0;
+            if (numbers) return asDouble(l) < asDouble(r) ? 1.0 : 0.0;
             throw std::runtime_error("Type error: '<' requires numbers");
         }
         else if (op == "<=") {
-            if (std::holds_alternative<double>(l) && std::holds_alternative<double>(r))
-                return std::get<double>(l) <= std::get<double>(r) ? 1.0 : 0.0;
+            if (ints) return *li <= *ri ? 1.0 : 0.0;
+            if (numbers) return asDouble(l) <= asDouble(r) ? 1.0 : 0.0;
             throw std::runtime_error("Type error: '<=' requires numbers");
         }
         else if (op == ">") {
-            if (std::holds_alternative<double>(l) && std::holds_alternative<double>(r))
-                return std::get<double>(l) > std::get<double>(r) ? 1.0 : 0.0;
+            if (ints) return *li > *ri ? 1.0 : 0.0;
+            if (numbers) return asDouble(l) > asDouble(r) ? 1.0 : 0.0;
             throw std::runtime_error("Type error: '>' requires numbers");
         }
         else if (op == ">=") {
-            if (std::holds_alternative<double>(l) && std::holds_alternative<double>(r))
-                return std::get<double>(l) >= std::get<double>(r) ? 1.0 : 0.0;
+            if (ints) return *li >= *ri ? 1.0 : 0.0;
+            if (numbers) return asDouble(l) >= asDouble(r) ? 1.0 : 0.0;
             throw std::runtime_error("Type error: '>=' requires numbers");
         }
 
         throw std::runtime_error("Unknown operator: " + op);
     }
 };
+
+// `a and b`, `a or b`: 1 or 0. The right operand is only evaluated when the
+// left one doesn't decide the result.
+struct Logical : public Expr {
+    std::shared_ptr<Expr> left;
+    std::string op;  // "and" or "or"
+    std::shared_ptr<Expr> right;
+
+    Logical(std::shared_ptr<Expr> left, const std::string& op, std::shared_ptr<Expr> right)
+        : left(std::move(left)), op(op), right(std::move(right)), isOr(this->op == "or") {}
+
+    Value evaluate(Environment& env) const override {
+        countNode(env, NodeKind::Logical);
+        bool holds = isTruthy(left->evaluate(env));
+        if (holds == isOr) return holds ? 1.0 : 0.0;
+        return isTruthy(right->evaluate(env)) ? 1.0 : 0.0;
+    }
+
+private:
+    bool isOr;
+};
 struct Unary : public Expr {
    Token op;
     std::shared_ptr<Expr> right;
@@ -134,32 +212,42 @@ struct Unary : public Expr {
     Unary(const Token& op, std::shared_ptr<Expr> right)
     : op(op), right(right) {}
 
-    Value evaluate(Environment& env) override {
+    Value evaluate(Environment& env) const override {
+        countNode(env, NodeKind::Unary);
         Value val = right->evaluate(env);
-        if (op.lexeme == "-") {
-            if (std::holds_alternative<double>(val)) {
-                return -std::get<double>(val);
-            }
-            throw std::runtime_error("Unary '-' requires a number.");
-        } else if (op.lexeme == "!") {
-            if (std::holds_alternative<double>(val)) {
-                return std::get<double>(val) == 0.0 ? 1.0 : 0.0;
-            }
-            throw std::runtime_error("Unary '!' requires a number.");
-        }
+        if (op.lexeme == "-") return negate(val);
+        if (op.lexeme == "!") return logicalNot(val);
         throw std::runtime_error("Unknown unary operator.");
     }
+
+    static Value negate(const Value& value) {
+        if (auto integer = std::get_if<int64_t>(&value)) {
+            if (*integer != 0) return -*integer;  // -0 is a double
+        }
+        if (isNumber(value)) return -asDouble(value);
+        throw std::runtime_error("Unary '-' requires a number.");
+    }
+
+    static Value logicalNot(const Value& value) {
+        if (isNumber(value)) return isTruthy(value) ? 0.0 : 1.0;
+        throw std::runtime_error("Unary '!' requires a number.");
+    }
 };
 
 struct Call : public Expr {
     std::string callee;
     std::vector<std::shared_ptr<Expr>> arguments;
-    
+    // The built-in of that name, called when no variable shadows it.
+    std::shared_ptr<const Native> builtin;
+
     Call(std::string callee, std::vector<std::shared_ptr<Expr>> args); 
 
-    Value evaluate(Environment& env) override;
+    Value evaluate(Environment& env) const override;
 };
 
+// The function `value` holds; `name` is the variable it came from, for errors.
+std::shared_ptr<const FunctionStmt> toFunction(const Value& value, const std::string& name);
+
 #endif 
 
 struct Postfix : public Expr {
@@ -169,5 +257,71 @@ struct Postfix : public Expr {
     Postfix(std::shared_ptr<Expr> operand, Token op)
         : operand(std::move(operand)), op(std::move(op)) {}
 
-    Value evaluate(Environment& env) override;
+    Value evaluate(Environment& env) const override;
+};
+
+// `spawn f(args)`: starts the call as a task and evaluates to its handle.
+struct Spawn : public Expr {
+    std::shared_ptr<Call> call;
+
+    Spawn(std::shared_ptr<Call> call) : call(std::move(call)) {}
+
+    Value evaluate(Environment& env) const override;
+};
+
+// `await t`: waits for task `t` and evaluates to its return value.
+struct Await : public Expr {
+    std::shared_ptr<Expr> task;
+
+    Await(std::shared_ptr<Expr> task) : task(std::move(task)) {}
+
+    Value evaluate(Environment& env) const override;
+};
+
+// `[a, b, c]`: a new array holding the values of the elements.
+struct ArrayLiteral : public Expr {
+    std::vector<std::shared_ptr<Expr>> elements;
+
+    ArrayLiteral(std::vector<std::shared_ptr<Expr>> elements) : elements(std::move(elements)) {}
+
+    Value evaluate(Environment& env) const override;
+};
+
+// `{k: v, ...}`: a new map. Keys are expressions, evaluated in order.
+struct MapLiteral : public Expr {
+    std::vector<std::pair<std::shared_ptr<Expr>, std::shared_ptr<Expr>>> entries;
+
+    MapLiteral(std::vector<std::pair<std::shared_ptr<Expr>, std::shared_ptr<Expr>>> entries)
+        : entries(std::move(entries)) {}
+
+    Value evaluate(Environment& env) const override;
+};
+
+// `array[index]`, or `map[key]`
+struct Index : public Expr {
+    std::shared_ptr<Expr> array;
+    std::shared_ptr<Expr> index;
+
+    Index(std::shared_ptr<Expr> array, std::shared_ptr<Expr> index)
+        : array(std::move(array)), index(std::move(index)) {}
+
+    Value evaluate(Environment& env) const override;
+
+    // `target[key]` of values already evaluated.
+    static Value apply(const Value& target, const Value& key);
+};
+
+// `array[index] = value` or `map[key] = value`, evaluating to the value.
+struct IndexAssign : public Expr {
+    std::shared_ptr<Expr> array;
+    std::shared_ptr<Expr> index;
+    std::shared_ptr<Expr> valueExpr;
+
+    IndexAssign(std::shared_ptr<Expr> array, std::shared_ptr<Expr> index, std::shared_ptr<Expr> value)
+        : array(std::move(array)), index(std::move(index)), valueExpr(std::move(value)) {}
+
+    Value evaluate(Environment& env) const override;
+
+    // `target[key] = value` of values already evaluated.
+    static void apply(Environment& env, const Value& target, const Value& key, const Value& value);
 };
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+#ifndef _WIN32
+#include <ucontext.h>
+#endif
+
+// A stackful coroutine: runs `body` on its own stack, and can suspend from
+// any depth of nested calls and be resumed later, on any thread.
+// Uses ucontext where available and Win32 fibers on Windows. `body` must
+// not let exceptions escape.
+class Fiber {
+public:
+    Fiber(std::function<void()> body, size_t stackSize);
+    ~Fiber();
+
+    Fiber(const Fiber&) = delete;
+    Fiber& operator=(const Fiber&) = delete;
+
+    // Runs the fiber on the calling thread until it suspends or finishes.
+    void resume();
+    // Called from inside the fiber: returns control to the resume() call.
+    void suspend();
+
+    bool finished() const { return done; }
+
+private:
+    void run();
+
+    std::function<void()> body;
+    bool done = false;
+#ifdef _WIN32
+    static void __stdcall entry(void* fiber);
+    void* handle = nullptr;
+    void* caller = nullptr;
+#else
+    static void entry();
+    ucontext_t context;
+    ucontext_t callerContext;
+    void* stack = nullptr;
+    size_t mappedSize = 0;
+#endif
+    // ThreadSanitizer's view of this fiber and of whoever resumed it.
+    void* tsanFiber = nullptr;
+    void* tsanCaller = nullptr;
+};
@@ -2,16 +2,202 @@
 #define INTERPRETER_HPP
 
 #pragma once
+#include <algorithm>
+#include <atomic>
 #include <unordered_map>
 #include <string>
 #include <memory>
 #include <vector>
+#include <iostream>
+#include <cstdint>
+#include <stdexcept>
 #include "value.hpp"
+#include "memory_charge.hpp"
+#include "output.hpp"
+#include "profiler.hpp"
+#include "stats.hpp"
 
+class Task;
+class TaskScheduler;
+
+// Thrown when a run exceeds its step budget, memory cap or call depth.
+struct LimitError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Steps left to a program whose tasks or parfor chunks run at the same time.
+// Each of its interpreters takes steps from here in small batches, so a
+// running interpreter may hold a few steps the others can't use yet.
+struct StepPool {
+    explicit StepPool(uint64_t left) : left(left) {}
+    // Up to `wanted` steps, or 0 once the pool is empty.
+    uint64_t take(uint64_t wanted);
+    std::atomic<uint64_t> left;
+};
+
+// One isolate: globals, call frames, output and limits of a run. Compiled
+// statements are only ever read (evaluate/execute are const), so a single
+// parsed program can run in several interpreters on different threads.
 class Interpreter {
 public:
+    explicit Interpreter(std::ostream& out = std::cout,
+                         OutputSink::Mode outputMode = OutputSink::Mode::FullyBuffered);
+
+    // The environment points back at this interpreter, so it stays put.
+    Interpreter(const Interpreter&) = delete;
+    Interpreter& operator=(const Interpreter&) = delete;
+    ~Interpreter();
+
+    // Runs `statements`; buffered output is flushed when they finish or throw.
+    // A `return` outside any function stops the run there, without an error.
     void interpret(const std::vector<std::shared_ptr<Stmt>>& statements);
     Environment environment;
+    OutputSink output;
+
+    // Step budget: one step per loop iteration and per function call, so a
+    // program's step count doesn't depend on machine speed. 0 = unlimited.
+    // Tasks and parfor chunks share the budget with the program that started
+    // them: the first one makes `stepPool`, and from then on every interpreter
+    // of the program draws its steps from it.
+    uint64_t maxSteps = 0;
+    uint64_t steps = 0;
+    std::shared_ptr<StepPool> stepPool;
+
+    void step() {
+        if (++steps > stepLimit) outOfSteps();
+    }
+    // The pool this interpreter's tasks and parfor chunks draw from, or null
+    // without a step budget.
+    std::shared_ptr<StepPool> shareSteps();
+    // Adds the steps of a task or parfor chunk that were already taken from
+    // the pool.
+    void chargeSteps(uint64_t taken) {
+        steps += taken;
+        if (stepPool) stepLimit += taken;
+    }
+
+    // Memory cap in bytes, 0 = unlimited (and no accounting). Counts the
+    // variables live in every call frame - each call copies its caller's
+    // environment - plus any string being built, plus the storage of the
+    // arrays and maps built here (`containerMemory`, see MemoryCharge).
+    size_t maxMemory = 0;
+    size_t memoryUsed = 0;
+    std::shared_ptr<ContainerMemory> containerMemory;
+
+    void chargeMemory(size_t bytes) {
+        checkAllocation(bytes);
+        memoryUsed += bytes;
+    }
+    void releaseMemory(size_t bytes) { memoryUsed -= bytes; }
+    // Fails if a new string or container of `bytes` would not fit, without
+    // charging it.
+    void checkAllocation(size_t bytes) const {
+        if (maxMemory == 0) return;
+        size_t containers = containerMemory ? containerMemory->used.load(std::memory_order_relaxed) : 0;
+        if (memoryUsed + containers + bytes > maxMemory) throw LimitError("Memory limit exceeded");
+    }
+
+    // Run on the stackless evaluator (see vm.hpp): call frames live on the
+    // heap, so recursion is bounded by maxDepth and memory instead of the
+    // native stack, and nesting deeper than maxDepth calls fails with
+    // "Stack overflow".
+    bool stackless = false;
+    size_t maxDepth = 1000000;
+
+    // Tasks started by `spawn` run on `scheduler`, which the first spawn
+    // creates with `taskThreads` workers (0 = one per core) unless this
+    // interpreter belongs to a task, which shares its parent's scheduler.
+    size_t taskThreads = 0;
+    TaskScheduler* scheduler = nullptr;
+    TaskScheduler& taskScheduler();
+
+    // Tasks spawned here. Any that were never awaited are joined, in spawn
+    // order, at the end of interpret() or of the spawning task.
+    std::vector<std::shared_ptr<Task>> spawned;
+    void joinSpawned();
+
+    // Set while this interpreter is being profiled: calls push frames and
+    // statements record their line. Only the interpreter's own thread is
+    // tracked, not tasks or parfor chunks.
+    ShadowStack* shadowStack = nullptr;
+    void atLine(int line) {
+        if (shadowStack) shadowStack->setLine(line);
+    }
+
+    // Counters for --stats, or null. Updates go through count(), which is
+    // empty when CODELANG_STATS is off.
+    Stats* stats = nullptr;
+    template <typename Update>
+    void count(Update update) {
+        if constexpr (kStatsEnabled) {
+            if (stats) update(*stats);
+        }
+    }
+
+private:
+    // step() fails over to outOfSteps() past this; 0 makes the first step
+    // read maxSteps.
+    uint64_t stepLimit = 0;
+    void outOfSteps();
+
+    std::unique_ptr<TaskScheduler> ownedScheduler;
+};
+
+// Approximate bytes held by one variable / a whole environment.
+size_t variableFootprint(const std::string& name, const Value& value);
+size_t environmentFootprint(const Environment& env);
+
+// `env[name] = value`, keeping the interpreter's memory accounting in step.
+void setVariable(Environment& env, const std::string& name, Value value);
+
+// One evaluation of a `kind` node / one environment lookup, for --stats.
+inline void countNode(const Environment& env, NodeKind kind) {
+    if constexpr (kStatsEnabled) {
+        if (env.interpreter && env.interpreter->stats) env.interpreter->stats->nodes[static_cast<size_t>(kind)]++;
+    }
+}
+inline void countLookup(const Environment& env) {
+    if constexpr (kStatsEnabled) {
+        if (env.interpreter && env.interpreter->stats) env.interpreter->stats->lookups++;
+    }
+}
+
+// Counts a call and the environment copied for it, and tracks call depth.
+class CallStats {
+public:
+    CallStats(Interpreter* interpreter, const Environment& copied) {
+        if constexpr (kStatsEnabled) {
+            if (!interpreter || !interpreter->stats) return;
+            stats = interpreter->stats;
+            stats->calls++;
+            stats->environments++;
+            stats->environmentBytes += environmentFootprint(copied);
+            stats->maxDepth = std::max(stats->maxDepth, ++stats->depth);
+        }
+    }
+    ~CallStats() {
+        if constexpr (kStatsEnabled) {
+            if (stats) stats->depth--;
+        }
+    }
+    CallStats(const CallStats&) = delete;
+    CallStats& operator=(const CallStats&) = delete;
+
+private:
+    Stats* stats = nullptr;
+};
+
+// Charges a call frame's environment against the memory cap while it lives.
+class FrameMemory {
+public:
+    explicit FrameMemory(const Environment& frame);
+    ~FrameMemory();
+    FrameMemory(const FrameMemory&) = delete;
+    FrameMemory& operator=(const FrameMemory&) = delete;
+
+private:
+    const Environment& frame;
+    Interpreter* interpreter;
 };
 
 
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+
+// Loops over contiguous doubles behind the bulk array built-ins (sum, dot,
+// min, max, map_add, map_mul, scale). There is a portable set and, on x86-64
+// with GCC or Clang, an AVX2 set picked at runtime when the CPU has it.
+//
+// Both sets give bit-identical results. Reductions accumulate in
+// kKernelLanes interleaved lanes (element i goes to lane i % kKernelLanes),
+// combine the lanes pairwise in a fixed order, then add the leftover tail
+// elements one by one. That order differs from a left-to-right loop, so
+// sum and dot can differ from one in the last bits, but never between
+// machines or runs. No fused multiply-add is used.
+constexpr size_t kKernelLanes = 16;
+
+struct NumericKernels {
+    double (*sum)(const double* a, size_t n);
+    double (*dot)(const double* a, const double* b, size_t n);
+    // n > 0. Same answer as `x < m ? x : m` over the lanes, NaN included.
+    double (*min)(const double* a, size_t n);
+    double (*max)(const double* a, size_t n);
+    // out[i] = a[i] op b[i], and out[i] = a[i] op k; `out` may alias `a`.
+    void (*add)(const double* a, const double* b, double* out, size_t n);
+    void (*mul)(const double* a, const double* b, double* out, size_t n);
+    void (*addScalar)(const double* a, double k, double* out, size_t n);
+    void (*mulScalar)(const double* a, double k, double* out, size_t n);
+};
+
+const NumericKernels& scalarKernels();
+// Null unless built with AVX2 support and running on a CPU that has it.
+const NumericKernels* avx2Kernels();
+// The fastest set available, chosen on first use.
+const NumericKernels& numericKernels();
+
+// out[i] = a[0] + ... + a[i], added left to right like a script loop would.
+void prefixSum(const double* a, double* out, size_t n);
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "memory_charge.hpp"
+#include "value.hpp"
+
+// A hash map value with number or string keys. Like arrays, maps are shared
+// handles and lock on every operation.
+//
+// Entries are kept in insertion order, which is the order keys() and print
+// list them in; setting an existing key keeps its place, and a deleted key
+// that is set again goes to the end. Lookups go through an open-addressing
+// index in the style of a Swiss table: one control byte per slot holding 7
+// bits of the key's hash, so a probe skips non-matching slots without
+// touching the entries. Each entry caches its full hash, so growing the
+// table never hashes a string again. Number keys hash their bits directly.
+//
+// Like an array's, a map's storage counts against the memory cap of the
+// interpreter passed to charge() or set() until the map is destroyed.
+class Map {
+public:
+    Map() = default;
+
+    size_t size() const;
+    // Approximate bytes held, for the memory cap.
+    size_t bytes() const;
+
+    // Charges the storage held now to `interpreter`, e.g. for a new map.
+    void charge(Interpreter* interpreter);
+
+    // Keys must be numbers (not NaN) or strings; other keys throw. A set()
+    // that grows the map past the cap still stores the entry, then throws.
+    bool get(const Value& key, Value& value) const;
+    void set(const Value& key, Value value, Interpreter* interpreter = nullptr);
+    bool has(const Value& key) const;
+    bool erase(const Value& key);
+
+    std::vector<Value> keys() const;
+    std::vector<std::pair<Value, Value>> entries() const;
+
+private:
+    struct Entry {
+        Value key;
+        Value value;
+        uint64_t hash;
+        bool live;
+    };
+
+    static uint64_t hashKey(const Value& key);
+    size_t find(const Value& key, uint64_t hash) const;
+    void place(uint32_t entry, uint64_t hash);
+    void rebuild();
+    size_t storedBytes() const;
+
+    mutable std::mutex mutex;
+    std::vector<Entry> order;
+    size_t liveCount = 0;
+    // Index table: capacity is a power of two (or zero before the first set).
+    std::vector<uint8_t> control;
+    std::vector<uint32_t> slots;
+    size_t usedSlots = 0;  // live plus deleted
+    MemoryCharge charged;
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file. Regular files are mapped where mmap is
+// available, so the contents are paged in on demand instead of copied into a
+// heap buffer; anything else (a pipe, /dev/stdin) is read into one.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Returns false if the file cannot be opened or mapped.
+    bool open(const std::string& path);
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    void close();
+
+    const char* bytes = nullptr;
+    size_t length = 0;
+    std::string fallback;
+#ifndef _WIN32
+    bool mapped = false;
+#endif
+};
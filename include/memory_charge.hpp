@@ -0,0 +1,34 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+class Interpreter;
+
+// Bytes held by the arrays and maps an interpreter has built. The containers
+// may outlive the interpreter, or be destroyed on another thread, so they
+// share this with it and give their bytes back here.
+struct ContainerMemory {
+    std::atomic<size_t> used{0};
+};
+
+// What one array or map holds against the memory cap. The first interpreter
+// with a cap that charges it keeps the charge; changes the container's own
+// lock guards. Whatever is still charged is given back on destruction.
+class MemoryCharge {
+public:
+    MemoryCharge() = default;
+    MemoryCharge(const MemoryCharge&) = delete;
+    MemoryCharge& operator=(const MemoryCharge&) = delete;
+    ~MemoryCharge() {
+        if (account) account->used -= bytes;
+    }
+
+    // Charges `total` bytes from now on. Growth must fit under `interpreter`'s
+    // cap, if it has one, or this throws LimitError without charging it.
+    void update(Interpreter* interpreter, size_t total);
+
+private:
+    std::shared_ptr<ContainerMemory> account;
+    size_t bytes = 0;
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "value.hpp"
+
+// Longest text formatNumber can produce, e.g. "-1.23457e-308".
+constexpr size_t kMaxNumberChars = 32;
+
+// Formats like `std::ostream << double` with default flags (printf "%g",
+// six significant digits) and returns the number of chars written.
+size_t formatNumber(double value, char* out);
+// The same for an integer: exactly as formatNumber(double(value)) would, so
+// whole numbers print alike whichever kind they are.
+size_t formatNumber(int64_t value, char* out);
+
+// Thrown by OutputSink once a run has printed more than its output limit.
+struct OutputLimitError : std::runtime_error {
+    OutputLimitError() : std::runtime_error("Output limit exceeded") {}
+};
+
+// Destination for `print`. Text is collected in a buffer and written to the
+// underlying stream only when the buffer fills, on flush() (end of a run or
+// an error), or - in LineBuffered mode, for the interactive REPL - after
+// every line. Either way the stream is flushed along with the buffer.
+class OutputSink {
+public:
+    enum class Mode { FullyBuffered, LineBuffered };
+
+    explicit OutputSink(std::ostream& out = std::cout, Mode mode = Mode::FullyBuffered,
+                        size_t capacity = 64 * 1024);
+    ~OutputSink();
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    // Writes `value` the way `print` shows it, followed by a newline.
+    void print(const Value& value);
+    void write(std::string_view text);
+    void writeNumber(double value);
+    void writeNumber(int64_t value);
+    void endLine();
+    void flush();
+
+    // Caps the total bytes written (0 = no limit). Output up to the limit is
+    // kept; the write that crosses it throws OutputLimitError.
+    void setLimit(size_t maxBytes) { limit = maxBytes; }
+    size_t limitBytes() const { return limit; }
+    bool truncated() const { return limitReached; }
+
+private:
+    void writeValue(const Value& value, int depth);
+    void append(std::string_view text);
+
+    std::ostream& out;
+    Mode mode;
+    size_t capacity;
+    std::string buffer;
+    size_t limit = 0;
+    size_t written = 0;
+    bool limitReached = false;
+};
@@ -7,12 +7,29 @@
 #include <vector>
 #include <memory>
 #include <string>
+#include <limits>
+#include <utility>
+
+// Eager builds every function body up front. LazyFunctions only brace-matches
+// a body and records where it starts; the body is parsed on its first call.
+enum class ParseMode { Eager, LazyFunctions };
 
 class Parser {
 public:
     Parser(const std::vector<Token>& tokens) : tokens(tokens), current(0) {}
+    // Deferred bodies keep the token buffer alive, so lazy parsing needs shared ownership.
+    Parser(std::shared_ptr<const std::vector<Token>> source, ParseMode mode)
+        : tokens(*source), current(0), sharedTokens(std::move(source)), mode(mode) {}
     std::shared_ptr<Stmt> parseStatement();
     std::vector<std::shared_ptr<Stmt>> parse();
+    // Same result as parse(), but independent top-level function declarations
+    // are parsed concurrently. On a syntax error the sequential parser is
+    // rerun so the first error in source order is the one reported.
+    std::vector<std::shared_ptr<Stmt>> parseParallel(size_t threads);
+
+    // Parses the body of a function that was pre-parsed in LazyFunctions
+    // mode. Not synchronized; go through FunctionStmt::parsedBody().
+    static void parseDeferredBody(const FunctionStmt& function);
 
 private:
     std::shared_ptr<Expr> parseExpression();
@@ -30,6 +47,9 @@ private:
     std::shared_ptr<Expr> parseLogicAnd();
     std::shared_ptr<Expr> parseCall();
     std::shared_ptr<Stmt> parseForStatement();
+    std::shared_ptr<Stmt> parseParforStatement();
+    std::shared_ptr<Stmt> parseJump();
+    std::shared_ptr<Stmt> parseLoopBody(bool parfor);
     std::shared_ptr<Expr> parsePostfix();
     bool match(const std::vector<TokenType>& types);
     bool check(TokenType type);
@@ -38,9 +58,25 @@ private:
     bool isAtEnd();
     Token peek();
     Token previous();
+    void skipBlock();
+    std::vector<std::pair<size_t, size_t>> splitTopLevel();
 
     const std::vector<Token>& tokens;
     size_t current;
+    size_t end = std::numeric_limits<size_t>::max();
+    std::shared_ptr<const std::vector<Token>> sharedTokens;
+    ParseMode mode = ParseMode::Eager;
+    // The innermost loop of the current function, which break and continue
+    // belong to. parfor has no break: its iterations run in parallel.
+    enum class Loop { None, Sequential, Parfor };
+    Loop loop = Loop::None;
+    // Statements, expressions, assignments, unary operators and operands of a
+    // binary operator chain (each operator puts the chain so far one level
+    // deeper in the tree) being parsed inside each other. Past kMaxNesting the source is rejected instead of overflowing
+    // the native stack, here or later when the tree is run or compiled.
+    static constexpr int kMaxNesting = 1000;
+    int nesting = 0;
+    class Nested;
 };
 
 #endif
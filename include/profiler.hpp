@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+
+// The functions an interpreter is running, outermost ("main") first, and the
+// line each one is at. Call::evaluate pushes and pops frames and statements
+// update the innermost line. Written only by the interpreter's thread, with
+// plain stores and signal fences, so a signal handler interrupting that
+// thread can read a consistent stack.
+class ShadowStack {
+public:
+    // Calls nested deeper than this are tracked but not recorded.
+    static constexpr int kMaxDepth = 128;
+
+    ShadowStack() {
+        functions[0] = "main";
+        depth.store(1, std::memory_order_relaxed);
+    }
+
+    void push(const char* function) {
+        int d = depth.load(std::memory_order_relaxed);
+        if (d < kMaxDepth) {
+            functions[d] = function;
+            lines[d].store(0, std::memory_order_relaxed);
+        }
+        std::atomic_signal_fence(std::memory_order_release);
+        depth.store(d + 1, std::memory_order_relaxed);
+    }
+    void pop() { depth.store(depth.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed); }
+    void setLine(int line) {
+        int d = depth.load(std::memory_order_relaxed);
+        if (d <= kMaxDepth) lines[d - 1].store(line, std::memory_order_relaxed);
+    }
+
+private:
+    friend class Profiler;
+
+    std::atomic<int> depth{0};
+    const char* functions[kMaxDepth];
+    std::atomic<int> lines[kMaxDepth] = {};
+};
+
+// Pushes a frame for the lifetime of a call, if there is a stack to push to.
+class ShadowFrame {
+public:
+    ShadowFrame(ShadowStack* stack, const char* function) : stack(stack) {
+        if (stack) stack->push(function);
+    }
+    ~ShadowFrame() {
+        if (stack) stack->pop();
+    }
+    ShadowFrame(const ShadowFrame&) = delete;
+    ShadowFrame& operator=(const ShadowFrame&) = delete;
+
+private:
+    ShadowStack* stack;
+};
+
+// Samples a ShadowStack kSampleHz times per second of CPU time used by the
+// thread that called start(), via SIGPROF, and counts identical stacks.
+// Counting happens in the signal handler, in tables allocated up front, so
+// nothing allocates or locks while sampling. One profiler runs at a time.
+// POSIX only; start() throws elsewhere.
+class Profiler {
+public:
+    static constexpr int kSampleHz = 1000;
+
+    explicit Profiler(const ShadowStack& stack);
+    ~Profiler();
+
+    void start();
+    void stop();
+
+    // One line per distinct stack in folded format, "main;f;g:12 34": the
+    // functions from the outside in, the line the innermost one was at, and
+    // the number of samples. Lines are sorted, so equal profiles are equal.
+    // Function names are read from the program, so call this before freeing it.
+    void writeFolded(std::ostream& out) const;
+    uint64_t samples() const { return taken.load(std::memory_order_relaxed); }
+    // Samples lost because the tables were full.
+    uint64_t dropped() const { return lost.load(std::memory_order_relaxed); }
+
+private:
+    struct Folded {
+        uint64_t hash;
+        uint32_t count;
+        uint32_t offset;  // of its frames in `frames`
+        int depth;
+        int line;
+    };
+
+    static void onSignal(int);
+    void record();
+
+    const ShadowStack& stack;
+    std::unique_ptr<Folded[]> table;
+    std::unique_ptr<const char*[]> frames;
+    size_t framesUsed = 0;
+    std::atomic<uint64_t> taken{0};
+    std::atomic<uint64_t> lost{0};
+    bool running = false;
+    // Timer and previous SIGPROF handler, kept opaque to keep <signal.h> out.
+    struct Platform;
+    std::unique_ptr<Platform> platform;
+};
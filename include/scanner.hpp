@@ -1,17 +1,20 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include "token.hpp"
 #include <any>
 
 class Scanner {
 public:
-    explicit Scanner(const std::string& source) : source(source) {}
+    // The scanner only reads through `source`; tokens own copies of their text,
+    // so the viewed buffer (e.g. a memory-mapped file) need only outlive scanTokens().
+    explicit Scanner(std::string_view source) : source(source) {}
 
     std::vector<Token> scanTokens();
 
 private:
-    const std::string& source;
+    std::string_view source;
     std::vector<Token> tokens;
     size_t start = 0;
     size_t current = 0;
@@ -21,6 +24,7 @@ private:
     char advance();
     void addToken(TokenType type, std::any literal = {});
     char peek();
+    char peekNext();
     bool match(char expected);
 
     void scanToken();
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "stmt.hpp"
+
+// Precompiled program cache (.clangc). Layout: a header (magic "CLGC",
+// format version, hash of the source it was compiled from), a table of every
+// distinct name/string in the program, then the statements as a pre-order
+// stream of tagged nodes. Bump kProgramCacheVersion whenever the node set or
+// encoding changes so stale caches are ignored instead of misread.
+constexpr uint32_t kProgramCacheVersion = 8;
+
+uint64_t hashSource(std::string_view source);
+
+// Lazily parsed function bodies are parsed here, so this throws on a syntax
+// error that the lazy pre-parse let through.
+std::string serializeProgram(const std::vector<std::shared_ptr<Stmt>>& statements, uint64_t sourceHash);
+
+// Returns false, leaving `statements` empty, if `data` is not a cache of
+// this format version for a source with the given hash, or is corrupt.
+// The nodes share a few large allocations, freed once none of them is left.
+bool deserializeProgram(const char* data, size_t size, uint64_t sourceHash,
+                        std::vector<std::shared_ptr<Stmt>>& statements);
+
+// Interpreter snapshot (--write-snapshot / --snapshot): the globals a program
+// left behind, so later runs can start from them without running it again.
+// Same header and string table as the program cache (magic "CLGS", no source
+// hash), then the functions the globals hold (FunctionStmt nodes with their
+// body's length before it), the arrays and maps reachable from them (numeric
+// arrays as raw doubles), and each global's name and value. Values refer to
+// strings, functions and objects by index, and to built-ins by name, so the
+// image has no pointers and loads at any address, and arrays and maps shared
+// between globals (or cyclic) stay that way.
+//
+// Throws std::runtime_error if a global holds a task, a channel or an
+// embedder's native function.
+std::string serializeSnapshot(const Environment& globals);
+
+// Adds the snapshot's globals to `globals`, charging them to its interpreter's
+// memory cap. Returns false, adding nothing, if `data` is not a snapshot of
+// this format version or is corrupt. Function bodies are left in `data` and
+// read on first call (a corrupt one fails then), so `owner` must keep
+// `data` alive for as long as the functions may be called.
+bool deserializeSnapshot(const char* data, size_t size, std::shared_ptr<const void> owner, Environment& globals);
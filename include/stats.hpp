@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+// Execution counters for --stats. Building with -DCODELANG_STATS=OFF defines
+// this as 0, which compiles every counter update out of the interpreter.
+#ifndef CODELANG_STATS
+#define CODELANG_STATS 1
+#endif
+
+constexpr bool kStatsEnabled = CODELANG_STATS != 0;
+
+// Every node type, for counting evaluations by kind.
+enum class NodeKind : uint8_t {
+    Literal, Variable, Assign, Binary, Logical, Unary, Call, Postfix, Spawn, Await,
+    ArrayLiteral, Index, IndexAssign, MapLiteral,
+    ExpressionStmt, PrintStmt, VarStmt, BlockStmt, IfStmt, WhileStmt, FunctionStmt, ReturnStmt, ParforStmt,
+    BreakStmt, ContinueStmt,
+    Count
+};
+
+const char* nodeKindName(NodeKind kind);
+
+// Counters of one run. Only the interpreter's own thread updates them, so
+// tasks and parfor chunks (which run in interpreters of their own) are not
+// counted, except for parfor's loop iterations.
+struct Stats {
+    uint64_t nodes[static_cast<size_t>(NodeKind::Count)] = {};
+    uint64_t calls = 0;
+    uint64_t depth = 0;  // calls currently running
+    uint64_t maxDepth = 0;
+    // Call::evaluate copies its caller's environment for every call.
+    uint64_t environments = 0;
+    uint64_t environmentBytes = 0;  // as estimated by environmentFootprint
+    // Strings built by `+`.
+    uint64_t strings = 0;
+    uint64_t stringBytes = 0;
+    // Variable reads, writes and function lookups in the environment.
+    uint64_t lookups = 0;
+    uint64_t loopIterations = 0;
+
+    double scanMs = 0;
+    double parseMs = 0;  // or the time to load the program cache
+    double executeMs = 0;
+    bool cached = false;  // loaded from the program cache, not scanned
+
+    // A table for people, and one JSON object on a single line for tools.
+    void writeText(std::ostream& out) const;
+    void writeJson(std::ostream& out) const;
+};
@@ -1,22 +1,27 @@
 #pragma once
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <iostream>
 #include "expr.hpp"
 #include "value.hpp"
+#include "interpreter.hpp"
 
-using Environment = std::unordered_map<std::string, Value>;
+struct Chunk;
 
 struct Stmt {
     virtual ~Stmt() = default;
-    virtual void execute(Environment& env) = 0;
+    virtual void execute(Environment& env) const = 0;
+    int line = 0;  // where the statement starts, 0 if unknown
 };
 
 struct ExpressionStmt : public Stmt {
     std::shared_ptr<Expr> expression;
     ExpressionStmt(std::shared_ptr<Expr> expression) : expression(expression) {}
-    void execute(Environment& env) override {
+    void execute(Environment& env) const override {
+        countNode(env, NodeKind::ExpressionStmt);
         expression->evaluate(env);
     }
 };
@@ -24,12 +29,14 @@ struct ExpressionStmt : public Stmt {
 struct PrintStmt : public Stmt {
     std::shared_ptr<Expr> expression;
     PrintStmt(std::shared_ptr<Expr> expression) : expression(expression) {}
-    void execute(Environment& env) override {
+    void execute(Environment& env) const override {
+        countNode(env, NodeKind::PrintStmt);
         Value val = expression->evaluate(env);
-        if (std::holds_alternative<double>(val))
-            std::cout << std::get<double>(val) << std::endl;
-        else if (std::holds_alternative<std::string>(val))
-            std::cout << std::get<std::string>(val) << std::endl;
+        if (env.interpreter) {
+            env.interpreter->output.print(val);
+        } else {
+            OutputSink(std::cout, OutputSink::Mode::LineBuffered, 0).print(val);
+        }
     }
 };
 
@@ -38,17 +45,21 @@ struct VarStmt : public Stmt {
     std::shared_ptr<Expr> initializer;
     VarStmt(const std::string& name, std::shared_ptr<Expr> initializer)
         : name(name), initializer(initializer) {}
-    void execute(Environment& env) override {
-        env[name] = initializer->evaluate(env);
+    void execute(Environment& env) const override {
+        countNode(env, NodeKind::VarStmt);
+        setVariable(env, name, initializer->evaluate(env));
     }
 };
 
 struct BlockStmt : public Stmt {
     std::vector<std::shared_ptr<Stmt>> statements;
     BlockStmt(std::vector<std::shared_ptr<Stmt>> stmts) : statements(std::move(stmts)) {}
-    void execute(Environment& env) override {
+    void execute(Environment& env) const override {
+        countNode(env, NodeKind::BlockStmt);
         for (auto& stmt : statements) {
+            if (env.interpreter) env.interpreter->atLine(stmt->line);
             stmt->execute(env);
+            if (env.jump != Jump::None) return;
         }
     }
 };
@@ -61,9 +72,9 @@ struct IfStmt : public Stmt {
     IfStmt(std::shared_ptr<Expr> cond, std::shared_ptr<Stmt> thenBr, std::shared_ptr<Stmt> elseBr = nullptr)
         : condition(cond), thenBranch(thenBr), elseBranch(elseBr) {}
 
-    void execute(Environment& env) override {
-        Value condVal = condition->evaluate(env);
-        if (std::holds_alternative<double>(condVal) && std::get<double>(condVal) != 0.0) {
+    void execute(Environment& env) const override {
+        countNode(env, NodeKind::IfStmt);
+        if (isTruthy(condition->evaluate(env))) {
             thenBranch->execute(env);
         } else if (elseBranch) {
             elseBranch->execute(env);
@@ -71,19 +82,30 @@ struct IfStmt : public Stmt {
     }
 };
 
+// Also what `for` loops become: `increment` is a for loop's, evaluated after
+// the body even when the body ends with `continue`.
 struct WhileStmt : public Stmt {
     std::shared_ptr<Expr> condition;
     std::shared_ptr<Stmt> body;
-
-    WhileStmt(std::shared_ptr<Expr> cond, std::shared_ptr<Stmt> body)
-        : condition(cond), body(body) {}
-
-    void execute(Environment& env) override {
-        while (true) {
-            Value condVal = condition->evaluate(env);
-            if (!std::holds_alternative<double>(condVal) || std::get<double>(condVal) == 0.0)
-                break;
+    std::shared_ptr<Expr> increment;  // or null
+
+    WhileStmt(std::shared_ptr<Expr> cond, std::shared_ptr<Stmt> body, std::shared_ptr<Expr> increment = nullptr)
+        : condition(cond), body(body), increment(std::move(increment)) {}
+
+    void execute(Environment& env) const override {
+        countNode(env, NodeKind::WhileStmt);
+        while (isTruthy(condition->evaluate(env))) {
+            if (env.interpreter) {
+                env.interpreter->step();
+                env.interpreter->count([](Stats& stats) { stats.loopIterations++; });
+            }
             body->execute(env);
+            if (env.jump != Jump::None) {
+                bool broke = env.jump == Jump::Break;
+                env.jump = Jump::None;
+                if (broke) break;
+            }
+            if (increment) increment->evaluate(env);
         }
     }
 };
@@ -91,20 +113,87 @@ struct WhileStmt : public Stmt {
 struct FunctionStmt : public Stmt, public std::enable_shared_from_this<FunctionStmt> {
     std::string name;
     std::vector<std::string> params;
-    std::vector<std::shared_ptr<Stmt>> body;
+    // Empty until parsedBody() has run for a lazily parsed function.
+    mutable std::vector<std::shared_ptr<Stmt>> body;
+    // Set while the body is still unparsed (ParseMode::LazyFunctions): the
+    // body's tokens start at deferredStart, just past the opening '{'.
+    mutable std::shared_ptr<const std::vector<Token>> deferredTokens;
+    size_t deferredStart = 0;
+    // Set while the body is still in a snapshot image: reads it from there.
+    mutable std::function<std::vector<std::shared_ptr<Stmt>>()> deferredLoad;
 
     FunctionStmt(std::string name, std::vector<std::string> params, std::vector<std::shared_ptr<Stmt>> body)
         : name(std::move(name)), params(std::move(params)), body(std::move(body)) {}
 
-    void execute(Environment& env) override {
-    env[name] = std::static_pointer_cast<Stmt>(shared_from_this());
+    // The body, parsing it first if it was deferred. Filling in a deferred
+    // body is the only change ever made to compiled code, and it happens at
+    // most once even when several threads call the function at the same time.
+    const std::vector<std::shared_ptr<Stmt>>& parsedBody() const;
+    // The body as bytecode for the stackless evaluator, compiled on first use.
+    const Chunk& compiled() const;
+
+    void execute(Environment& env) const override {
+        countNode(env, NodeKind::FunctionStmt);
+    setVariable(env, name, std::static_pointer_cast<const Stmt>(shared_from_this()));
     }
+
+private:
+    mutable std::once_flag bodyParsed;
+    mutable std::once_flag bodyCompiled;
+    mutable std::shared_ptr<const Chunk> code;
 };
 
 struct ReturnStmt : public Stmt {
     std::shared_ptr<Expr> value;
     ReturnStmt(std::shared_ptr<Expr> value) : value(value) {}
-    void execute(Environment& env) override {
+    void execute(Environment& env) const override {
+        countNode(env, NodeKind::ReturnStmt);
         throw value->evaluate(env);
     }
 };
+
+// `break;` and `continue;`. They don't unwind anything: they set env.jump,
+// which makes blocks skip their remaining statements until the loop sees it.
+// The parser only accepts them inside a loop of the same function.
+struct BreakStmt : public Stmt {
+    void execute(Environment& env) const override {
+        countNode(env, NodeKind::BreakStmt);
+        env.jump = Jump::Break;
+    }
+};
+
+struct ContinueStmt : public Stmt {
+    void execute(Environment& env) const override {
+        countNode(env, NodeKind::ContinueStmt);
+        env.jump = Jump::Continue;
+    }
+};
+
+// `parfor (let i = a; i < b; i = i + step) reduce(+, acc) { ... }`: runs the
+// iterations in chunks on the worker pool, each chunk with a private copy of
+// the variables. Reductions are combined in chunk order and the chunking
+// depends only on the iteration count, so results are the same for any
+// number of threads. The parser rejects bodies that assign anything other
+// than their own locals and the reduction variables.
+struct ParforStmt : public Stmt {
+    struct Reduction {
+        std::string op;
+        std::string name;
+    };
+
+    std::string var;
+    std::shared_ptr<Expr> start;
+    std::string comparison;  // "<", "<=", ">" or ">="
+    std::shared_ptr<Expr> bound;
+    std::shared_ptr<Expr> step;
+    std::vector<Reduction> reductions;
+    std::shared_ptr<Stmt> body;
+
+    ParforStmt(std::string var, std::shared_ptr<Expr> start, std::string comparison, std::shared_ptr<Expr> bound,
+               std::shared_ptr<Expr> step, std::vector<Reduction> reductions, std::shared_ptr<Stmt> body)
+        : var(std::move(var)), start(std::move(start)), comparison(std::move(comparison)),
+          bound(std::move(bound)), step(std::move(step)), reductions(std::move(reductions)),
+          body(std::move(body)) {}
+
+    void execute(Environment& env) const override;
+};
@@ -0,0 +1,125 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "fiber.hpp"
+#include "interpreter.hpp"
+#include "thread_pool.hpp"
+#include "value.hpp"
+
+struct FunctionStmt;
+class Task;
+
+// Reserved size of each task's stack; only the pages a task touches are backed.
+constexpr size_t kTaskStackSize = 8 * 1024 * 1024;
+
+// Runs tasks on a work-stealing pool of OS threads. A task that blocks in
+// await, send or recv is parked and its worker picks up other work; waking
+// it schedules it again, possibly on a different worker.
+class TaskScheduler {
+public:
+    explicit TaskScheduler(size_t threads);
+
+    void schedule(std::shared_ptr<Task> task);
+    // No task is queued or running: each one has finished or is parked.
+    bool idle() const { return runnable == 0; }
+    // The pool itself, shared with parfor chunks.
+    ThreadPool& workers() { return pool; }
+
+private:
+    std::atomic<size_t> runnable{0};
+    ThreadPool pool;  // last member, so its workers are joined first
+};
+
+// Tasks and threads blocked on a Task or Channel, guarded by its mutex.
+// Tasks are parked; any other thread (the main program) sleeps, and fails
+// with a deadlock error once no task is left that could wake it.
+class WaitList {
+public:
+    template <typename Ready>
+    void waitUntil(std::unique_lock<std::mutex>& lock, TaskScheduler* scheduler, Ready ready) {
+        while (!ready()) block(lock, scheduler);
+    }
+    void wakeAll();
+
+private:
+    void block(std::unique_lock<std::mutex>& lock, TaskScheduler* scheduler);
+
+    std::vector<std::shared_ptr<Task>> tasks;
+    std::condition_variable threads;
+};
+
+// A call started by `spawn`: a green thread with its own stack and its own
+// Interpreter (memory and output are per task; steps come out of the
+// program's shared budget). It starts with a copy of the spawning
+// environment, so globals are shared read-only.
+class Task : public std::enable_shared_from_this<Task> {
+public:
+    ~Task();
+
+    // Starts `function(args)` as a task of `parent`, seeing a copy of `env`.
+    static std::shared_ptr<Task> spawn(Interpreter& parent, std::shared_ptr<const FunctionStmt> function,
+                                       std::vector<Value> args, const Environment& env);
+
+    // Blocks until the task has finished. The first await writes the task's
+    // output to `waiter` and adds its steps to the waiter's count; every await returns its result or rethrows its error.
+    Value await(Interpreter& waiter);
+    // Like await, but does nothing for a task that was already awaited.
+    void join(Interpreter& waiter);
+
+    // The task running on this thread, or null outside of tasks.
+    static Task* current();
+
+private:
+    friend class TaskScheduler;
+    friend class WaitList;
+
+    Task(Interpreter& parent, std::shared_ptr<const FunctionStmt> function, std::vector<Value> args);
+    void run();
+    Value finish(Interpreter& waiter, bool always);
+
+    std::shared_ptr<const FunctionStmt> function;
+    std::vector<Value> args;
+    TaskScheduler* scheduler;
+    std::ostringstream buffer;
+    // Both released as soon as the task finishes.
+    std::unique_ptr<Interpreter> interpreter;
+    std::unique_ptr<Fiber> fiber;
+    // Set while a parking fiber is still on its way off the worker's stack;
+    // a worker resuming the task waits for it to clear.
+    std::atomic<bool> switchingOut{false};
+
+    std::mutex mutex;
+    WaitList waiters;
+    bool done = false;
+    bool collected = false;
+    Value result;
+    std::exception_ptr error;
+    std::string output;
+    uint64_t steps = 0;
+};
+
+// Bounded FIFO of values for passing data between tasks. send blocks while
+// the channel is full, recv while it is empty.
+class Channel {
+public:
+    explicit Channel(size_t capacity) : capacity(capacity) {}
+
+    // `scheduler` is the caller's, used only to detect a deadlock.
+    void send(Value value, TaskScheduler* scheduler);
+    Value recv(TaskScheduler* scheduler);
+
+private:
+    std::mutex mutex;
+    size_t capacity;
+    std::deque<Value> items;
+    WaitList senders;
+    WaitList receivers;
+};
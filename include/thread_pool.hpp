@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool: every worker has its own deque. Jobs submitted from a
+// worker go to the back of that worker's deque and it takes its newest job
+// first; idle workers steal the oldest job from another worker's front.
+// Jobs submitted from outside the pool are spread round-robin.
+// Jobs must not throw; catch and record failures inside the job instead.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> job);
+    // Blocks until every submitted job has finished.
+    void wait();
+
+    size_t size() const { return workers.size(); }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> jobs;
+    };
+
+    void workerLoop(size_t index);
+    bool takeJob(size_t index, std::function<void()>& job);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> nextQueue{0};
+    // Jobs sitting in some deque. A steal can briefly run ahead of the count
+    // for a job still being submitted, hence signed.
+    std::atomic<std::ptrdiff_t> queued{0};
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable allDone;
+    size_t pending = 0;
+    bool stopping = false;
+};
@@ -17,6 +17,9 @@ enum class TokenType {
     IDENTIFIER, STRING, NUMBER,
     FUN, RETURN, AND, OR,
     LET, VAR, PRINT,
+    SPAWN, AWAIT, PARFOR,
+    BREAK, CONTINUE,
+    LEFT_BRACKET, RIGHT_BRACKET, COLON,
     END_OF_FILE,
 };
 
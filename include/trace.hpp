@@ -0,0 +1,101 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// A timeline of one process in the Chrome trace-event format, which
+// chrome://tracing and ui.perfetto.dev open. Code marks spans with
+// TraceSpan; while a Tracer is running each finished span becomes a
+// "complete" event in a ring buffer of the thread it finished on. Recording
+// takes no lock: each buffer has a single writer, and a thread only locks
+// once, to register its buffer. A full buffer overwrites its oldest events;
+// function calls have a buffer of their own, so however many there are they
+// never push out phases and statements. Buffers are written out by
+// writeJson() once the traced work is done.
+class Tracer {
+public:
+    static constexpr size_t kDefaultCapacity = 1 << 15;  // calls, and other events, per thread
+    // Names are copied into the event (function names go away with their
+    // program), cut to this many bytes.
+    static constexpr size_t kMaxName = 39;
+    // The category of function call spans.
+    static constexpr const char kCallCategory[] = "call";
+
+    // `callSample`: record one Codelang function call in this many (0: none).
+    explicit Tracer(uint32_t callSample = 1, size_t capacity = kDefaultCapacity);
+    ~Tracer();
+
+    // Makes this the tracer spans record into. One tracer runs at a time.
+    void start();
+    void stop();
+
+    void writeJson(std::ostream& out) const;
+    // Events overwritten because a thread's buffer was full.
+    uint64_t dropped() const;
+
+    // The running tracer, or null: the one check a span makes when tracing is off.
+    static Tracer* active() { return running.load(std::memory_order_acquire); }
+    // The running tracer if the function call about to start on this thread
+    // is one of those sampled, otherwise null.
+    static Tracer* forCall() {
+        Tracer* tracer = active();
+        return tracer && tracer->sampleCall() ? tracer : nullptr;
+    }
+
+    uint64_t now() const {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count());
+    }
+    // `category` must outlive the tracer (a literal).
+    void record(const char* name, const char* category, uint64_t start, uint64_t end, int64_t line);
+
+private:
+    struct Event {
+        char name[kMaxName + 1];
+        const char* category;
+        uint64_t start;  // ns since the tracer was created
+        uint64_t duration;
+        int64_t line;  // shown as an argument if not 0
+    };
+    struct Ring;
+    struct Buffer;
+
+    Buffer& threadBuffer();
+    bool sampleCall();
+
+    static std::atomic<Tracer*> running;
+
+    const uint64_t id;  // tells a thread's cached buffer from an earlier tracer's
+    const uint32_t callSample;
+    const size_t capacity;
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    mutable std::mutex buffersMutex;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+};
+
+// Records the time from its construction to its destruction into
+// `tracer`, by default the one running when it was constructed, if any.
+class TraceSpan {
+public:
+    TraceSpan(const char* name, const char* category, int64_t line = 0)
+        : TraceSpan(Tracer::active(), name, category, line) {}
+    TraceSpan(Tracer* tracer, const char* name, const char* category, int64_t line)
+        : tracer(tracer), name(name), category(category), line(line), start(tracer ? tracer->now() : 0) {}
+    ~TraceSpan() {
+        if (tracer) tracer->record(name, category, start, tracer->now(), line);
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    Tracer* tracer;
+    const char* name;
+    const char* category;
+    int64_t line;
+    uint64_t start;
+};
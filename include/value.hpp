@@ -2,9 +2,62 @@
 #pragma once
 #include <variant>
 #include <string>
+#include <cstdint>
 #include <memory>
 #include <unordered_map>
 
 struct Stmt;  // forward-declared
-using Value = std::variant<double, std::string, std::shared_ptr<Stmt>>;
-using Environment = std::unordered_map<std::string, Value>;
+class Interpreter;
+class Task;
+class Channel;
+class Array;
+class Map;
+struct Native;
+// Numbers are int64_t while they are whole and small enough (integer literals
+// and arithmetic on them), and double otherwise: a literal with a fraction, a
+// division that isn't exact, or a result out of range (kMaxExactInteger). The
+// two kinds compare, hash and print alike. Functions are values that share the
+// program's immutable code, and so are built-ins (Native). Tasks, channels,
+// arrays and maps are handles; every copy refers to the same object.
+using Value = std::variant<double, int64_t, std::string, std::shared_ptr<const Stmt>,
+                           std::shared_ptr<Task>, std::shared_ptr<Channel>, std::shared_ptr<Array>,
+                           std::shared_ptr<Map>, std::shared_ptr<const Native>>;
+
+// Integers stay within ±2^53, where each one is exact as a double too, so
+// integer arithmetic gives exactly the results double arithmetic would and
+// only the representation differs. Results outside the range are doubles.
+constexpr int64_t kMaxExactInteger = int64_t{1} << 53;
+
+inline bool isExactInteger(int64_t value) {
+    return value >= -kMaxExactInteger && value <= kMaxExactInteger;
+}
+
+inline bool isNumber(const Value& value) {
+    return std::holds_alternative<int64_t>(value) || std::holds_alternative<double>(value);
+}
+
+// The number `value` holds, as a double; `value` must be a number.
+inline double asDouble(const Value& value) {
+    if (auto integer = std::get_if<int64_t>(&value)) return static_cast<double>(*integer);
+    return std::get<double>(value);
+}
+
+// `==` in scripts and for map keys: numbers by value whatever their kind,
+// anything else by identity or contents.
+inline bool valuesEqual(const Value& l, const Value& r) {
+    if (l.index() == r.index()) return l == r;
+    if (isNumber(l) && isNumber(r)) return asDouble(l) == asDouble(r);
+    return false;
+}
+
+// A `break` or `continue` on its way to the loop it belongs to.
+enum class Jump : uint8_t { None, Break, Continue };
+
+// Variables in scope, plus the interpreter running the code. `interpreter`
+// is null when nodes are evaluated on their own (e.g. in unit tests).
+struct Environment : std::unordered_map<std::string, Value> {
+    Interpreter* interpreter = nullptr;
+    // Set by break/continue. Blocks stop running statements while it is set,
+    // and the enclosing loop clears it.
+    Jump jump = Jump::None;
+};
@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "value.hpp"
+
+struct Expr;
+struct Stmt;
+class Interpreter;
+
+// Bytecode of the stackless evaluator. A function body is compiled once, on
+// its first call in stackless mode; top-level statements and parfor bodies
+// are compiled when they run. Nodes the Vm doesn't compile (postfix updates,
+// parfor) are handed to their evaluate/execute.
+enum class Op : uint8_t {
+    Constant,     // push constants[a]
+    Load,         // push variable strings[a]
+    Store,        // variable strings[a] = top, which stays unless b is set
+    Pop,
+    Binary,       // pop r, l; push `l op r` with op strings[a]
+    Negate,
+    Not,
+    Truth,        // top = 1 if it holds, else 0
+    Jump,         // to a
+    JumpIfFalse,  // pop; to a unless it holds
+    JumpIfTrue,   // pop; to a if it holds
+    Print,        // pop and print
+    Line,         // the statement at line a starts
+    Step,         // a loop iteration starts
+    Resolve,      // Call nodes[a]: push the function or built-in it calls
+    Call,         // pop a arguments and the function below them; run it (nodes[b] is the call)
+    Return,       // pop the result and return it to the caller
+    Spawn,        // Spawn nodes[a]: pop b arguments, push the task
+    Await,        // pop a task, push its result
+    Array,        // pop a values, push an array of them
+    Map,          // pop a keys and values (alternating), push a map
+    Index,        // pop key, target; push target[key]
+    IndexStore,   // pop value, key, target; target[key] = value; push value
+    Evaluate,     // push nodes[a]->evaluate
+    Execute,      // statements[a]->execute
+};
+
+struct Instruction {
+    Op op;
+    uint32_t a = 0;
+    uint32_t b = 0;
+};
+
+// Code plus its tables. Node pointers point into the syntax tree the chunk
+// was compiled from, which has to outlive it.
+struct Chunk {
+    std::vector<Instruction> code;
+    std::vector<Value> constants;
+    std::vector<std::string> strings;  // variable names and operators
+    std::vector<const Expr*> nodes;
+    std::vector<const Stmt*> statements;
+};
+
+// `statement` as a chunk that returns 0 at the end. A `return` in it (outside any
+// function) throws its value instead, which ends the program.
+std::shared_ptr<const Chunk> compileStatement(const std::shared_ptr<Stmt>& statement);
+// A parfor body: the chunk runs one iteration, and `continue` ends it.
+std::shared_ptr<const Chunk> compileLoopBody(const std::shared_ptr<Stmt>& body);
+
+// Runs chunks without recursing on the native stack: each Codelang call
+// pushes a frame (with the copy of its caller's variables that calls get)
+// onto a vector, and operands live on a vector too. Calls nested deeper than
+// the interpreter's maxDepth fail with "Stack overflow". Because the whole
+// state is in those vectors, a run can stop after any instruction and resume
+// later (start/resume).
+class Vm {
+public:
+    explicit Vm(Interpreter& interpreter);
+    ~Vm();
+    Vm(const Vm&) = delete;
+    Vm& operator=(const Vm&) = delete;
+
+    // Runs `code` with `env` as its variables and returns what it returned.
+    Value run(const Chunk& code, Environment& env);
+
+    // run() in slices: resume() executes up to `budget` instructions and
+    // returns true once the chunk has returned, with its value in result().
+    // `code` and `env` must stay valid until then. If resume() throws, the
+    // run is over.
+    void start(const Chunk& code, Environment& env);
+    bool resume(uint64_t budget = std::numeric_limits<uint64_t>::max());
+    const Value& result() const { return returned; }
+
+    // Frames on the stack, counting the one start() pushed.
+    size_t depth() const;
+
+private:
+    struct Frame;
+
+    void call(size_t argc);
+    void release(Frame& frame);
+    void leave();
+    void unwind();
+
+    Interpreter& interpreter;
+    std::vector<Frame> frames;
+    std::vector<Value> stack;
+    Value returned;
+};
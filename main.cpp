@@ -2,11 +2,23 @@
 #include "parser.hpp"
 #include "interpreter.hpp"
 #include "stmt.hpp"
+#include "serializer.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <cstring>
+#include <cstdlib>
+#include <cstdio>
 #include "repl.hpp"
 
 void printInstructions(std::ostream& out) {
@@ -29,7 +41,7 @@ void printInstructions(std::ostream& out) {
 }
 
 int runRepl(std::istream& in, std::ostream& out) {
-    Interpreter interpreter;
+    Interpreter interpreter(out, OutputSink::Mode::LineBuffered);
     printInstructions(out);
 
     std::string line;
@@ -65,42 +77,487 @@ int runRepl(std::istream& in, std::ostream& out) {
     return 0;
 }
 
+// Exit codes of a run stopped by --max-steps/--max-memory/--max-depth and by --max-output.
+constexpr int kExitResourceLimit = 2;
+constexpr int kExitOutputLimit = 3;
+
+struct ScriptOptions {
+    ParseMode mode = ParseMode::LazyFunctions;
+    size_t parseThreads = 1;
+    std::string cacheDir;  // --cache-dir: where program caches go (empty: not cached)
+    size_t maxOutputBytes = 0;
+    uint64_t maxSteps = 0;
+    size_t maxMemory = 0;
+    size_t taskThreads = 0;  // 0: one per core
+    bool stackless = false;
+    size_t maxDepth = 1000000;
+    std::string snapshotPath;                  // --snapshot: globals to start from
+    std::shared_ptr<const MappedFile> snapshot;  // ... mapped once for every run
+    std::string writeSnapshotPath;             // --write-snapshot: where to save them after
+    std::string profilePath;  // --profile: where to write folded stacks
+    enum class Stats { None, Text, Json } stats = Stats::None;  // --stats, --stats-json
+};
+
+double millisSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Scans and parses `source`. When `cachePath` is set, a precompiled program
+// for exactly this source (same content hash) is loaded from there instead,
+// and on a miss the freshly parsed program is written back for next time.
+// Scan and parse (or cache load) times go in `stats` if given.
+std::vector<std::shared_ptr<Stmt>> compileScript(std::string_view source, const ScriptOptions& options,
+                                                 const std::string& cachePath, Stats* stats = nullptr) {
+    std::vector<std::shared_ptr<Stmt>> statements;
+    uint64_t sourceHash = hashSource(source);
+    auto start = std::chrono::steady_clock::now();
+    if (!cachePath.empty()) {
+        MappedFile cache;
+        TraceSpan span("load program cache", "phase");
+        if (cache.open(cachePath) && deserializeProgram(cache.data(), cache.size(), sourceHash, statements)) {
+            if (stats) {
+                stats->parseMs = millisSince(start);
+                stats->cached = true;
+            }
+            return statements;
+        }
+    }
+
+    start = std::chrono::steady_clock::now();
+    Scanner scanner(source);
+    auto tokens = std::make_shared<const std::vector<Token>>(scanner.scanTokens());
+    if (stats) stats->scanMs = millisSince(start);
+    start = std::chrono::steady_clock::now();
+    Parser parser(tokens, options.mode);
+    statements = parser.parseParallel(options.parseThreads);
+    if (stats) stats->parseMs = millisSince(start);
+
+    if (!cachePath.empty()) {
+        TraceSpan span("write program cache", "phase");
+        try {
+            std::string image = serializeProgram(statements, sourceHash);
+            std::error_code ignored;  // a cache that can't be written is just skipped
+            std::filesystem::create_directories(std::filesystem::path(cachePath).parent_path(), ignored);
+            std::string tmpPath = cachePath + ".tmp";
+            std::ofstream cacheOut(tmpPath, std::ios::binary | std::ios::trunc);
+            cacheOut.write(image.data(), image.size());
+            cacheOut.close();
+            if (cacheOut) {
+                std::rename(tmpPath.c_str(), cachePath.c_str());
+            } else {
+                std::remove(tmpPath.c_str());
+            }
+        } catch (const std::exception&) {
+            // a lazily parsed body with a syntax error: run uncached, the
+            // error is reported if and when that function is called
+        }
+    }
+    return statements;
+}
+
+// Saves `globals` for --write-snapshot, replacing the file only once the
+// whole image is written.
+void writeSnapshot(const std::string& path, const Environment& globals) {
+    std::string image = serializeSnapshot(globals);
+    std::string tmpPath = path + ".tmp";
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    out.write(image.data(), image.size());
+    out.close();
+    if (!out || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        throw std::runtime_error("could not write snapshot '" + path + "'");
+    }
+}
+
 // Script mode: run a whole program at once, quietly (no banner, no prompts).
 // Unlike the REPL, the entire source is scanned and parsed as one unit via
 // Parser::parse(), so statements can span lines and blank lines are fine.
 // Used by the web IDE, and for running .clang script files from the CLI.
-int runScript(std::istream& in, std::ostream& out) {
-    std::stringstream buffer;
-    buffer << in.rdbuf();
-    std::string source = buffer.str();
-
+// Function bodies are parsed lazily on first call unless the mode is Eager
+// (--strict), which reports syntax errors in never-called functions too.
+// The number of steps the run took is stored in `stepsTaken` if given.
+// With --profile the run is sampled and its folded stacks written out, and
+// with --stats its counters are printed to stderr, even if it stopped with an
+// error. Counters are also collected into `stats` if given. With --snapshot
+// the run starts from the snapshot's globals, and with --write-snapshot the
+// globals it ends with are saved if it succeeded.
+int runScript(std::string_view source, std::ostream& out, const ScriptOptions& options,
+              const std::string& cachePath = "", uint64_t* stepsTaken = nullptr, Stats* stats = nullptr) {
+    Interpreter interpreter(out);
+    interpreter.output.setLimit(options.maxOutputBytes);
+    interpreter.maxSteps = options.maxSteps;
+    interpreter.maxMemory = options.maxMemory;
+    interpreter.taskThreads = options.taskThreads;
+    interpreter.stackless = options.stackless;
+    interpreter.maxDepth = options.maxDepth;
+    ShadowStack shadowStack;
+    std::unique_ptr<Profiler> profiler;
+    if (!options.profilePath.empty()) {
+        interpreter.shadowStack = &shadowStack;
+        profiler = std::make_unique<Profiler>(shadowStack);
+    }
+    Stats printedStats;
+    if (!stats && options.stats != ScriptOptions::Stats::None) stats = &printedStats;
+    interpreter.stats = stats;
+    std::vector<std::shared_ptr<Stmt>> statements;
+    int exitCode = 0;
+    std::chrono::steady_clock::time_point executeStart;  // stays zero if compiling fails
     try {
-        Scanner scanner(source);
-        std::vector<Token> tokens = scanner.scanTokens();
-        Parser parser(tokens);
-        std::vector<std::shared_ptr<Stmt>> statements = parser.parse();
-        Interpreter interpreter;
-        interpreter.interpret(statements);
+        if (options.snapshot) {
+            TraceSpan span("load snapshot", "phase");
+            if (!deserializeSnapshot(options.snapshot->data(), options.snapshot->size(), options.snapshot,
+                                     interpreter.environment)) {
+                throw std::runtime_error("'" + options.snapshotPath + "' is not a valid snapshot");
+            }
+        }
+        statements = compileScript(source, options, cachePath, stats);
+        if (profiler) profiler->start();
+        executeStart = std::chrono::steady_clock::now();
+        {
+            TraceSpan span("execute", "phase");
+            interpreter.interpret(statements);
+        }
+        if (!options.writeSnapshotPath.empty()) {
+            TraceSpan span("write snapshot", "phase");
+            writeSnapshot(options.writeSnapshotPath, interpreter.environment);
+        }
+    } catch (const OutputLimitError&) {
+        // whatever fit under the limit has been written; don't add to it
+        exitCode = kExitOutputLimit;
+    } catch (const LimitError& e) {
+        out << "Error: " << e.what() << "\n";
+        exitCode = kExitResourceLimit;
     } catch (const std::exception& e) {
         out << "Error: " << e.what() << "\n";
-        return 1;
+        exitCode = 1;
+    }
+    if (profiler) {
+        profiler->stop();
+        std::ofstream profile(options.profilePath);
+        profiler->writeFolded(profile);
+        std::cerr << "Profile: " << profiler->samples() << " samples written to " << options.profilePath;
+        if (profiler->dropped() != 0) std::cerr << " (" << profiler->dropped() << " dropped)";
+        std::cerr << "\n";
+    }
+    if (stats && executeStart.time_since_epoch().count() != 0) stats->executeMs = millisSince(executeStart);
+    if (stats == &printedStats) {
+        if (options.stats == ScriptOptions::Stats::Json) {
+            printedStats.writeJson(std::cerr);
+            std::cerr << "\n";
+        } else {
+            printedStats.writeText(std::cerr);
+        }
+    }
+    if (stepsTaken) *stepsTaken = interpreter.steps;
+    return exitCode;
+}
+
+// Serve mode: a long-lived worker for the playground server, so a run costs
+// no process startup. Each job arrives on stdin as a 4-byte little-endian
+// length followed by that many bytes: a flags byte (bit 0 = collect --stats)
+// and the source. Each reply on stdout is a 4-byte little-endian length
+// followed by the exit code (1 byte), flags (1 byte, bit 0 = output hit
+// --max-output, bit 1 = stats follow), the stats as a 4-byte length and a
+// JSON object if requested, and the program's output. Every job runs in a
+// fresh Interpreter, so no state carries over between jobs.
+int runServe(const ScriptOptions& options) {
+    auto readLength = [](uint32_t& length) {
+        unsigned char bytes[4];
+        if (!std::cin.read(reinterpret_cast<char*>(bytes), sizeof(bytes))) return false;
+        length = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (uint32_t(bytes[3]) << 24);
+        return true;
+    };
+    auto writeLength = [](uint32_t length) {
+        char bytes[4] = {char(length & 0xff), char((length >> 8) & 0xff),
+                         char((length >> 16) & 0xff), char((length >> 24) & 0xff)};
+        std::cout.write(bytes, sizeof(bytes));
+    };
+
+    uint32_t length;
+    std::string source;
+    while (readLength(length) && length > 0) {
+        TraceSpan jobSpan("job", "serve");
+        int jobFlags = std::cin.get();
+        source.resize(length - 1);
+        {
+            TraceSpan readSpan("read input", "io");
+            if (!std::cin.read(&source[0], length - 1)) break;
+        }
+
+        std::ostringstream output;
+        Stats stats;
+        bool wantStats = kStatsEnabled && (jobFlags & 1) != 0;
+        int exitCode = runScript(source, output, options, "", nullptr, wantStats ? &stats : nullptr);
+        bool truncated = exitCode == kExitOutputLimit;
+        std::string result = output.str();
+        std::string statsJson;
+        if (wantStats) {
+            std::ostringstream json;
+            stats.writeJson(json);
+            statsJson = json.str();
+        }
+
+        size_t statsSize = wantStats ? 4 + statsJson.size() : 0;
+        writeLength(static_cast<uint32_t>(2 + statsSize + result.size()));
+        std::cout.put(static_cast<char>(exitCode));
+        std::cout.put(static_cast<char>((truncated ? 1 : 0) | (wantStats ? 2 : 0)));
+        if (wantStats) {
+            writeLength(static_cast<uint32_t>(statsJson.size()));
+            std::cout.write(statsJson.data(), static_cast<std::streamsize>(statsJson.size()));
+        }
+        std::cout.write(result.data(), static_cast<std::streamsize>(result.size()));
+        std::cout.flush();
     }
     return 0;
 }
 
+// Reads all of `in` into one growable buffer (stdin can't be mapped).
+std::string readAll(std::istream& in) {
+    TraceSpan span("read input", "io");
+    std::string source;
+    char chunk[64 * 1024];
+    while (in.read(chunk, sizeof(chunk)) || in.gcount() > 0) {
+        source.append(chunk, static_cast<size_t>(in.gcount()));
+    }
+    return source;
+}
+
+// The program cache of a script, or "" without --cache-dir. dir/foo.clang
+// caches to <cache dir>/foo-<hash of the script's full path>.clangc, so
+// scripts of the same name in different directories don't share one.
+std::string cachePathFor(const std::string& scriptPath, const ScriptOptions& options) {
+    namespace fs = std::filesystem;
+    if (options.cacheDir.empty()) return "";
+    std::error_code error;
+    fs::path script = fs::absolute(scriptPath, error);
+    if (error) script = scriptPath;
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx",
+                  static_cast<unsigned long long>(hashSource(script.lexically_normal().string())));
+    std::string name = fs::path(scriptPath).stem().string() + "-" + hash + ".clangc";
+    return (fs::path(options.cacheDir) / name).string();
+}
+
+// Lists the scripts of a batch: every *.clang file in `target` when it is a
+// directory, otherwise `target` is a manifest with one script path per line
+// (relative to the manifest's directory; blank lines and # comments skipped).
+std::vector<std::string> batchScripts(const std::string& target) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> scripts;
+    if (fs::is_directory(target)) {
+        for (const auto& entry : fs::directory_iterator(target)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".clang") {
+                scripts.push_back(entry.path().string());
+            }
+        }
+        std::sort(scripts.begin(), scripts.end());
+        return scripts;
+    }
+
+    std::ifstream manifest(target);
+    if (!manifest) {
+        throw std::runtime_error("could not open batch '" + target + "'");
+    }
+    fs::path base = fs::path(target).parent_path();
+    std::string line;
+    while (std::getline(manifest, line)) {
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') continue;
+        size_t last = line.find_last_not_of(" \t\r");
+        fs::path script(line.substr(first, last - first + 1));
+        scripts.push_back(script.is_absolute() ? script.string() : (base / script).string());
+    }
+    return scripts;
+}
+
+// Batch mode: runs every script of a directory or manifest on a thread pool,
+// each in its own Interpreter with its own output buffer, then prints one
+// PASS/FAIL line per script (in list order) with wall time and steps, and
+// the first error line of each failure. Exits 0 only if every script passed.
+int runBatch(const std::string& target, const ScriptOptions& options, size_t jobs) {
+    struct BatchResult {
+        int exitCode = 0;
+        uint64_t steps = 0;
+        double millis = 0;
+        std::string output;
+    };
+
+    std::vector<std::string> scripts;
+    try {
+        scripts = batchScripts(target);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    std::vector<BatchResult> results(scripts.size());
+    auto batchStart = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(std::max<size_t>(1, std::min(jobs, scripts.size())));
+        for (size_t i = 0; i < scripts.size(); ++i) {
+            pool.submit([&, i] {
+                BatchResult& result = results[i];
+                TraceSpan span(scripts[i].c_str(), "batch");
+                auto start = std::chrono::steady_clock::now();
+                std::ostringstream out;
+                MappedFile file;
+                if (!file.open(scripts[i])) {
+                    out << "Error: could not open file '" << scripts[i] << "'\n";
+                    result.exitCode = 1;
+                } else {
+                    std::string cachePath = cachePathFor(scripts[i], options);
+                    result.exitCode = runScript(std::string_view(file.data(), file.size()), out, options,
+                                                cachePath, &result.steps);
+                }
+                result.output = out.str();
+                result.millis = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+            });
+        }
+        pool.wait();
+    }
+    double totalMillis = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - batchStart).count();
+
+    size_t passed = 0;
+    for (size_t i = 0; i < scripts.size(); ++i) {
+        const BatchResult& result = results[i];
+        char timing[64];
+        std::snprintf(timing, sizeof(timing), "%.1fms", result.millis);
+        std::cout << (result.exitCode == 0 ? "PASS " : "FAIL ") << scripts[i] << " " << timing
+                  << " " << result.steps << " steps\n";
+        if (result.exitCode == 0) {
+            ++passed;
+            continue;
+        }
+        size_t error = result.output.rfind("Error: ");
+        if (error != std::string::npos) {
+            size_t end = result.output.find('\n', error);
+            std::cout << "  " << result.output.substr(error, end - error) << "\n";
+        } else if (result.exitCode == kExitOutputLimit) {
+            std::cout << "  output limit exceeded\n";
+        }
+    }
+    char timing[64];
+    std::snprintf(timing, sizeof(timing), "%.1fms", totalMillis);
+    std::cout << passed << "/" << scripts.size() << " passed, " << (scripts.size() - passed)
+              << " failed in " << timing << "\n";
+    return passed == scripts.size() ? 0 : 1;
+}
+
+int runCommand(int argc, char* argv[], int arg, const ScriptOptions& options, size_t jobs);
+
 int main(int argc, char* argv[]) {
-    if (argc > 1) {
-        if (std::strcmp(argv[1], "--script") == 0) {
+    ScriptOptions options;
+    std::string tracePath;
+    uint32_t traceCalls = 1;  // record every call
+    size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+    int arg = 1;
+    for (; arg < argc; ++arg) {
+        if (std::strcmp(argv[arg], "--strict") == 0) {
+            options.mode = ParseMode::Eager;
+        } else if (std::strcmp(argv[arg], "--parse-threads") == 0 && arg + 1 < argc) {
+            options.parseThreads = std::strtoul(argv[++arg], nullptr, 10);
+        } else if (std::strcmp(argv[arg], "--cache-dir") == 0 && arg + 1 < argc) {
+            options.cacheDir = argv[++arg];
+        } else if (std::strcmp(argv[arg], "--no-cache") == 0) {
+            options.cacheDir.clear();
+        } else if (std::strcmp(argv[arg], "--max-output") == 0 && arg + 1 < argc) {
+            options.maxOutputBytes = std::strtoul(argv[++arg], nullptr, 10);
+        } else if (std::strcmp(argv[arg], "--max-steps") == 0 && arg + 1 < argc) {
+            options.maxSteps = std::strtoull(argv[++arg], nullptr, 10);
+        } else if (std::strcmp(argv[arg], "--max-memory") == 0 && arg + 1 < argc) {
+            options.maxMemory = std::strtoull(argv[++arg], nullptr, 10);
+        } else if (std::strcmp(argv[arg], "--stackless") == 0) {
+            options.stackless = true;
+        } else if (std::strcmp(argv[arg], "--max-depth") == 0 && arg + 1 < argc) {
+            options.maxDepth = std::strtoull(argv[++arg], nullptr, 10);
+        } else if (std::strcmp(argv[arg], "--snapshot") == 0 && arg + 1 < argc) {
+            options.snapshotPath = argv[++arg];
+        } else if (std::strcmp(argv[arg], "--write-snapshot") == 0 && arg + 1 < argc) {
+            options.writeSnapshotPath = argv[++arg];
+        } else if (std::strcmp(argv[arg], "--task-threads") == 0 && arg + 1 < argc) {
+            options.taskThreads = std::strtoul(argv[++arg], nullptr, 10);
+        } else if (std::strcmp(argv[arg], "--stats") == 0) {
+            options.stats = ScriptOptions::Stats::Text;
+        } else if (std::strcmp(argv[arg], "--stats-json") == 0) {
+            options.stats = ScriptOptions::Stats::Json;
+        } else if (std::strcmp(argv[arg], "--profile") == 0 && arg + 1 < argc) {
+            options.profilePath = argv[++arg];
+        } else if (std::strcmp(argv[arg], "--trace") == 0 && arg + 1 < argc) {
+            tracePath = argv[++arg];
+        } else if (std::strcmp(argv[arg], "--trace-calls") == 0 && arg + 1 < argc) {
+            traceCalls = static_cast<uint32_t>(std::strtoul(argv[++arg], nullptr, 10));
+        } else if (std::strcmp(argv[arg], "--jobs") == 0 && arg + 1 < argc) {
+            jobs = std::strtoul(argv[++arg], nullptr, 10);
+        } else {
+            break;
+        }
+    }
+
+    if (!kStatsEnabled && options.stats != ScriptOptions::Stats::None) {
+        std::cerr << "Error: this build has no --stats (CODELANG_STATS is off)\n";
+        return 1;
+    }
+    if (!options.snapshotPath.empty()) {
+        auto snapshot = std::make_shared<MappedFile>();
+        if (!snapshot->open(options.snapshotPath)) {
+            std::cerr << "Error: could not open snapshot '" << options.snapshotPath << "'\n";
+            return 1;
+        }
+        options.snapshot = std::move(snapshot);
+    }
+    // --trace covers the whole process, whatever it runs
+    std::unique_ptr<Tracer> tracer;
+    if (!tracePath.empty()) {
+        tracer = std::make_unique<Tracer>(traceCalls);
+        tracer->start();
+    }
+    int exitCode = runCommand(argc, argv, arg, options, jobs);
+    if (tracer) {
+        tracer->stop();
+        std::ofstream trace(tracePath);
+        tracer->writeJson(trace);
+        std::cerr << "Trace written to " << tracePath;
+        if (tracer->dropped() != 0) std::cerr << " (oldest " << tracer->dropped() << " events dropped)";
+        std::cerr << "\n";
+    }
+    return exitCode;
+}
+
+// Runs what the arguments from `arg` on ask for: serve, batch, a script or the REPL.
+int runCommand(int argc, char* argv[], int arg, const ScriptOptions& options, size_t jobs) {
+    if (arg < argc) {
+        bool manyScripts = std::strcmp(argv[arg], "--serve") == 0 || std::strcmp(argv[arg], "--batch") == 0;
+        if (manyScripts && (!options.profilePath.empty() || options.stats != ScriptOptions::Stats::None ||
+                            !options.writeSnapshotPath.empty())) {
+            std::cerr << "Error: --profile, --stats and --write-snapshot run a single script\n";
+            return 1;
+        }
+        if (std::strcmp(argv[arg], "--serve") == 0) {
+            return runServe(options);
+        }
+        if (std::strcmp(argv[arg], "--batch") == 0 && arg + 1 < argc) {
+            return runBatch(argv[arg + 1], options, jobs);
+        }
+        if (std::strcmp(argv[arg], "--script") == 0) {
             // program is piped in on stdin
-            return runScript(std::cin, std::cout);
+            return runScript(readAll(std::cin), std::cout, options);
+        }
+        // otherwise treat the argument as a script file path; the scanner
+        // reads straight out of the read-only mapping
+        MappedFile file;
+        bool opened;
+        {
+            TraceSpan span("read input", "io");
+            opened = file.open(argv[arg]);
         }
-        // otherwise treat the argument as a script file path
-        std::ifstream file(argv[1]);
-        if (!file) {
-            std::cerr << "Error: could not open file '" << argv[1] << "'\n";
+        if (!opened) {
+            std::cerr << "Error: could not open file '" << argv[arg] << "'\n";
             return 1;
         }
-        return runScript(file, std::cout);
+        std::string cachePath = cachePathFor(argv[arg], options);
+        return runScript(std::string_view(file.data(), file.size()), std::cout, options, cachePath);
     }
     return runRepl();
 }
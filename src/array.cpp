@@ -0,0 +1,242 @@
+#include "array.hpp"
+#include "interpreter.hpp"
+#include "kernels.hpp"
+#include <cmath>
+#include <stdexcept>
+
+Array::Array(std::vector<Value> elements) {
+    for (const auto& element : elements) {
+        if (!isNumber(element)) {
+            allNumbers = false;
+            values = std::move(elements);
+            return;
+        }
+    }
+    numbers.reserve(elements.size());
+    for (const auto& element : elements) numbers.push_back(asDouble(element));
+}
+
+size_t Array::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return allNumbers ? numbers.size() : values.size();
+}
+
+size_t Array::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return storedBytes();
+}
+
+size_t Array::storedBytes() const {
+    return allNumbers ? numbers.size() * sizeof(double) : values.size() * sizeof(Value);
+}
+
+void Array::charge(Interpreter* interpreter) {
+    std::lock_guard<std::mutex> lock(mutex);
+    charged.update(interpreter, storedBytes());
+}
+
+bool Array::numeric() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return allNumbers;
+}
+
+Value Array::get(double index) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t i = position(index);
+    if (allNumbers) return numbers[i];
+    return values[i];
+}
+
+void Array::set(double index, Value value, Interpreter* interpreter) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t i = position(index);
+    if (allNumbers && isNumber(value)) {
+        numbers[i] = asDouble(value);
+        return;
+    }
+    if (allNumbers) charged.update(interpreter, numbers.size() * sizeof(Value));
+    makeGeneric();
+    values[i] = std::move(value);
+}
+
+size_t Array::push(Value value, Interpreter* interpreter) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (allNumbers && isNumber(value)) {
+        charged.update(interpreter, (numbers.size() + 1) * sizeof(double));
+        numbers.push_back(asDouble(value));
+        return numbers.size();
+    }
+    charged.update(interpreter, ((allNumbers ? numbers.size() : values.size()) + 1) * sizeof(Value));
+    makeGeneric();
+    values.push_back(std::move(value));
+    return values.size();
+}
+
+Value Array::pop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (allNumbers) {
+        if (numbers.empty()) throw std::runtime_error("pop() on an empty array.");
+        double last = numbers.back();
+        numbers.pop_back();
+        charged.update(nullptr, storedBytes());
+        return last;
+    }
+    if (values.empty()) throw std::runtime_error("pop() on an empty array.");
+    Value last = std::move(values.back());
+    values.pop_back();
+    charged.update(nullptr, storedBytes());
+    return last;
+}
+
+std::vector<Value> Array::elements() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!allNumbers) return values;
+    return std::vector<Value>(numbers.begin(), numbers.end());
+}
+
+size_t Array::position(double index) const {
+    if (index != std::floor(index)) throw std::runtime_error("Array index must be a whole number.");
+    size_t count = allNumbers ? numbers.size() : values.size();
+    if (index < 0 || index >= static_cast<double>(count)) throw std::runtime_error("Array index out of range.");
+    return static_cast<size_t>(index);
+}
+
+// One-way: an array that has held a non-number stays generic.
+void Array::makeGeneric() {
+    if (!allNumbers) return;
+    values.assign(numbers.begin(), numbers.end());
+    numbers.clear();
+    numbers.shrink_to_fit();
+    allNumbers = false;
+}
+namespace {
+
+std::shared_ptr<Array> arrayArgument(const Value& value, const char* name) {
+    if (!std::holds_alternative<std::shared_ptr<Array>>(value))
+        throw std::runtime_error(std::string(name) + "() expects an array.");
+    return std::get<std::shared_ptr<Array>>(value);
+}
+
+std::runtime_error notNumeric(const char* name) {
+    return std::runtime_error(std::string(name) + "() expects an array of numbers.");
+}
+
+std::runtime_error lengthMismatch(const char* name) {
+    return std::runtime_error(std::string(name) + "() expects arrays of the same length.");
+}
+
+using Reduction = double (*)(const double* a, size_t n);
+
+// min and max of a non-empty array of numbers.
+Value extreme(const Value& value, const char* name, Reduction reduce) {
+    auto array = arrayArgument(value, name);
+    double result = 0;
+    bool empty = false;
+    bool numeric = array->readNumbers([&](const double* a, size_t n) {
+        empty = n == 0;
+        if (!empty) result = reduce(a, n);
+    });
+    if (!numeric) throw notNumeric(name);
+    if (empty) throw std::runtime_error(std::string(name) + "() of an empty array.");
+    return result;
+}
+
+using PairOp = void (*)(const double* a, const double* b, double* out, size_t n);
+using ScalarOp = void (*)(const double* a, double k, double* out, size_t n);
+
+// A new array of `op` applied to the elements of `value` and those of
+// `operand`, or to each element and `operand` if it is a number. `pairOp` is
+// null for built-ins that only take a number.
+Value elementwise(const Value& value, const Value& operand, const char* name, ScalarOp scalarOp,
+                  PairOp pairOp, Interpreter* interpreter) {
+    auto array = arrayArgument(value, name);
+    std::vector<double> out;
+    auto allocate = [&](size_t n) {
+        if (interpreter) interpreter->checkAllocation(n * sizeof(double));
+        out.resize(n);
+    };
+    bool numeric = true;
+    if (isNumber(operand)) {
+        double k = asDouble(operand);
+        numeric = array->readNumbers([&](const double* a, size_t n) {
+            allocate(n);
+            scalarOp(a, k, out.data(), n);
+        });
+    } else if (!pairOp) {
+        throw std::runtime_error(std::string(name) + "() expects a number as its second argument.");
+    } else {
+        auto other = arrayArgument(operand, name);
+        bool sameLength = true;
+        numeric = Array::readNumbers(*array, *other, [&](const double* a, size_t n, const double* b, size_t m) {
+            sameLength = n == m;
+            if (!sameLength) return;
+            allocate(n);
+            pairOp(a, b, out.data(), n);
+        });
+        if (numeric && !sameLength) throw lengthMismatch(name);
+    }
+    if (!numeric) throw notNumeric(name);
+    auto result = std::make_shared<Array>(std::move(out));
+    result->charge(interpreter);
+    return result;
+}
+
+} // namespace
+
+Value arraySum(const Value& array) {
+    double result = 0;
+    bool numeric = arrayArgument(array, "sum")->readNumbers([&](const double* a, size_t n) {
+        result = numericKernels().sum(a, n);
+    });
+    if (!numeric) throw notNumeric("sum");
+    return result;
+}
+
+Value arrayMin(const Value& array) {
+    return extreme(array, "min", numericKernels().min);
+}
+
+Value arrayMax(const Value& array) {
+    return extreme(array, "max", numericKernels().max);
+}
+
+Value arrayDot(const Value& a, const Value& b) {
+    auto left = arrayArgument(a, "dot");
+    auto right = arrayArgument(b, "dot");
+    double result = 0;
+    bool sameLength = true;
+    bool numeric = Array::readNumbers(*left, *right, [&](const double* x, size_t n, const double* y, size_t m) {
+        sameLength = n == m;
+        if (sameLength) result = numericKernels().dot(x, y, n);
+    });
+    if (!numeric) throw notNumeric("dot");
+    if (!sameLength) throw lengthMismatch("dot");
+    return result;
+}
+
+Value arrayPrefixSum(const Value& array, Interpreter* interpreter) {
+    std::vector<double> out;
+    bool numeric = arrayArgument(array, "prefix_sum")->readNumbers([&](const double* a, size_t n) {
+        if (interpreter) interpreter->checkAllocation(n * sizeof(double));
+        out.resize(n);
+        prefixSum(a, out.data(), n);
+    });
+    if (!numeric) throw notNumeric("prefix_sum");
+    auto result = std::make_shared<Array>(std::move(out));
+    result->charge(interpreter);
+    return result;
+}
+
+Value arrayMapAdd(const Value& array, const Value& operand, Interpreter* interpreter) {
+    const NumericKernels& kernels = numericKernels();
+    return elementwise(array, operand, "map_add", kernels.addScalar, kernels.add, interpreter);
+}
+
+Value arrayMapMul(const Value& array, const Value& operand, Interpreter* interpreter) {
+    const NumericKernels& kernels = numericKernels();
+    return elementwise(array, operand, "map_mul", kernels.mulScalar, kernels.mul, interpreter);
+}
+
+Value arrayScale(const Value& array, const Value& factor, Interpreter* interpreter) {
+    return elementwise(array, factor, "scale", numericKernels().mulScalar, nullptr, interpreter);
+}
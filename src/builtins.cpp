@@ -0,0 +1,233 @@
+#include "builtins.hpp"
+#include "array.hpp"
+#include "expr.hpp"
+#include "map.hpp"
+#include "output.hpp"
+#include "task.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+double toNumber(const Value& value, const Native& self) {
+    if (!isNumber(value)) throw std::runtime_error(self.name + "() expects a number.");
+    return asDouble(value);
+}
+
+std::shared_ptr<Channel> toChannel(const Value& value, const Native& self) {
+    if (!std::holds_alternative<std::shared_ptr<Channel>>(value))
+        throw std::runtime_error(self.name + "() expects a channel.");
+    return std::get<std::shared_ptr<Channel>>(value);
+}
+
+std::shared_ptr<Array> toArray(const Value& value, const Native& self) {
+    if (!std::holds_alternative<std::shared_ptr<Array>>(value))
+        throw std::runtime_error(self.name + "() expects an array.");
+    return std::get<std::shared_ptr<Array>>(value);
+}
+
+std::shared_ptr<Map> toMap(const Value& value, const Native& self) {
+    if (!std::holds_alternative<std::shared_ptr<Map>>(value))
+        throw std::runtime_error(self.name + "() expects a map.");
+    return std::get<std::shared_ptr<Map>>(value);
+}
+
+TaskScheduler* schedulerOf(Environment& env) {
+    return env.interpreter ? env.interpreter->scheduler : nullptr;
+}
+
+// A new string or array must fit under the memory cap before it is built.
+void checkGrowth(Environment& env, size_t bytes) {
+    if (env.interpreter) env.interpreter->checkAllocation(bytes);
+}
+
+Value channelBuiltin(const Native&, Value* args, Environment&) {
+    if (!isNumber(args[0]) || asDouble(args[0]) < 1)
+        throw std::runtime_error("Channel capacity must be a positive number.");
+    return std::make_shared<Channel>(static_cast<size_t>(asDouble(args[0])));
+}
+
+Value sendBuiltin(const Native& self, Value* args, Environment& env) {
+    toChannel(args[0], self)->send(args[1], schedulerOf(env));
+    return std::move(args[1]);
+}
+
+Value recvBuiltin(const Native& self, Value* args, Environment& env) {
+    return toChannel(args[0], self)->recv(schedulerOf(env));
+}
+
+Value lenBuiltin(const Native& self, Value* args, Environment&) {
+    if (std::holds_alternative<std::string>(args[0])) {
+        return static_cast<int64_t>(std::get<std::string>(args[0]).size());
+    }
+    if (std::holds_alternative<std::shared_ptr<Map>>(args[0])) {
+        return static_cast<int64_t>(std::get<std::shared_ptr<Map>>(args[0])->size());
+    }
+    return static_cast<int64_t>(toArray(args[0], self)->size());
+}
+
+Value pushBuiltin(const Native& self, Value* args, Environment& env) {
+    return static_cast<int64_t>(toArray(args[0], self)->push(std::move(args[1]), env.interpreter));
+}
+
+Value popBuiltin(const Native& self, Value* args, Environment&) {
+    return toArray(args[0], self)->pop();
+}
+
+Value getBuiltin(const Native& self, Value* args, Environment&) {
+    toMap(args[0], self);
+    return Index::apply(args[0], args[1]);
+}
+
+Value setBuiltin(const Native& self, Value* args, Environment& env) {
+    toMap(args[0], self)->set(args[1], args[2], env.interpreter);
+    return std::move(args[2]);
+}
+
+Value hasBuiltin(const Native& self, Value* args, Environment&) {
+    return toMap(args[0], self)->has(args[1]) ? 1.0 : 0.0;
+}
+
+Value deleteBuiltin(const Native& self, Value* args, Environment&) {
+    return toMap(args[0], self)->erase(args[1]) ? 1.0 : 0.0;
+}
+
+Value keysBuiltin(const Native& self, Value* args, Environment& env) {
+    auto map = toMap(args[0], self);
+    checkGrowth(env, map->size() * sizeof(Value));
+    auto keys = std::make_shared<Array>(map->keys());
+    keys->charge(env.interpreter);
+    return keys;
+}
+
+Value sqrtBuiltin(const Native& self, Value* args, Environment&) {
+    return std::sqrt(toNumber(args[0], self));
+}
+
+Value floorBuiltin(const Native& self, Value* args, Environment&) {
+    if (std::holds_alternative<int64_t>(args[0])) return args[0];
+    return std::floor(toNumber(args[0], self));
+}
+
+Value absBuiltin(const Native& self, Value* args, Environment&) {
+    if (auto integer = std::get_if<int64_t>(&args[0])) return *integer < 0 ? -*integer : *integer;
+    return std::fabs(toNumber(args[0], self));
+}
+
+// substr(s, start, length): at most `length` characters from `start`.
+Value substrBuiltin(const Native& self, Value* args, Environment& env) {
+    if (!std::holds_alternative<std::string>(args[0])) throw std::runtime_error("substr() expects a string.");
+    const std::string& text = std::get<std::string>(args[0]);
+    double start = toNumber(args[1], self);
+    double length = toNumber(args[2], self);
+    if (start != std::floor(start) || length != std::floor(length))
+        throw std::runtime_error("substr() expects whole numbers.");
+    if (start < 0 || start > static_cast<double>(text.size()) || length < 0)
+        throw std::runtime_error("substr() range out of bounds.");
+    size_t from = static_cast<size_t>(start);
+    size_t count = std::min(static_cast<double>(text.size() - from), length);
+    checkGrowth(env, count);
+    return text.substr(from, count);
+}
+
+// The text `print` shows for a number or string.
+Value toStringBuiltin(const Native&, Value* args, Environment&) {
+    if (std::holds_alternative<std::string>(args[0])) return std::move(args[0]);
+    char digits[kMaxNumberChars];
+    if (auto integer = std::get_if<int64_t>(&args[0])) return std::string(digits, formatNumber(*integer, digits));
+    if (!std::holds_alternative<double>(args[0]))
+        throw std::runtime_error("to_string() expects a number or a string.");
+    return std::string(digits, formatNumber(std::get<double>(args[0]), digits));
+}
+
+// Seconds on a monotonic clock, for timing parts of a script.
+Value clockBuiltin(const Native&, Value*, Environment&) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Value sumBuiltin(const Native&, Value* args, Environment&) {
+    return arraySum(args[0]);
+}
+
+Value minBuiltin(const Native&, Value* args, Environment&) {
+    return arrayMin(args[0]);
+}
+
+Value maxBuiltin(const Native&, Value* args, Environment&) {
+    return arrayMax(args[0]);
+}
+
+Value dotBuiltin(const Native&, Value* args, Environment&) {
+    return arrayDot(args[0], args[1]);
+}
+
+Value prefixSumBuiltin(const Native&, Value* args, Environment& env) {
+    return arrayPrefixSum(args[0], env.interpreter);
+}
+
+Value mapAddBuiltin(const Native&, Value* args, Environment& env) {
+    return arrayMapAdd(args[0], args[1], env.interpreter);
+}
+
+Value mapMulBuiltin(const Native&, Value* args, Environment& env) {
+    return arrayMapMul(args[0], args[1], env.interpreter);
+}
+
+Value scaleBuiltin(const Native&, Value* args, Environment& env) {
+    return arrayScale(args[0], args[1], env.interpreter);
+}
+
+using BuiltinTable = std::unordered_map<std::string, std::shared_ptr<const Native>>;
+
+BuiltinTable makeBuiltins() {
+    BuiltinTable table;
+    for (const Native& native : {
+             Native("channel", 1, channelBuiltin),
+             Native("send", 2, sendBuiltin),
+             Native("recv", 1, recvBuiltin),
+             Native("len", 1, lenBuiltin),
+             Native("push", 2, pushBuiltin),
+             Native("pop", 1, popBuiltin),
+             Native("get", 2, getBuiltin),
+             Native("set", 3, setBuiltin),
+             Native("has", 2, hasBuiltin),
+             Native("delete", 2, deleteBuiltin),
+             Native("keys", 1, keysBuiltin),
+             Native("sqrt", 1, sqrtBuiltin),
+             Native("floor", 1, floorBuiltin),
+             Native("abs", 1, absBuiltin),
+             Native("substr", 3, substrBuiltin),
+             Native("to_string", 1, toStringBuiltin),
+             Native("clock", 0, clockBuiltin),
+             Native("sum", 1, sumBuiltin),
+             Native("min", 1, minBuiltin),
+             Native("max", 1, maxBuiltin),
+             Native("dot", 2, dotBuiltin),
+             Native("prefix_sum", 1, prefixSumBuiltin),
+             Native("map_add", 2, mapAddBuiltin),
+             Native("map_mul", 2, mapMulBuiltin),
+             Native("scale", 2, scaleBuiltin),
+         }) {
+        table.emplace(native.name, std::make_shared<const Native>(native));
+    }
+    return table;
+}
+
+} // namespace
+
+void checkArity(const Native& native, size_t count) {
+    if (count != native.arity) {
+        throw std::runtime_error(native.name + "() expects " + std::to_string(native.arity) + " argument" +
+                                 (native.arity == 1 ? "" : "s") + ".");
+    }
+}
+
+const std::shared_ptr<const Native>& findBuiltin(const std::string& name) {
+    static const BuiltinTable builtins = makeBuiltins();
+    static const std::shared_ptr<const Native> none;
+    auto it = builtins.find(name);
+    return it == builtins.end() ? none : it->second;
+}
@@ -0,0 +1,216 @@
+#include "codelang.h"
+#include "scanner.hpp"
+#include "parser.hpp"
+#include "interpreter.hpp"
+#include "stmt.hpp"
+#include "builtins.hpp"
+#include <exception>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+struct codelang_context {
+    std::vector<std::shared_ptr<const Native>> natives;
+    uint64_t maxSteps = 0;
+    size_t maxMemory = 0;
+    size_t maxOutput = 0;
+    uint64_t lastSteps = 0;
+    std::string lastError;
+};
+
+// Fully parsed up front (ParseMode::Eager), so runs never modify it.
+struct codelang_program {
+    std::vector<std::shared_ptr<Stmt>> statements;
+};
+
+struct codelang_call {
+    const Value* args;
+    size_t argc;
+    Value result = 0.0;
+    bool failed = false;
+    std::string error;
+};
+
+namespace {
+
+// A function defined with codelang_define_function.
+struct CallbackNative : Native {
+    CallbackNative(std::string name, size_t arity, codelang_native_fn callback, void* userData)
+        : Native(std::move(name), arity, invoke), callback(callback), userData(userData) {}
+
+    static Value invoke(const Native& self, Value* args, Environment&) {
+        const auto& native = static_cast<const CallbackNative&>(self);
+        codelang_call call{args, native.arity, 0.0, false, {}};
+        native.callback(native.userData, &call);
+        if (call.failed) throw std::runtime_error(call.error);
+        return std::move(call.result);
+    }
+
+    codelang_native_fn callback;
+    void* userData;
+};
+
+const Value* argument(const codelang_call* call, size_t index) {
+    return index < call->argc ? &call->args[index] : nullptr;
+}
+
+// Hands whatever the OutputSink writes straight to the embedder's callback.
+class CallbackBuffer : public std::streambuf {
+public:
+    CallbackBuffer(codelang_output_fn output, void* userData) : output(output), userData(userData) {}
+
+protected:
+    std::streamsize xsputn(const char* data, std::streamsize count) override {
+        if (output) output(userData, data, static_cast<size_t>(count));
+        return count;
+    }
+
+    int_type overflow(int_type ch) override {
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            char c = traits_type::to_char_type(ch);
+            if (output) output(userData, &c, 1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+private:
+    codelang_output_fn output;
+    void* userData;
+};
+
+} // namespace
+
+extern "C" {
+
+codelang_context* codelang_context_new(void) {
+    return new codelang_context();
+}
+
+void codelang_context_free(codelang_context* ctx) {
+    delete ctx;
+}
+
+void codelang_set_step_budget(codelang_context* ctx, uint64_t max_steps) {
+    ctx->maxSteps = max_steps;
+}
+
+void codelang_set_memory_limit(codelang_context* ctx, size_t max_bytes) {
+    ctx->maxMemory = max_bytes;
+}
+
+void codelang_set_output_limit(codelang_context* ctx, size_t max_bytes) {
+    ctx->maxOutput = max_bytes;
+}
+
+codelang_program* codelang_compile(codelang_context* ctx, const char* source, size_t length) {
+    ctx->lastError.clear();
+    try {
+        Scanner scanner(std::string_view(source, length));
+        std::vector<Token> tokens = scanner.scanTokens();
+        Parser parser(tokens);
+        auto program = new codelang_program();
+        try {
+            program->statements = parser.parse();
+        } catch (...) {
+            delete program;
+            throw;
+        }
+        return program;
+    } catch (const std::exception& e) {
+        ctx->lastError = e.what();
+        return nullptr;
+    }
+}
+
+void codelang_program_free(codelang_program* program) {
+    delete program;
+}
+
+int codelang_run(codelang_context* ctx, const codelang_program* program,
+                 codelang_output_fn output, void* user_data) {
+    ctx->lastError.clear();
+    ctx->lastSteps = 0;
+    CallbackBuffer buffer(output, user_data);
+    std::ostream out(&buffer);
+    Interpreter interpreter(out);
+    interpreter.output.setLimit(ctx->maxOutput);
+    interpreter.maxSteps = ctx->maxSteps;
+    interpreter.maxMemory = ctx->maxMemory;
+    for (const auto& native : ctx->natives) setVariable(interpreter.environment, native->name, native);
+
+    int result = CODELANG_OK;
+    try {
+        interpreter.interpret(program->statements);
+    } catch (const OutputLimitError& e) {
+        ctx->lastError = e.what();
+        result = CODELANG_OUTPUT_LIMIT;
+    } catch (const LimitError& e) {
+        ctx->lastError = e.what();
+        result = CODELANG_LIMIT;
+    } catch (const std::exception& e) {
+        ctx->lastError = e.what();
+        result = CODELANG_ERROR;
+    } catch (...) {
+        // nothing may unwind into the embedder's C frames
+        ctx->lastError = "Unexpected error";
+        result = CODELANG_ERROR;
+    }
+    ctx->lastSteps = interpreter.steps;
+    return result;
+}
+
+void codelang_define_function(codelang_context* ctx, const char* name, size_t arity,
+                              codelang_native_fn fn, void* user_data) {
+    auto native = std::make_shared<const CallbackNative>(name, arity, fn, user_data);
+    for (auto& existing : ctx->natives) {
+        if (existing->name == native->name) {
+            existing = std::move(native);
+            return;
+        }
+    }
+    ctx->natives.push_back(std::move(native));
+}
+
+int codelang_arg_type(const codelang_call* call, size_t index) {
+    const Value* value = argument(call, index);
+    if (value && isNumber(*value)) return CODELANG_NUMBER;
+    if (value && std::holds_alternative<std::string>(*value)) return CODELANG_STRING;
+    return CODELANG_OTHER;
+}
+
+double codelang_arg_number(const codelang_call* call, size_t index) {
+    const Value* value = argument(call, index);
+    return value && isNumber(*value) ? asDouble(*value) : 0;
+}
+
+const char* codelang_arg_string(const codelang_call* call, size_t index, size_t* length) {
+    const Value* value = argument(call, index);
+    if (!value || !std::holds_alternative<std::string>(*value)) return nullptr;
+    const std::string& text = std::get<std::string>(*value);
+    if (length) *length = text.size();
+    return text.data();
+}
+
+void codelang_return_number(codelang_call* call, double value) {
+    call->result = value;
+}
+
+void codelang_return_string(codelang_call* call, const char* data, size_t length) {
+    call->result = std::string(data, length);
+}
+
+void codelang_fail(codelang_call* call, const char* message) {
+    call->failed = true;
+    call->error = message;
+}
+
+uint64_t codelang_last_steps(const codelang_context* ctx) {
+    return ctx->lastSteps;
+}
+
+const char* codelang_last_error(const codelang_context* ctx) {
+    return ctx->lastError.c_str();
+}
+
+} // extern "C"
@@ -1,31 +1,124 @@
 #include "token.hpp"
 #include "expr.hpp"
 #include "stmt.hpp"
+#include "parser.hpp"
+#include "task.hpp"
+#include "array.hpp"
+#include "builtins.hpp"
+#include "map.hpp"
+#include "output.hpp"
+#include "trace.hpp"
+#include "vm.hpp"
 #include <memory>
 #include <stdexcept>
 
 Call::Call(std::string callee, std::vector<std::shared_ptr<Expr>> args)
-    : callee(std::move(callee)), arguments(std::move(args)) {}
+    : callee(std::move(callee)), arguments(std::move(args)), builtin(findBuiltin(this->callee)) {}
 
-Value Call::evaluate(Environment& env) {
+std::shared_ptr<const FunctionStmt> toFunction(const Value& value, const std::string& name) {
+    if (std::holds_alternative<std::shared_ptr<const Native>>(value))
+        throw std::runtime_error("Built-in functions cannot be spawned: " + name);
+    if (!std::holds_alternative<std::shared_ptr<const Stmt>>(value))
+        throw std::runtime_error("Value is not a function: " + name);
+
+    auto fn = std::get<std::shared_ptr<const Stmt>>(value);
+    auto function = std::dynamic_pointer_cast<const FunctionStmt>(fn);
+    if (!function) throw std::runtime_error("Value is not a FunctionStmt: " + name);
+    return function;
+}
+
+namespace {
+
+double toIndex(const Value& value) {
+    if (!isNumber(value)) throw std::runtime_error("Array index must be a number.");
+    return asDouble(value);
+}
+
+Value mapLookup(const Map& map, const Value& key) {
+    Value value;
+    if (map.get(key, value)) return value;
+    std::string text;
+    if (auto integer = std::get_if<int64_t>(&key)) {
+        char digits[kMaxNumberChars];
+        text.assign(digits, formatNumber(*integer, digits));
+    } else if (std::holds_alternative<double>(key)) {
+        char digits[kMaxNumberChars];
+        text.assign(digits, formatNumber(std::get<double>(key), digits));
+    } else if (std::holds_alternative<std::string>(key)) {
+        text = std::get<std::string>(key);
+    }
+    throw std::runtime_error("Map has no key: " + text);
+}
+
+// A new array must fit under the memory cap before it is built; it is
+// charged once it is (see MemoryCharge).
+void checkGrowth(Environment& env, size_t bytes) {
+    if (env.interpreter) env.interpreter->checkAllocation(bytes);
+}
+
+Interpreter& runningInterpreter(Environment& env) {
+    if (!env.interpreter) throw std::runtime_error("Tasks need a running interpreter.");
+    return *env.interpreter;
+}
+
+// Calls a built-in or an embedder's native function. Arguments are evaluated
+// into a buffer on the stack unless there are more than a few.
+Value callNative(const Native& native, const std::vector<std::shared_ptr<Expr>>& arguments, Environment& env) {
+    checkArity(native, arguments.size());
+    constexpr size_t kInlineArguments = 4;
+    Value inlineArgs[kInlineArguments];
+    std::vector<Value> spilled;
+    Value* args = inlineArgs;
+    if (native.arity > kInlineArguments) {
+        spilled.resize(native.arity);
+        args = spilled.data();
+    }
+    for (size_t i = 0; i < native.arity; ++i) args[i] = arguments[i]->evaluate(env);
+    return native.function(native, args, env);
+}
+
+} // namespace
+
+Value Call::evaluate(Environment& env) const {
+    countNode(env, NodeKind::Call);
+    countLookup(env);
     auto it = env.find(callee);
-    if (it == env.end()) throw std::runtime_error("Undefined function: " + callee);
+    if (it == env.end()) {
+        if (!builtin) throw std::runtime_error("Undefined function: " + callee);
+        return callNative(*builtin, arguments, env);
+    }
+    if (auto native = std::get_if<std::shared_ptr<const Native>>(&it->second)) {
+        // a copy: evaluating the arguments may reassign the variable
+        std::shared_ptr<const Native> held = *native;
+        return callNative(*held, arguments, env);
+    }
 
-    if (!std::holds_alternative<std::shared_ptr<Stmt>>(it->second))
-        throw std::runtime_error("Value is not a function: " + callee);
+    auto function = toFunction(it->second, callee);
+    if (arguments.size() != function->params.size()) {
+        throw std::runtime_error("Expected " + std::to_string(function->params.size()) + " arguments but got " +
+                                 std::to_string(arguments.size()) + ".");
+    }
+    const auto& body = function->parsedBody();
 
-    auto fn = std::get<std::shared_ptr<Stmt>>(it->second);
-    auto function = std::dynamic_pointer_cast<FunctionStmt>(fn);
-    if (!function) throw std::runtime_error("Value is not a FunctionStmt: " + callee);
+    if (env.interpreter) env.interpreter->step();
 
+    CallStats callStats(env.interpreter, env);
     Environment localEnv = env;
+    FrameMemory frameMemory(localEnv);
     for (size_t i = 0; i < function->params.size(); ++i) {
-        localEnv[function->params[i]] = arguments[i]->evaluate(env);
+        setVariable(localEnv, function->params[i], arguments[i]->evaluate(env));
     }
 
+    Interpreter* interpreter = env.interpreter;
+    ShadowFrame frame(interpreter ? interpreter->shadowStack : nullptr, function->name.c_str());
+    TraceSpan span(Tracer::forCall(), function->name.c_str(), Tracer::kCallCategory, line);
+    // reached in stackless mode only through nodes the Vm hands back here
+    if (interpreter && interpreter->stackless) return Vm(*interpreter).run(function->compiled(), localEnv);
     try {
-        for (const auto& stmt : function->body)
+        for (const auto& stmt : body) {
+            if (interpreter) interpreter->atLine(stmt->line);
             stmt->execute(localEnv);
+        }
     } catch (const Value& returnVal) {
         return returnVal;
     }
@@ -33,31 +126,122 @@ Value Call::evaluate(Environment& env) {
     return {};
 }
 
-Value Postfix::evaluate(Environment& env) {
-    auto var = std::dynamic_pointer_cast<Variable>(operand);
+Value Postfix::evaluate(Environment& env) const {
+    countNode(env, NodeKind::Postfix);
+    auto var = dynamic_cast<const Variable*>(operand.get());
     if (!var) {
         throw std::runtime_error("Postfix operator must be applied to a variable.");
     }
 
+    countLookup(env);
     auto it = env.find(var->name);
     if (it == env.end()) {
         throw std::runtime_error("Undefined variable '" + var->name + "'.");
     }
 
-    Value current = it->second;
+    int64_t delta;
+    if (this->op.type == TokenType::INCREMENT) {
+        delta = 1;
+    } else if (this->op.type == TokenType::DECREMENT) {
+        delta = -1;
+    } else {
+        throw std::runtime_error("Unknown postfix operator.");
+    }
 
-    if (!std::holds_alternative<double>(current)) {
+    Value& current = it->second;
+    if (auto integer = std::get_if<int64_t>(&current)) {
+        int64_t old = *integer;
+        if (isExactInteger(old + delta)) {
+            *integer = old + delta;
+            return old;
+        }
+    }
+    if (!isNumber(current)) {
         throw std::runtime_error("Postfix operators can only be applied to numbers.");
     }
 
-    double val = std::get<double>(current);
+    Value old = current;
+    current = asDouble(current) + static_cast<double>(delta);
+    return old;
+}
 
-    if (this->op.type == TokenType::INCREMENT) {
-        env[var->name] = val + 1;
-        return val; 
-    } else if (this->op.type == TokenType::DECREMENT) {
-        env[var->name] = val - 1;
-        return val; 
+Value Spawn::evaluate(Environment& env) const {
+    countNode(env, NodeKind::Spawn);
+    Interpreter& interpreter = runningInterpreter(env);
+    auto it = env.find(call->callee);
+    if (it == env.end()) throw std::runtime_error("Undefined function: " + call->callee);
+    auto function = toFunction(it->second, call->callee);
+
+    std::vector<Value> args;
+    args.reserve(call->arguments.size());
+    for (const auto& argument : call->arguments) args.push_back(argument->evaluate(env));
+    return Task::spawn(interpreter, std::move(function), std::move(args), env);
+}
+
+Value Await::evaluate(Environment& env) const {
+    countNode(env, NodeKind::Await);
+    Interpreter& interpreter = runningInterpreter(env);
+    Value value = task->evaluate(env);
+    if (!std::holds_alternative<std::shared_ptr<Task>>(value))
+        throw std::runtime_error("Can only await a task.");
+    return std::get<std::shared_ptr<Task>>(value)->await(interpreter);
+}
+
+Value ArrayLiteral::evaluate(Environment& env) const {
+    countNode(env, NodeKind::ArrayLiteral);
+    std::vector<Value> values;
+    values.reserve(elements.size());
+    for (const auto& element : elements) values.push_back(element->evaluate(env));
+    checkGrowth(env, values.size() * sizeof(Value));
+    auto array = std::make_shared<Array>(std::move(values));
+    array->charge(env.interpreter);
+    return array;
+}
+
+Value MapLiteral::evaluate(Environment& env) const {
+    countNode(env, NodeKind::MapLiteral);
+    auto map = std::make_shared<Map>();
+    for (const auto& [key, value] : entries) {
+        Value k = key->evaluate(env);
+        map->set(k, value->evaluate(env));
+    }
+    map->charge(env.interpreter);
+    return map;
+}
+
+Value Index::evaluate(Environment& env) const {
+    countNode(env, NodeKind::Index);
+    Value target = array->evaluate(env);
+    return apply(target, index->evaluate(env));
+}
+
+Value Index::apply(const Value& target, const Value& key) {
+    if (std::holds_alternative<std::shared_ptr<Array>>(target)) {
+        return std::get<std::shared_ptr<Array>>(target)->get(toIndex(key));
+    }
+    if (std::holds_alternative<std::shared_ptr<Map>>(target)) {
+        return mapLookup(*std::get<std::shared_ptr<Map>>(target), key);
+    }
+    throw std::runtime_error("Can only index arrays and maps.");
+}
+
+Value IndexAssign::evaluate(Environment& env) const {
+    countNode(env, NodeKind::IndexAssign);
+    Value target = array->evaluate(env);
+    Value key = index->evaluate(env);
+    Value value = valueExpr->evaluate(env);
+    apply(env, target, key, value);
+    return value;
+}
+
+void IndexAssign::apply(Environment& env, const Value& target, const Value& key, const Value& value) {
+    if (std::holds_alternative<std::shared_ptr<Array>>(target)) {
+        std::get<std::shared_ptr<Array>>(target)->set(toIndex(key), value, env.interpreter);
+        return;
+    }
+    if (std::holds_alternative<std::shared_ptr<Map>>(target)) {
+        std::get<std::shared_ptr<Map>>(target)->set(key, value, env.interpreter);
+        return;
     }
-    throw std::runtime_error("Unknown postfix operator.");
+    throw std::runtime_error("Can only index arrays and maps.");
 }
@@ -0,0 +1,154 @@
+#include "fiber.hpp"
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// ThreadSanitizer has to be told about stack switches, or it mixes up the
+// fibers' histories with those of the threads they happen to run on.
+#if defined(__SANITIZE_THREAD__)
+#define CODELANG_TSAN_FIBERS 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define CODELANG_TSAN_FIBERS 1
+#endif
+#endif
+
+#ifdef CODELANG_TSAN_FIBERS
+extern "C" {
+void* __tsan_get_current_fiber();
+void* __tsan_create_fiber(unsigned flags);
+void __tsan_destroy_fiber(void* fiber);
+void __tsan_switch_to_fiber(void* fiber, unsigned flags);
+}
+#endif
+
+namespace {
+
+void* tsanCurrent() {
+#ifdef CODELANG_TSAN_FIBERS
+    return __tsan_get_current_fiber();
+#else
+    return nullptr;
+#endif
+}
+
+void* tsanCreate() {
+#ifdef CODELANG_TSAN_FIBERS
+    return __tsan_create_fiber(0);
+#else
+    return nullptr;
+#endif
+}
+
+void tsanDestroy(void* fiber) {
+#ifdef CODELANG_TSAN_FIBERS
+    __tsan_destroy_fiber(fiber);
+#else
+    (void)fiber;
+#endif
+}
+
+void tsanSwitch(void* fiber) {
+#ifdef CODELANG_TSAN_FIBERS
+    __tsan_switch_to_fiber(fiber, 0);
+#else
+    (void)fiber;
+#endif
+}
+
+} // namespace
+
+void Fiber::run() {
+    body();
+    done = true;
+    tsanSwitch(tsanCaller);
+}
+
+#ifdef _WIN32
+
+Fiber::Fiber(std::function<void()> body, size_t stackSize) : body(std::move(body)) {
+    handle = CreateFiber(stackSize, &Fiber::entry, this);
+    if (!handle) throw std::runtime_error("Could not allocate a task stack");
+    tsanFiber = tsanCreate();
+}
+
+Fiber::~Fiber() {
+    DeleteFiber(handle);
+    tsanDestroy(tsanFiber);
+}
+
+void __stdcall Fiber::entry(void* fiber) {
+    auto* self = static_cast<Fiber*>(fiber);
+    self->run();
+    // a fiber routine must never return
+    SwitchToFiber(self->caller);
+}
+
+void Fiber::resume() {
+    if (!IsThreadAFiber()) ConvertThreadToFiber(nullptr);
+    caller = GetCurrentFiber();
+    tsanCaller = tsanCurrent();
+    tsanSwitch(tsanFiber);
+    SwitchToFiber(handle);
+}
+
+void Fiber::suspend() {
+    tsanSwitch(tsanCaller);
+    SwitchToFiber(caller);
+}
+
+#else
+
+namespace {
+// makecontext can only pass int arguments, so the fiber being started for
+// the first time is handed to entry() through here.
+thread_local Fiber* starting = nullptr;
+}
+
+Fiber::Fiber(std::function<void()> body, size_t stackSize) : body(std::move(body)) {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    mappedSize = (stackSize + page - 1) / page * page + page;
+    // reserved, not committed: pages are only backed once the stack reaches them
+    void* addr = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (addr == MAP_FAILED) throw std::runtime_error("Could not allocate a task stack");
+    stack = addr;
+    // the stack grows down, so an overflow runs into this guard page
+    mprotect(stack, page, PROT_NONE);
+
+    getcontext(&context);
+    context.uc_stack.ss_sp = stack;
+    context.uc_stack.ss_size = mappedSize;
+    context.uc_link = &callerContext;
+    makecontext(&context, &Fiber::entry, 0);
+    tsanFiber = tsanCreate();
+}
+
+Fiber::~Fiber() {
+    munmap(stack, mappedSize);
+    tsanDestroy(tsanFiber);
+}
+
+void Fiber::entry() {
+    starting->run();
+    // returning continues at uc_link, i.e. the last resume()
+}
+
+void Fiber::resume() {
+    starting = this;
+    tsanCaller = tsanCurrent();
+    tsanSwitch(tsanFiber);
+    swapcontext(&callerContext, &context);
+}
+
+void Fiber::suspend() {
+    tsanSwitch(tsanCaller);
+    swapcontext(&context, &callerContext);
+}
+
+#endif
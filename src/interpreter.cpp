@@ -1,8 +1,155 @@
 #include "interpreter.hpp"
 #include "stmt.hpp"
+#include "task.hpp"
+#include "trace.hpp"
+#include "vm.hpp"
+#include <thread>
+
+Interpreter::Interpreter(std::ostream& out, OutputSink::Mode outputMode)
+    : output(out, outputMode) {
+    environment.interpreter = this;
+}
+
+Interpreter::~Interpreter() {
+    // hand back what this task or parfor chunk took but didn't use
+    if (stepPool && stepLimit > steps) stepPool->left += stepLimit - steps;
+}
 
 void Interpreter::interpret(const std::vector<std::shared_ptr<Stmt>>& statements) {
-    for (const auto& stmt : statements) {
-        stmt->execute(environment);
+    stepLimit = 0;  // maxSteps and steps may have been set since the last run
+    try {
+        std::unique_ptr<Vm> vm = stackless ? std::make_unique<Vm>(*this) : nullptr;
+        try {
+            for (const auto& stmt : statements) {
+                atLine(stmt->line);
+                TraceSpan span("statement", "statement", stmt->line);
+                if (vm) {
+                    vm->run(*compileStatement(stmt), environment);
+                } else {
+                    stmt->execute(environment);
+                }
+            }
+        } catch (const Value&) {
+            // a `return` outside any function ends the program; its value is unused
+        }
+        joinSpawned();
+    } catch (...) {
+        spawned.clear();
+        stepPool.reset();
+        output.flush();
+        throw;
+    }
+    stepPool.reset();
+    output.flush();
+}
+
+namespace {
+// Steps an interpreter takes from a shared pool at a time.
+constexpr uint64_t kStepBatch = 64;
+}
+
+uint64_t StepPool::take(uint64_t wanted) {
+    uint64_t available = left.load(std::memory_order_relaxed);
+    uint64_t granted;
+    do {
+        granted = std::min(wanted, available);
+        if (granted == 0) return 0;
+    } while (!left.compare_exchange_weak(available, available - granted, std::memory_order_relaxed));
+    return granted;
+}
+
+void Interpreter::outOfSteps() {
+    if (stepPool) {
+        uint64_t granted = stepPool->take(kStepBatch);
+        if (granted == 0) throw LimitError("Step limit exceeded");
+        stepLimit = steps - 1 + granted;
+        return;
+    }
+    stepLimit = maxSteps != 0 ? maxSteps : UINT64_MAX;
+    if (steps > stepLimit) throw LimitError("Step limit exceeded");
+}
+
+std::shared_ptr<StepPool> Interpreter::shareSteps() {
+    if (maxSteps == 0) return nullptr;
+    if (!stepPool) {
+        stepPool = std::make_shared<StepPool>(maxSteps - std::min(steps, maxSteps));
+        stepLimit = steps;  // this interpreter now takes its steps from the pool too
+    }
+    return stepPool;
+}
+
+TaskScheduler& Interpreter::taskScheduler() {
+    if (!scheduler) {
+        size_t threads = taskThreads != 0 ? taskThreads : std::thread::hardware_concurrency();
+        ownedScheduler = std::make_unique<TaskScheduler>(threads);
+        scheduler = ownedScheduler.get();
+    }
+    return *scheduler;
+}
+
+void Interpreter::joinSpawned() {
+    std::vector<std::shared_ptr<Task>> tasks;
+    tasks.swap(spawned);
+    for (const auto& task : tasks) task->join(*this);
+}
+
+size_t variableFootprint(const std::string& name, const Value& value) {
+    // hash node + key + value; strings count their characters
+    constexpr size_t kNodeOverhead = 32;
+    size_t bytes = kNodeOverhead + sizeof(Value) + name.size();
+    if (std::holds_alternative<std::string>(value)) bytes += std::get<std::string>(value).size();
+    return bytes;
+}
+
+size_t environmentFootprint(const Environment& env) {
+    size_t bytes = 0;
+    for (const auto& [name, value] : env) bytes += variableFootprint(name, value);
+    return bytes;
+}
+
+void setVariable(Environment& env, const std::string& name, Value value) {
+    countLookup(env);
+    Interpreter* interpreter = env.interpreter;
+    if (!interpreter || interpreter->maxMemory == 0) {
+        env[name] = std::move(value);
+        return;
+    }
+    auto it = env.find(name);
+    size_t before = it == env.end() ? 0 : variableFootprint(name, it->second);
+    size_t after = variableFootprint(name, value);
+    if (after > before) {
+        interpreter->chargeMemory(after - before);
+    } else {
+        interpreter->releaseMemory(before - after);
+    }
+    if (it == env.end()) {
+        env.emplace(name, std::move(value));
+    } else {
+        it->second = std::move(value);
+    }
+}
+
+FrameMemory::FrameMemory(const Environment& frame)
+    : frame(frame), interpreter(frame.interpreter) {
+    if (interpreter && interpreter->maxMemory == 0) interpreter = nullptr;
+    if (interpreter) interpreter->chargeMemory(environmentFootprint(frame));
+}
+
+FrameMemory::~FrameMemory() {
+    if (interpreter) interpreter->releaseMemory(environmentFootprint(frame));
+}
+
+void MemoryCharge::update(Interpreter* interpreter, size_t total) {
+    if (!account) {
+        if (!interpreter || interpreter->maxMemory == 0) return;
+        if (!interpreter->containerMemory) interpreter->containerMemory = std::make_shared<ContainerMemory>();
+        account = interpreter->containerMemory;
+    }
+    if (total > bytes) {
+        if (interpreter) interpreter->checkAllocation(total - bytes);
+        account->used += total - bytes;
+    } else {
+        account->used -= bytes - total;
     }
-}
\ No newline at end of file
+    bytes = total;
+}
@@ -0,0 +1,238 @@
+#include "kernels.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CODELANG_KERNELS_AVX2 1
+#include <immintrin.h>
+#endif
+
+// Built with -ffp-contract=off (see CMakeLists.txt), so `s += a * b` is never
+// turned into a fused multiply-add that the AVX2 path doesn't do.
+
+namespace {
+
+constexpr size_t kWholeBlocks = ~(kKernelLanes - 1);
+
+// Lane combining and tails are shared by both sets, which is what keeps
+// their results identical.
+double addLanes(double* lanes) {
+    for (size_t width = kKernelLanes / 2; width > 0; width /= 2) {
+        for (size_t l = 0; l < width; ++l) lanes[l] += lanes[l + width];
+    }
+    return lanes[0];
+}
+
+double minOf(double x, double m) { return x < m ? x : m; }
+double maxOf(double x, double m) { return x > m ? x : m; }
+
+template <double (*pick)(double, double)>
+double pickLanes(double* lanes) {
+    for (size_t width = kKernelLanes / 2; width > 0; width /= 2) {
+        for (size_t l = 0; l < width; ++l) lanes[l] = pick(lanes[l + width], lanes[l]);
+    }
+    return lanes[0];
+}
+
+template <double (*pick)(double, double)>
+double pickTail(double m, const double* a, size_t begin, size_t n) {
+    for (size_t i = begin; i < n; ++i) m = pick(a[i], m);
+    return m;
+}
+
+double sumScalar(const double* a, size_t n) {
+    double lanes[kKernelLanes] = {};
+    size_t blocks = n & kWholeBlocks;
+    for (size_t i = 0; i < blocks; i += kKernelLanes) {
+        for (size_t l = 0; l < kKernelLanes; ++l) lanes[l] += a[i + l];
+    }
+    double s = addLanes(lanes);
+    for (size_t i = blocks; i < n; ++i) s += a[i];
+    return s;
+}
+
+double dotScalar(const double* a, const double* b, size_t n) {
+    double lanes[kKernelLanes] = {};
+    size_t blocks = n & kWholeBlocks;
+    for (size_t i = 0; i < blocks; i += kKernelLanes) {
+        for (size_t l = 0; l < kKernelLanes; ++l) lanes[l] += a[i + l] * b[i + l];
+    }
+    double s = addLanes(lanes);
+    for (size_t i = blocks; i < n; ++i) s += a[i] * b[i];
+    return s;
+}
+
+template <double (*pick)(double, double)>
+double pickScalar(const double* a, size_t n) {
+    if (n < kKernelLanes) return pickTail<pick>(a[0], a, 1, n);
+    double lanes[kKernelLanes];
+    for (size_t l = 0; l < kKernelLanes; ++l) lanes[l] = a[l];
+    size_t blocks = n & kWholeBlocks;
+    for (size_t i = kKernelLanes; i < blocks; i += kKernelLanes) {
+        for (size_t l = 0; l < kKernelLanes; ++l) lanes[l] = pick(a[i + l], lanes[l]);
+    }
+    return pickTail<pick>(pickLanes<pick>(lanes), a, blocks, n);
+}
+
+void addScalarLoop(const double* a, const double* b, double* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = a[i] + b[i];
+}
+
+void mulScalarLoop(const double* a, const double* b, double* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = a[i] * b[i];
+}
+
+void addConstantScalar(const double* a, double k, double* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = a[i] + k;
+}
+
+void mulConstantScalar(const double* a, double k, double* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = a[i] * k;
+}
+
+const NumericKernels kScalar = {
+    sumScalar, dotScalar, pickScalar<minOf>, pickScalar<maxOf>,
+    addScalarLoop, mulScalarLoop, addConstantScalar, mulConstantScalar,
+};
+
+#ifdef CODELANG_KERNELS_AVX2
+
+#define AVX2 __attribute__((target("avx2")))
+
+// Four 4-wide accumulators hold lanes 0-3, 4-7, 8-11 and 12-15.
+AVX2 void storeLanes(double* lanes, __m256d v0, __m256d v1, __m256d v2, __m256d v3) {
+    _mm256_storeu_pd(lanes, v0);
+    _mm256_storeu_pd(lanes + 4, v1);
+    _mm256_storeu_pd(lanes + 8, v2);
+    _mm256_storeu_pd(lanes + 12, v3);
+}
+
+AVX2 double sumAvx2(const double* a, size_t n) {
+    __m256d v0 = _mm256_setzero_pd(), v1 = v0, v2 = v0, v3 = v0;
+    size_t blocks = n & kWholeBlocks;
+    for (size_t i = 0; i < blocks; i += kKernelLanes) {
+        v0 = _mm256_add_pd(v0, _mm256_loadu_pd(a + i));
+        v1 = _mm256_add_pd(v1, _mm256_loadu_pd(a + i + 4));
+        v2 = _mm256_add_pd(v2, _mm256_loadu_pd(a + i + 8));
+        v3 = _mm256_add_pd(v3, _mm256_loadu_pd(a + i + 12));
+    }
+    double lanes[kKernelLanes];
+    storeLanes(lanes, v0, v1, v2, v3);
+    double s = addLanes(lanes);
+    for (size_t i = blocks; i < n; ++i) s += a[i];
+    return s;
+}
+
+AVX2 double dotAvx2(const double* a, const double* b, size_t n) {
+    __m256d v0 = _mm256_setzero_pd(), v1 = v0, v2 = v0, v3 = v0;
+    size_t blocks = n & kWholeBlocks;
+    for (size_t i = 0; i < blocks; i += kKernelLanes) {
+        v0 = _mm256_add_pd(v0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        v1 = _mm256_add_pd(v1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+        v2 = _mm256_add_pd(v2, _mm256_mul_pd(_mm256_loadu_pd(a + i + 8), _mm256_loadu_pd(b + i + 8)));
+        v3 = _mm256_add_pd(v3, _mm256_mul_pd(_mm256_loadu_pd(a + i + 12), _mm256_loadu_pd(b + i + 12)));
+    }
+    double lanes[kKernelLanes];
+    storeLanes(lanes, v0, v1, v2, v3);
+    double s = addLanes(lanes);
+    for (size_t i = blocks; i < n; ++i) s += a[i] * b[i];
+    return s;
+}
+
+// _mm256_min_pd(x, m) is exactly `x < m ? x : m` per lane, NaN included.
+AVX2 double minAvx2(const double* a, size_t n) {
+    if (n < kKernelLanes) return pickTail<minOf>(a[0], a, 1, n);
+    __m256d v0 = _mm256_loadu_pd(a), v1 = _mm256_loadu_pd(a + 4);
+    __m256d v2 = _mm256_loadu_pd(a + 8), v3 = _mm256_loadu_pd(a + 12);
+    size_t blocks = n & kWholeBlocks;
+    for (size_t i = kKernelLanes; i < blocks; i += kKernelLanes) {
+        v0 = _mm256_min_pd(_mm256_loadu_pd(a + i), v0);
+        v1 = _mm256_min_pd(_mm256_loadu_pd(a + i + 4), v1);
+        v2 = _mm256_min_pd(_mm256_loadu_pd(a + i + 8), v2);
+        v3 = _mm256_min_pd(_mm256_loadu_pd(a + i + 12), v3);
+    }
+    double lanes[kKernelLanes];
+    storeLanes(lanes, v0, v1, v2, v3);
+    return pickTail<minOf>(pickLanes<minOf>(lanes), a, blocks, n);
+}
+
+AVX2 double maxAvx2(const double* a, size_t n) {
+    if (n < kKernelLanes) return pickTail<maxOf>(a[0], a, 1, n);
+    __m256d v0 = _mm256_loadu_pd(a), v1 = _mm256_loadu_pd(a + 4);
+    __m256d v2 = _mm256_loadu_pd(a + 8), v3 = _mm256_loadu_pd(a + 12);
+    size_t blocks = n & kWholeBlocks;
+    for (size_t i = kKernelLanes; i < blocks; i += kKernelLanes) {
+        v0 = _mm256_max_pd(_mm256_loadu_pd(a + i), v0);
+        v1 = _mm256_max_pd(_mm256_loadu_pd(a + i + 4), v1);
+        v2 = _mm256_max_pd(_mm256_loadu_pd(a + i + 8), v2);
+        v3 = _mm256_max_pd(_mm256_loadu_pd(a + i + 12), v3);
+    }
+    double lanes[kKernelLanes];
+    storeLanes(lanes, v0, v1, v2, v3);
+    return pickTail<maxOf>(pickLanes<maxOf>(lanes), a, blocks, n);
+}
+
+AVX2 void addAvx2(const double* a, const double* b, double* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    for (; i < n; ++i) out[i] = a[i] + b[i];
+}
+
+AVX2 void mulAvx2(const double* a, const double* b, double* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    for (; i < n; ++i) out[i] = a[i] * b[i];
+}
+
+AVX2 void addConstantAvx2(const double* a, double k, double* out, size_t n) {
+    __m256d kv = _mm256_set1_pd(k);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(a + i), kv));
+    for (; i < n; ++i) out[i] = a[i] + k;
+}
+
+AVX2 void mulConstantAvx2(const double* a, double k, double* out, size_t n) {
+    __m256d kv = _mm256_set1_pd(k);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), kv));
+    for (; i < n; ++i) out[i] = a[i] * k;
+}
+
+#undef AVX2
+
+const NumericKernels kAvx2 = {
+    sumAvx2, dotAvx2, minAvx2, maxAvx2,
+    addAvx2, mulAvx2, addConstantAvx2, mulConstantAvx2,
+};
+
+#endif
+
+} // namespace
+
+const NumericKernels& scalarKernels() {
+    return kScalar;
+}
+
+const NumericKernels* avx2Kernels() {
+#ifdef CODELANG_KERNELS_AVX2
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported ? &kAvx2 : nullptr;
+#else
+    return nullptr;
+#endif
+}
+
+const NumericKernels& numericKernels() {
+    static const NumericKernels& chosen = avx2Kernels() ? *avx2Kernels() : scalarKernels();
+    return chosen;
+}
+
+void prefixSum(const double* a, double* out, size_t n) {
+    double s = 0;
+    for (size_t i = 0; i < n; ++i) {
+        s += a[i];
+        out[i] = s;
+    }
+}
@@ -0,0 +1,172 @@
+#include "map.hpp"
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+constexpr uint8_t kEmpty = 0x80;
+constexpr uint8_t kDeleted = 0xFE;
+constexpr size_t kNotFound = static_cast<size_t>(-1);
+constexpr size_t kMinCapacity = 16;
+
+uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// The low 7 bits go in the control byte, the rest pick the first slot.
+uint8_t controlByte(uint64_t hash) {
+    return static_cast<uint8_t>(hash & 0x7F);
+}
+
+} // namespace
+
+uint64_t Map::hashKey(const Value& key) {
+    if (isNumber(key)) {
+        // by value, so that 1 and 1.0 are the same key
+        double number = asDouble(key);
+        if (std::isnan(number)) throw std::runtime_error("Map keys cannot be NaN.");
+        if (number == 0) number = 0;  // -0 and 0 are the same key
+        uint64_t bits;
+        std::memcpy(&bits, &number, sizeof(bits));
+        return mix(bits);
+    }
+    if (std::holds_alternative<std::string>(key)) {
+        return mix(std::hash<std::string>{}(std::get<std::string>(key)));
+    }
+    throw std::runtime_error("Map keys must be numbers or strings.");
+}
+
+size_t Map::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return liveCount;
+}
+
+size_t Map::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return storedBytes();
+}
+
+size_t Map::storedBytes() const {
+    return order.size() * sizeof(Entry) + control.size() * (sizeof(uint8_t) + sizeof(uint32_t));
+}
+
+void Map::charge(Interpreter* interpreter) {
+    std::lock_guard<std::mutex> lock(mutex);
+    charged.update(interpreter, storedBytes());
+}
+
+bool Map::get(const Value& key, Value& value) const {
+    uint64_t hash = hashKey(key);
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t slot = find(key, hash);
+    if (slot == kNotFound) return false;
+    value = order[slots[slot]].value;
+    return true;
+}
+
+void Map::set(const Value& key, Value value, Interpreter* interpreter) {
+    uint64_t hash = hashKey(key);
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t slot = find(key, hash);
+    if (slot != kNotFound) {
+        order[slots[slot]].value = std::move(value);
+        return;
+    }
+    // keep at least one slot in eight empty, so every probe ends
+    if ((usedSlots + 1) * 8 > control.size() * 7) rebuild();
+    order.push_back({key, std::move(value), hash, true});
+    place(static_cast<uint32_t>(order.size() - 1), hash);
+    liveCount++;
+    charged.update(interpreter, storedBytes());
+}
+
+bool Map::has(const Value& key) const {
+    uint64_t hash = hashKey(key);
+    std::lock_guard<std::mutex> lock(mutex);
+    return find(key, hash) != kNotFound;
+}
+
+bool Map::erase(const Value& key) {
+    uint64_t hash = hashKey(key);
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t slot = find(key, hash);
+    if (slot == kNotFound) return false;
+    Entry& entry = order[slots[slot]];
+    entry.live = false;
+    entry.key = Value();
+    entry.value = Value();
+    control[slot] = kDeleted;
+    liveCount--;
+    return true;
+}
+
+std::vector<Value> Map::keys() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Value> result;
+    result.reserve(liveCount);
+    for (const auto& entry : order) {
+        if (entry.live) result.push_back(entry.key);
+    }
+    return result;
+}
+
+std::vector<std::pair<Value, Value>> Map::entries() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::pair<Value, Value>> result;
+    result.reserve(liveCount);
+    for (const auto& entry : order) {
+        if (entry.live) result.emplace_back(entry.key, entry.value);
+    }
+    return result;
+}
+
+// Linear probing from the hash's home slot; only slots whose control byte
+// matches are compared, and those by cached hash before the key itself.
+size_t Map::find(const Value& key, uint64_t hash) const {
+    if (control.empty()) return kNotFound;
+    size_t mask = control.size() - 1;
+    uint8_t tag = controlByte(hash);
+    for (size_t pos = (hash >> 7) & mask;; pos = (pos + 1) & mask) {
+        uint8_t c = control[pos];
+        if (c == kEmpty) return kNotFound;
+        if (c == tag) {
+            const Entry& entry = order[slots[pos]];
+            if (entry.hash == hash && valuesEqual(entry.key, key)) return pos;
+        }
+    }
+}
+
+void Map::place(uint32_t entry, uint64_t hash) {
+    size_t mask = control.size() - 1;
+    size_t pos = (hash >> 7) & mask;
+    while (control[pos] != kEmpty && control[pos] != kDeleted) pos = (pos + 1) & mask;
+    if (control[pos] == kEmpty) usedSlots++;
+    control[pos] = controlByte(hash);
+    slots[pos] = entry;
+}
+
+// Drops deleted entries and re-indexes the rest into a table at most half
+// full, reusing the cached hashes.
+void Map::rebuild() {
+    if (liveCount != order.size()) {
+        std::vector<Entry> kept;
+        kept.reserve(liveCount);
+        for (auto& entry : order) {
+            if (entry.live) kept.push_back(std::move(entry));
+        }
+        order.swap(kept);
+    }
+    size_t capacity = kMinCapacity;
+    while ((liveCount + 1) * 2 > capacity) capacity *= 2;
+    control.assign(capacity, kEmpty);
+    slots.assign(capacity, 0);
+    usedSlots = 0;
+    for (size_t i = 0; i < order.size(); ++i) place(static_cast<uint32_t>(i), order[i].hash);
+}
@@ -0,0 +1,94 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#include <fstream>
+#include <sstream>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path) {
+    close();
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    fallback = buffer.str();
+    bytes = fallback.data();
+    length = fallback.size();
+    return true;
+}
+
+void MappedFile::close() {
+    fallback.clear();
+    bytes = nullptr;
+    length = 0;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+    if (!S_ISREG(info.st_mode)) {
+        // a pipe, FIFO or terminal has no size to map: read it to the end
+        char chunk[64 * 1024];
+        ssize_t got;
+        while ((got = ::read(fd, chunk, sizeof chunk)) != 0) {
+            if (got < 0 && errno == EINTR) continue;
+            if (got < 0) {
+                ::close(fd);
+                fallback.clear();
+                return false;
+            }
+            fallback.append(chunk, static_cast<size_t>(got));
+        }
+        ::close(fd);
+        bytes = fallback.data();
+        length = fallback.size();
+        return true;
+    }
+    length = static_cast<size_t>(info.st_size);
+    if (length == 0) {
+        ::close(fd);
+        bytes = "";
+        return true;
+    }
+
+    void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        length = 0;
+        return false;
+    }
+    bytes = static_cast<const char*>(addr);
+    mapped = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (mapped) munmap(const_cast<char*>(bytes), length);
+    mapped = false;
+    fallback.clear();
+    bytes = nullptr;
+    length = 0;
+}
+
+#endif
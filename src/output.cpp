@@ -0,0 +1,121 @@
+#include "output.hpp"
+#include "array.hpp"
+#include "map.hpp"
+#include <charconv>
+
+size_t formatNumber(double value, char* out) {
+    auto result = std::to_chars(out, out + kMaxNumberChars, value, std::chars_format::general, 6);
+    return static_cast<size_t>(result.ptr - out);
+}
+
+size_t formatNumber(int64_t value, char* out) {
+    // up to six digits "%g" shows an integer as it is; past that it rounds
+    if (value > -1000000 && value < 1000000) {
+        return static_cast<size_t>(std::to_chars(out, out + kMaxNumberChars, value).ptr - out);
+    }
+    return formatNumber(static_cast<double>(value), out);
+}
+
+OutputSink::OutputSink(std::ostream& out, Mode mode, size_t capacity)
+    : out(out), mode(mode), capacity(capacity) {
+    buffer.reserve(capacity);
+}
+
+OutputSink::~OutputSink() {
+    flush();
+}
+
+void OutputSink::print(const Value& value) {
+    if (isNumber(value) || std::holds_alternative<std::string>(value) ||
+        std::holds_alternative<std::shared_ptr<Array>>(value) || std::holds_alternative<std::shared_ptr<Map>>(value)) {
+        writeValue(value, 0);
+        endLine();
+    }
+}
+
+// Arrays print as `[1, 2, x]` and maps as `{a: 1, b: 2}`, in insertion order.
+// Anything nested deeper than this shows as `[...]` or `{...}`, which also
+// stops a collection that contains itself.
+constexpr int kMaxPrintDepth = 16;
+
+void OutputSink::writeValue(const Value& value, int depth) {
+    if (auto integer = std::get_if<int64_t>(&value)) {
+        writeNumber(*integer);
+    } else if (std::holds_alternative<double>(value)) {
+        writeNumber(std::get<double>(value));
+    } else if (std::holds_alternative<std::string>(value)) {
+        write(std::get<std::string>(value));
+    } else if (std::holds_alternative<std::shared_ptr<Array>>(value)) {
+        if (depth == kMaxPrintDepth) {
+            write("[...]");
+            return;
+        }
+        write("[");
+        bool first = true;
+        for (const auto& element : std::get<std::shared_ptr<Array>>(value)->elements()) {
+            if (!first) write(", ");
+            first = false;
+            writeValue(element, depth + 1);
+        }
+        write("]");
+    } else if (std::holds_alternative<std::shared_ptr<Map>>(value)) {
+        if (depth == kMaxPrintDepth) {
+            write("{...}");
+            return;
+        }
+        write("{");
+        bool first = true;
+        for (const auto& [key, element] : std::get<std::shared_ptr<Map>>(value)->entries()) {
+            if (!first) write(", ");
+            first = false;
+            writeValue(key, depth + 1);
+            write(": ");
+            writeValue(element, depth + 1);
+        }
+        write("}");
+    }
+}
+
+void OutputSink::write(std::string_view text) {
+    if (limit != 0 && written + text.size() > limit) {
+        append(text.substr(0, limit - written));
+        written = limit;
+        limitReached = true;
+        throw OutputLimitError();
+    }
+    written += text.size();
+    append(text);
+}
+
+void OutputSink::append(std::string_view text) {
+    if (buffer.size() + text.size() > capacity) {
+        flush();
+        if (text.size() > capacity) {
+            out.write(text.data(), static_cast<std::streamsize>(text.size()));
+            return;
+        }
+    }
+    buffer.append(text);
+}
+
+void OutputSink::writeNumber(double value) {
+    char digits[kMaxNumberChars];
+    write(std::string_view(digits, formatNumber(value, digits)));
+}
+
+void OutputSink::writeNumber(int64_t value) {
+    char digits[kMaxNumberChars];
+    write(std::string_view(digits, formatNumber(value, digits)));
+}
+
+void OutputSink::endLine() {
+    write("\n");
+    if (mode == Mode::LineBuffered) flush();
+}
+
+void OutputSink::flush() {
+    if (buffer.empty()) return;
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    buffer.clear();
+    out.flush();
+}
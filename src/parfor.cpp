@@ -0,0 +1,192 @@
+#include "stmt.hpp"
+#include "task.hpp"
+#include "vm.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Fixed, so a reduction's grouping - and with it its floating-point
+// rounding - depends only on the iteration count, never on the machine.
+constexpr size_t kParforChunks = 64;
+
+struct ChunkResult {
+    std::vector<Value> accumulators;
+    std::string output;
+    uint64_t steps = 0;
+    std::exception_ptr error;
+};
+
+// Shared with the helper jobs, which can start after the loop has finished
+// (they then find no chunk left to claim and return).
+struct ParforRun {
+    std::atomic<size_t> nextChunk{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t chunksDone = 0;
+};
+
+// Start value for chunks after the first: 0 or 1, or "" when summing strings.
+Value identity(const std::string& op, const Value& initial) {
+    if (op == "+" && std::holds_alternative<std::string>(initial)) return std::string();
+    return int64_t{op == "*" ? 1 : 0};
+}
+
+double numberOf(const Value& value, const char* what) {
+    if (!isNumber(value)) {
+        throw std::runtime_error(std::string("parfor ") + what + " must be a number.");
+    }
+    return asDouble(value);
+}
+
+} // namespace
+
+void ParforStmt::execute(Environment& env) const {
+    countNode(env, NodeKind::ParforStmt);
+    if (!env.interpreter) throw std::runtime_error("parfor needs a running interpreter.");
+    Interpreter& parent = *env.interpreter;
+
+    Value startValue = start->evaluate(env);
+    Value stepValue = step->evaluate(env);
+    double first = numberOf(startValue, "start");
+    double last = numberOf(bound->evaluate(env), "bound");
+    double stride = numberOf(stepValue, "step");
+    if (!std::isfinite(first) || !std::isfinite(last) || !std::isfinite(stride)) {
+        throw std::runtime_error("parfor start, bound and step must be finite.");
+    }
+    // past this the iterations are no longer exact as doubles, let alone countable
+    constexpr double kExactIntegers = 9007199254740992.0;  // 2^53
+
+    auto holds = [&](double i) {
+        if (comparison == "<") return i < last;
+        if (comparison == "<=") return i <= last;
+        if (comparison == ">") return i > last;
+        return i >= last;
+    };
+    size_t count = 0;
+    if (holds(first)) {
+        bool upward = comparison[0] == '<';
+        if (stride == 0 || (stride > 0) != upward) {
+            throw std::runtime_error("parfor step must move '" + var + "' toward its bound.");
+        }
+        double span = std::floor((last - first) / stride);
+        // also false for a span that overflowed to infinity
+        if (!(span < kExactIntegers)) throw std::runtime_error("parfor has too many iterations.");
+        count = static_cast<size_t>(span) + 1;
+        // the bound itself is excluded by < and >
+        if (!holds(first + static_cast<double>(count - 1) * stride)) count--;
+    }
+    if (count == 0) return;
+    // an integer start and step give integer iterations, while they stay
+    // small enough to be exact as doubles too
+    bool integral = std::holds_alternative<int64_t>(startValue) && std::holds_alternative<int64_t>(stepValue) &&
+                    std::fabs(first) + static_cast<double>(count) * std::fabs(stride) < kExactIntegers;
+    if (env.interpreter) env.interpreter->count([count](Stats& stats) { stats.loopIterations += count; });
+
+    std::vector<Value> initial;
+    for (const auto& reduction : reductions) {
+        auto it = env.find(reduction.name);
+        if (it == env.end()) throw std::runtime_error("Undefined variable: " + reduction.name);
+        initial.push_back(it->second);
+    }
+
+    std::shared_ptr<StepPool> stepPool = parent.shareSteps();
+
+    std::shared_ptr<const Chunk> code = parent.stackless ? compileLoopBody(body) : nullptr;
+    size_t chunks = std::min(count, kParforChunks);
+    std::vector<ChunkResult> results(chunks);
+    auto runChunk = [&](size_t chunk) {
+        ChunkResult& result = results[chunk];
+        std::ostringstream out;
+        Interpreter child(out);
+        child.maxSteps = parent.maxSteps;
+        child.stepPool = stepPool;
+        child.maxMemory = parent.maxMemory;
+        child.stackless = parent.stackless;
+        child.maxDepth = parent.maxDepth;
+        child.output.setLimit(parent.output.limitBytes());
+        child.scheduler = parent.scheduler;
+        child.environment = env;
+        child.environment.interpreter = &child;
+        Environment& local = child.environment;
+        try {
+            FrameMemory frameMemory(local);
+            if (chunk > 0) {
+                for (size_t r = 0; r < reductions.size(); ++r) {
+                    setVariable(local, reductions[r].name, identity(reductions[r].op, initial[r]));
+                }
+            }
+            std::unique_ptr<Vm> vm = code ? std::make_unique<Vm>(child) : nullptr;
+            size_t begin = chunk * count / chunks;
+            size_t end = (chunk + 1) * count / chunks;
+            for (size_t n = begin; n < end; ++n) {
+                if (integral) {
+                    setVariable(local, var, std::get<int64_t>(startValue) +
+                                                static_cast<int64_t>(n) * std::get<int64_t>(stepValue));
+                } else {
+                    setVariable(local, var, first + static_cast<double>(n) * stride);
+                }
+                child.step();
+                if (vm) {
+                    vm->run(*code, local);
+                } else {
+                    body->execute(local);
+                    // the parser rejects `break` here; a tree built some other
+                    // way fails instead of having it act like `continue`
+                    if (local.jump == Jump::Break) throw std::runtime_error("Cannot break out of parfor.");
+                    local.jump = Jump::None;  // a `continue` ends just this iteration
+                }
+            }
+            child.joinSpawned();
+            for (const auto& reduction : reductions) result.accumulators.push_back(local[reduction.name]);
+        } catch (...) {
+            result.error = std::current_exception();
+        }
+        child.output.flush();
+        result.output = out.str();
+        result.steps = child.steps;
+    };
+
+    // Workers and this thread all claim chunks from the same counter, so the
+    // loop finishes even if every worker is busy, including in nested parfors.
+    auto run = std::make_shared<ParforRun>();
+    auto claimChunks = [run, chunks, &runChunk] {
+        size_t chunk;
+        while ((chunk = run->nextChunk++) < chunks) {
+            runChunk(chunk);
+            std::lock_guard<std::mutex> lock(run->mutex);
+            if (++run->chunksDone == chunks) run->finished.notify_all();
+        }
+    };
+    ThreadPool& pool = parent.taskScheduler().workers();
+    size_t helpers = std::min(pool.size(), chunks - 1);
+    for (size_t h = 0; h < helpers; ++h) {
+        pool.submit(claimChunks);
+    }
+    claimChunks();
+    {
+        std::unique_lock<std::mutex> lock(run->mutex);
+        run->finished.wait(lock, [&] { return run->chunksDone == chunks; });
+    }
+
+    // Merge in chunk order: output as if the iterations ran one by one, the
+    // first failing chunk's error, then the reductions left to right.
+    std::vector<Value> combined = initial;
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        ChunkResult& result = results[chunk];
+        parent.chargeSteps(result.steps);
+        parent.output.write(result.output);
+        if (result.error) std::rethrow_exception(result.error);
+        for (size_t r = 0; r < reductions.size(); ++r) {
+            combined[r] = chunk == 0 ? result.accumulators[r]
+                                     : Binary::apply(reductions[r].op, combined[r], result.accumulators[r], &parent);
+        }
+    }
+    for (size_t r = 0; r < reductions.size(); ++r) setVariable(env, reductions[r].name, combined[r]);
+}
@@ -1,23 +1,61 @@
 #include "parser.hpp"
 #include "token.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
 #include <stdexcept>
 #include <iostream>
+#include <algorithm>
+#include <unordered_set>
+
+namespace {
+
+// Records the source line a node came from (for the profiler and errors).
+template <typename Node>
+std::shared_ptr<Node> at(int line, std::shared_ptr<Node> node) {
+    node->line = line;
+    return node;
+}
+
+} // namespace
+
+// Levels of Parser::nesting, for as long as it lives: one to start with
+// (none if `levels` is 0), and one more per deeper().
+class Parser::Nested {
+public:
+    explicit Nested(Parser& parser, int levels = 1) : parser(parser), start(parser.nesting) {
+        for (int i = 0; i < levels; ++i) deeper();
+    }
+    ~Nested() { parser.nesting = start; }
+    Nested(const Nested&) = delete;
+    Nested& operator=(const Nested&) = delete;
+
+    void deeper() {
+        if (parser.nesting >= kMaxNesting) throw std::runtime_error("Too deeply nested.");
+        parser.nesting++;
+    }
+
+private:
+    Parser& parser;
+    int start;
+};
 
 std::shared_ptr<Stmt> Parser::parseStatement() {
+    Nested nested(*this);
+    int line = peek().line;
     if (match({TokenType::LET, TokenType::VAR})) {
         Token nameToken = consume(TokenType::IDENTIFIER, "Expected variable name.");
         consume(TokenType::EQUAL, "Expected '=' after variable name.");
         auto initializer = parseExpression();
         consume(TokenType::SEMICOLON, "Expected ';' after variable declaration.");
-        return std::make_shared<VarStmt>(nameToken.lexeme, initializer);
+        return at(line, std::make_shared<VarStmt>(nameToken.lexeme, initializer));
     }
     if (match({TokenType::PRINT})) {
         auto value = parseExpression();
         consume(TokenType::SEMICOLON, "Expected ';' after value.");
-        return std::make_shared<PrintStmt>(value);
+        return at(line, std::make_shared<PrintStmt>(value));
     }
     if (match({TokenType::LEFT_BRACE})) {
-        return std::make_shared<BlockStmt>(parseBlock());
+        return at(line, std::make_shared<BlockStmt>(parseBlock()));
     }
     if (match({TokenType::IF})) {
         consume(TokenType::LEFT_PAREN, "Expected '(' after 'if'.");
@@ -28,25 +66,240 @@ std::shared_ptr<Stmt> Parser::parseStatement() {
         if (match({TokenType::ELSE})) {
             elseBranch = parseStatement();
         }
-        return std::make_shared<IfStmt>(condition, thenBranch, elseBranch);
+        return at(line, std::make_shared<IfStmt>(condition, thenBranch, elseBranch));
     }
     if (match({TokenType::WHILE})) {
         consume(TokenType::LEFT_PAREN, "Expected '(' after 'while'.");
         auto condition = parseExpression();
         consume(TokenType::RIGHT_PAREN, "Expected ')' after condition.");
-        auto body = parseStatement();
-        return std::make_shared<WhileStmt>(condition, body);
+        auto body = parseLoopBody(false);
+        return at(line, std::make_shared<WhileStmt>(condition, body));
     }
-    if (match({TokenType::FOR})) return parseForStatement();
-    if (match({TokenType::FUN})) return parseFunction();
-    if (match({TokenType::RETURN})) return parseReturn();
+    if (match({TokenType::FOR})) return at(line, parseForStatement());
+    if (match({TokenType::PARFOR})) return at(line, parseParforStatement());
+    if (match({TokenType::FUN})) return at(line, parseFunction());
+    if (match({TokenType::RETURN})) return at(line, parseReturn());
+    if (match({TokenType::BREAK, TokenType::CONTINUE})) return at(line, parseJump());
 
     auto expr = parseExpression();
     consume(TokenType::SEMICOLON, "Expected ';' after expression.");
-    return std::make_shared<ExpressionStmt>(expr);
+    return at(line, std::make_shared<ExpressionStmt>(expr));
+}
+
+namespace {
+
+// Everything a parfor body declares with let/var/function, at any depth
+// (blocks don't open a new scope, so these all live in the chunk's copy).
+void collectDeclarations(const std::shared_ptr<Stmt>& stmt, std::unordered_set<std::string>& names) {
+    if (auto var = std::dynamic_pointer_cast<VarStmt>(stmt)) {
+        names.insert(var->name);
+    } else if (auto function = std::dynamic_pointer_cast<FunctionStmt>(stmt)) {
+        names.insert(function->name);
+    } else if (auto block = std::dynamic_pointer_cast<BlockStmt>(stmt)) {
+        for (const auto& inner : block->statements) collectDeclarations(inner, names);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<IfStmt>(stmt)) {
+        collectDeclarations(ifStmt->thenBranch, names);
+        if (ifStmt->elseBranch) collectDeclarations(ifStmt->elseBranch, names);
+    } else if (auto whileStmt = std::dynamic_pointer_cast<WhileStmt>(stmt)) {
+        collectDeclarations(whileStmt->body, names);
+    }
+}
+
+// What a parfor body may change: the variables it declares and reduces into,
+// and outer containers only at the loop variable `var`.
+struct ParforScope {
+    std::string var;
+    std::unordered_set<std::string> assignable;
+};
+
+// Built-ins that change the array or map passed as their first argument.
+bool mutatesFirstArgument(const std::string& name) {
+    return name == "push" || name == "pop" || name == "set" || name == "delete";
+}
+
+// Fails if `container` is, or is inside, a variable from outside the body:
+// every iteration would change the same array or map, in no fixed order.
+void checkParforMutation(const Expr& container, const ParforScope& scope) {
+    const Expr* root = &container;
+    while (auto index = dynamic_cast<const Index*>(root)) root = index->array.get();
+    auto var = dynamic_cast<const Variable*>(root);
+    if (var && !scope.assignable.count(var->name)) {
+        throw std::runtime_error("parfor body cannot change '" + var->name + "', which every iteration shares: only " +
+                                 var->name + "[" + scope.var + "] = value is allowed.");
+    }
+}
+
+void checkParforTarget(const std::string& name, const ParforScope& scope) {
+    if (!scope.assignable.count(name)) {
+        throw std::runtime_error("parfor body cannot assign to '" + name +
+                                 "': declare it inside the loop or list it in reduce().");
+    }
+}
+
+void checkParforExpr(const std::shared_ptr<Expr>& expr, const ParforScope& scope) {
+    if (!expr) return;
+    if (auto assign = std::dynamic_pointer_cast<Assign>(expr)) {
+        checkParforTarget(assign->name, scope);
+        checkParforExpr(assign->valueExpr, scope);
+    } else if (auto postfix = std::dynamic_pointer_cast<Postfix>(expr)) {
+        if (auto var = std::dynamic_pointer_cast<Variable>(postfix->operand)) {
+            checkParforTarget(var->name, scope);
+        }
+    } else if (auto binary = std::dynamic_pointer_cast<Binary>(expr)) {
+        checkParforExpr(binary->left, scope);
+        checkParforExpr(binary->right, scope);
+    } else if (auto logical = std::dynamic_pointer_cast<Logical>(expr)) {
+        checkParforExpr(logical->left, scope);
+        checkParforExpr(logical->right, scope);
+    } else if (auto unary = std::dynamic_pointer_cast<Unary>(expr)) {
+        checkParforExpr(unary->right, scope);
+    } else if (auto call = std::dynamic_pointer_cast<Call>(expr)) {
+        if (mutatesFirstArgument(call->callee) && !call->arguments.empty()) {
+            checkParforMutation(*call->arguments[0], scope);
+        }
+        for (const auto& arg : call->arguments) checkParforExpr(arg, scope);
+    } else if (auto spawn = std::dynamic_pointer_cast<Spawn>(expr)) {
+        checkParforExpr(spawn->call, scope);
+    } else if (auto await = std::dynamic_pointer_cast<Await>(expr)) {
+        checkParforExpr(await->task, scope);
+    } else if (auto literal = std::dynamic_pointer_cast<ArrayLiteral>(expr)) {
+        for (const auto& element : literal->elements) checkParforExpr(element, scope);
+    } else if (auto literal = std::dynamic_pointer_cast<MapLiteral>(expr)) {
+        for (const auto& [key, value] : literal->entries) {
+            checkParforExpr(key, scope);
+            checkParforExpr(value, scope);
+        }
+    } else if (auto index = std::dynamic_pointer_cast<Index>(expr)) {
+        checkParforExpr(index->array, scope);
+        checkParforExpr(index->index, scope);
+    } else if (auto store = std::dynamic_pointer_cast<IndexAssign>(expr)) {
+        // arrays and maps are shared handles: an outer one may only be filled
+        // at the loop variable, which no two iterations share
+        auto target = std::dynamic_pointer_cast<Variable>(store->array);
+        auto key = std::dynamic_pointer_cast<Variable>(store->index);
+        if (!target || !key || key->name != scope.var) checkParforMutation(*store->array, scope);
+        checkParforExpr(store->array, scope);
+        checkParforExpr(store->index, scope);
+        checkParforExpr(store->valueExpr, scope);
+    }
+}
+
+// Function bodies aren't checked: a call runs in its own copy of the
+// environment, so nothing it assigns is visible outside it anyway. The
+// check is by name, so an outer container a function or a local alias
+// changes gets past it.
+void checkParforStmt(const std::shared_ptr<Stmt>& stmt, const ParforScope& scope) {
+    if (!stmt) return;
+    if (auto exprStmt = std::dynamic_pointer_cast<ExpressionStmt>(stmt)) {
+        checkParforExpr(exprStmt->expression, scope);
+    } else if (auto print = std::dynamic_pointer_cast<PrintStmt>(stmt)) {
+        checkParforExpr(print->expression, scope);
+    } else if (auto var = std::dynamic_pointer_cast<VarStmt>(stmt)) {
+        checkParforExpr(var->initializer, scope);
+    } else if (auto block = std::dynamic_pointer_cast<BlockStmt>(stmt)) {
+        for (const auto& inner : block->statements) checkParforStmt(inner, scope);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<IfStmt>(stmt)) {
+        checkParforExpr(ifStmt->condition, scope);
+        checkParforStmt(ifStmt->thenBranch, scope);
+        checkParforStmt(ifStmt->elseBranch, scope);
+    } else if (auto whileStmt = std::dynamic_pointer_cast<WhileStmt>(stmt)) {
+        checkParforExpr(whileStmt->condition, scope);
+        checkParforStmt(whileStmt->body, scope);
+        checkParforExpr(whileStmt->increment, scope);
+    } else if (std::dynamic_pointer_cast<ReturnStmt>(stmt)) {
+        throw std::runtime_error("Cannot return from inside parfor.");
+    } else if (auto parfor = std::dynamic_pointer_cast<ParforStmt>(stmt)) {
+        // A nested parfor's body was checked against its own loop when it was
+        // parsed. It writes only its reduction variables back into this body,
+        // but the containers it changes must also be apart across this loop.
+        checkParforExpr(parfor->start, scope);
+        checkParforExpr(parfor->bound, scope);
+        checkParforExpr(parfor->step, scope);
+        for (const auto& reduction : parfor->reductions) checkParforTarget(reduction.name, scope);
+        ParforScope inner = scope;
+        collectDeclarations(parfor->body, inner.assignable);
+        inner.assignable.insert(parfor->var);
+        checkParforStmt(parfor->body, inner);
+    }
+}
+
+} // namespace
+
+// parfor (let i = start; i < bound; i = i + step) reduce(+, a), reduce(*, b) body
+// The condition may use <, <=, > or >=; the increment may also be i = i - step,
+// i++ or i--. Bounds and step are evaluated once, before the loop starts.
+std::shared_ptr<Stmt> Parser::parseParforStatement() {
+    consume(TokenType::LEFT_PAREN, "Expected '(' after 'parfor'.");
+    if (!match({TokenType::LET, TokenType::VAR})) {
+        throw std::runtime_error("Expected 'let' to declare the parfor loop variable.");
+    }
+    std::string var = consume(TokenType::IDENTIFIER, "Expected variable name.").lexeme;
+    consume(TokenType::EQUAL, "Expected '=' after variable name.");
+    auto start = parseExpression();
+    consume(TokenType::SEMICOLON, "Expected ';' after variable declaration.");
+
+    auto condition = std::dynamic_pointer_cast<Binary>(parseExpression());
+    auto conditionVar = condition ? std::dynamic_pointer_cast<Variable>(condition->left) : nullptr;
+    if (!conditionVar || conditionVar->name != var ||
+        (condition->op != "<" && condition->op != "<=" && condition->op != ">" && condition->op != ">=")) {
+        throw std::runtime_error("parfor condition must compare '" + var + "' to a bound with <, <=, > or >=.");
+    }
+    consume(TokenType::SEMICOLON, "Expected ';' after loop condition.");
+
+    auto increment = parseExpression();
+    std::shared_ptr<Expr> step;
+    if (auto assign = std::dynamic_pointer_cast<Assign>(increment)) {
+        auto binary = std::dynamic_pointer_cast<Binary>(assign->valueExpr);
+        auto self = binary ? std::dynamic_pointer_cast<Variable>(binary->left) : nullptr;
+        if (assign->name == var && self && self->name == var && binary->op == "+") {
+            step = binary->right;
+        } else if (assign->name == var && self && self->name == var && binary->op == "-") {
+            step = at(binary->line, std::make_shared<Unary>(Token(TokenType::MINUS, "-", std::any(), binary->line), binary->right));
+        }
+    } else if (auto postfix = std::dynamic_pointer_cast<Postfix>(increment)) {
+        auto self = std::dynamic_pointer_cast<Variable>(postfix->operand);
+        if (self && self->name == var) {
+            step = at(postfix->line, std::make_shared<Literal>(int64_t{postfix->op.type == TokenType::INCREMENT ? 1 : -1}));
+        }
+    }
+    if (!step) {
+        throw std::runtime_error("parfor increment must be " + var + " = " + var + " + step, " + var + " = " +
+                                 var + " - step, " + var + "++ or " + var + "--.");
+    }
+    consume(TokenType::RIGHT_PAREN, "Expected ')' after parfor clauses.");
+
+    std::vector<ParforStmt::Reduction> reductions;
+    while (check(TokenType::IDENTIFIER) && peek().lexeme == "reduce") {
+        advance();
+        consume(TokenType::LEFT_PAREN, "Expected '(' after 'reduce'.");
+        if (!match({TokenType::PLUS, TokenType::STAR})) {
+            throw std::runtime_error("reduce() supports '+' and '*'.");
+        }
+        std::string op = previous().lexeme;
+        consume(TokenType::COMMA, "Expected ',' after reduction operator.");
+        std::string name = consume(TokenType::IDENTIFIER, "Expected reduction variable name.").lexeme;
+        consume(TokenType::RIGHT_PAREN, "Expected ')' after reduction.");
+        reductions.push_back({op, name});
+        if (!match({TokenType::COMMA})) break;
+    }
+
+    auto body = parseLoopBody(true);
+
+    ParforScope scope{var, {}};
+    collectDeclarations(body, scope.assignable);
+    scope.assignable.erase(var);
+    for (const auto& reduction : reductions) {
+        if (reduction.name == var) throw std::runtime_error("Cannot reduce into the parfor loop variable.");
+        scope.assignable.insert(reduction.name);
+    }
+    checkParforStmt(body, scope);
+
+    return std::make_shared<ParforStmt>(var, start, condition->op, condition->right, step, std::move(reductions),
+                                        body);
 }
 
 std::shared_ptr<Stmt> Parser::parseForStatement() {
+    int line = previous().line;
     consume(TokenType::LEFT_PAREN, "Expected '(' after 'for'.");
 
     std::shared_ptr<Stmt> initializer;
@@ -57,11 +310,11 @@ std::shared_ptr<Stmt> Parser::parseForStatement() {
         consume(TokenType::EQUAL, "Expected '=' after variable name.");
         auto initExpr = parseExpression();
         consume(TokenType::SEMICOLON, "Expected ';' after variable declaration.");
-        initializer = std::make_shared<VarStmt>(nameToken.lexeme, initExpr);
+        initializer = at(line, std::make_shared<VarStmt>(nameToken.lexeme, initExpr));
     } else {
         auto initExpr = parseExpression();
         consume(TokenType::SEMICOLON, "Expected ';' after loop initializer.");
-        initializer = std::make_shared<ExpressionStmt>(initExpr);
+        initializer = at(line, std::make_shared<ExpressionStmt>(initExpr));
     }
 
     std::shared_ptr<Expr> condition = nullptr;
@@ -76,26 +329,19 @@ std::shared_ptr<Stmt> Parser::parseForStatement() {
     }
     consume(TokenType::RIGHT_PAREN, "Expected ')' after for clauses.");
 
-    auto body = parseStatement();
-
-    if (increment) {
-        body = std::make_shared<BlockStmt>(std::vector<std::shared_ptr<Stmt>>{
-            body,
-            std::make_shared<ExpressionStmt>(increment)
-        });
-    }
+    auto body = parseLoopBody(false);
 
     if (!condition) {
-        condition = std::make_shared<Literal>(1.0);
+        condition = at(line, std::make_shared<Literal>(1.0));
     }
 
-    body = std::make_shared<WhileStmt>(condition, body);
+    body = at(line, std::make_shared<WhileStmt>(condition, body, increment));
 
     if (initializer) {
-        body = std::make_shared<BlockStmt>(std::vector<std::shared_ptr<Stmt>>{
+        body = at(line, std::make_shared<BlockStmt>(std::vector<std::shared_ptr<Stmt>>{
             initializer,
             body
-        });
+        }));
     }
 
     return body;
@@ -104,15 +350,23 @@ std::shared_ptr<Stmt> Parser::parseForStatement() {
 std::shared_ptr<Expr> Parser::parsePostfix() {
     std::shared_ptr<Expr> expr = parsePrimary();
 
+    while (match({TokenType::LEFT_BRACKET})) {
+        int line = previous().line;
+        auto index = parseExpression();
+        consume(TokenType::RIGHT_BRACKET, "Expected ']' after index.");
+        expr = at(line, std::make_shared<Index>(expr, index));
+    }
+
     while (match({TokenType::INCREMENT}) || match({TokenType::DECREMENT})) {
         Token op = previous();
-        expr = std::make_shared<Postfix>(expr, op);
+        expr = at(op.line, std::make_shared<Postfix>(expr, op));
     }
 
     return expr;
 }
 
 std::shared_ptr<Expr> Parser::parseExpression() {
+    Nested nested(*this);
     return parseAssignment();
 }
 
@@ -121,10 +375,14 @@ std::shared_ptr<Expr> Parser::parseAssignment() {
 
     if (match({TokenType::EQUAL})) {
         Token equals = previous();
+        Nested nested(*this);
         auto value = parseAssignment();
 
         if (auto var = std::dynamic_pointer_cast<Variable>(expr)) {
-            return std::make_shared<Assign>(var->name, value);
+            return at(equals.line, std::make_shared<Assign>(var->name, value));
+        }
+        if (auto index = std::dynamic_pointer_cast<Index>(expr)) {
+            return at(equals.line, std::make_shared<IndexAssign>(index->array, index->index, value));
         }
 
         throw std::runtime_error("Invalid assignment target.");
@@ -135,91 +393,141 @@ std::shared_ptr<Expr> Parser::parseAssignment() {
 
 std::shared_ptr<Expr> Parser::parseLogicOr() {
     auto expr = parseLogicAnd();
+    Nested chain(*this, 0);
     while (match({TokenType::OR})) {
         Token op = previous();
+        chain.deeper();
         auto right = parseLogicAnd();
-        expr = std::make_shared<Binary>(expr, op.lexeme, right);
+        expr = at(op.line, std::make_shared<Logical>(expr, op.lexeme, right));
     }
     return expr;
 }
 
 std::shared_ptr<Expr> Parser::parseLogicAnd() {
     auto expr = parseEquality();
+    Nested chain(*this, 0);
     while (match({TokenType::AND})) {
         Token op = previous();
+        chain.deeper();
         auto right = parseEquality();
-        expr = std::make_shared<Binary>(expr, op.lexeme, right);
+        expr = at(op.line, std::make_shared<Logical>(expr, op.lexeme, right));
     }
     return expr;
 }
 
 std::shared_ptr<Expr> Parser::parseEquality() {
     auto expr = parseComparison();
+    Nested chain(*this, 0);
     while (match({TokenType::EQUAL_EQUAL, TokenType::BANG_EQUAL})) {
         Token op = previous();
+        chain.deeper();
         auto right = parseComparison();
-        expr = std::make_shared<Binary>(expr, op.lexeme, right);
+        expr = at(op.line, std::make_shared<Binary>(expr, op.lexeme, right));
     }
     return expr;
 }
 
 std::shared_ptr<Expr> Parser::parseComparison() {
     auto expr = parseTerm();
+    Nested chain(*this, 0);
     while (match({TokenType::GREATER, TokenType::GREATER_EQUAL, TokenType::LESS, TokenType::LESS_EQUAL})) {
         Token op = previous();
+        chain.deeper();
         auto right = parseTerm();
-        expr = std::make_shared<Binary>(expr, op.lexeme, right);
+        expr = at(op.line, std::make_shared<Binary>(expr, op.lexeme, right));
     }
     return expr;
 }
 
 std::shared_ptr<Expr> Parser::parseTerm() {
     auto expr = parseFactor();
+    Nested chain(*this, 0);
     while (match({TokenType::PLUS, TokenType::MINUS})) {
         Token op = previous();
+        chain.deeper();
         auto right = parseFactor();
-        expr = std::make_shared<Binary>(expr, op.lexeme, right);
+        expr = at(op.line, std::make_shared<Binary>(expr, op.lexeme, right));
     }
     return expr;
 }
 
 std::shared_ptr<Expr> Parser::parseFactor() {
     auto expr = parseUnary();
+    Nested chain(*this, 0);
     while (match({TokenType::STAR, TokenType::SLASH})) {
         Token op = previous();
+        chain.deeper();
         auto right = parseUnary();
-        expr = std::make_shared<Binary>(expr, op.lexeme, right);
+        expr = at(op.line, std::make_shared<Binary>(expr, op.lexeme, right));
     }
     return expr;
 }
 
 std::shared_ptr<Expr> Parser::parseUnary() {
+    Nested nested(*this);
     if (match({TokenType::BANG, TokenType::MINUS, TokenType::PLUS_PLUS, TokenType::MINUS_MINUS})) {
         Token op = previous();
         auto right = parseUnary();
-        return std::make_shared<Unary>(op, right);
+        return at(op.line, std::make_shared<Unary>(op, right));
+    }
+    if (match({TokenType::SPAWN})) {
+        int line = previous().line;
+        auto call = std::dynamic_pointer_cast<Call>(parsePrimary());
+        if (!call) throw std::runtime_error("Expected function call after 'spawn'.");
+        return at(line, std::make_shared<Spawn>(call));
+    }
+    if (match({TokenType::AWAIT})) {
+        int line = previous().line;
+        return at(line, std::make_shared<Await>(parseUnary()));
     }
     return parsePostfix();
 }
 
 std::shared_ptr<Expr> Parser::parsePrimary() {
+    int line = peek().line;
     if (match({TokenType::NUMBER})) {
-        return std::make_shared<Literal>(std::any_cast<double>(previous().literal));
+        const std::any& literal = previous().literal;
+        if (auto integer = std::any_cast<int64_t>(&literal)) return at(line, std::make_shared<Literal>(*integer));
+        return at(line, std::make_shared<Literal>(std::any_cast<double>(literal)));
     }
     if (match({TokenType::STRING})) {
-        return std::make_shared<Literal>(std::any_cast<std::string>(previous().literal));
+        return at(line, std::make_shared<Literal>(std::any_cast<std::string>(previous().literal)));
     }
     if (match({TokenType::TRUE})) {
-        return std::make_shared<Literal>(1.0);
+        return at(line, std::make_shared<Literal>(1.0));
     }
     if (match({TokenType::FALSE})) {
-        return std::make_shared<Literal>(0.0);
+        return at(line, std::make_shared<Literal>(0.0));
     }
     if (match({TokenType::LEFT_PAREN})) {
         auto expr = parseExpression();
         consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
         return expr;
     }
+    if (match({TokenType::LEFT_BRACKET})) {
+        std::vector<std::shared_ptr<Expr>> elements;
+        if (!check(TokenType::RIGHT_BRACKET)) {
+            do {
+                elements.push_back(parseExpression());
+            } while (match({TokenType::COMMA}));
+        }
+        consume(TokenType::RIGHT_BRACKET, "Expected ']' after array elements.");
+        return at(line, std::make_shared<ArrayLiteral>(elements));
+    }
+    // a statement starting with '{' is a block, so this is only reached
+    // where an expression is expected
+    if (match({TokenType::LEFT_BRACE})) {
+        std::vector<std::pair<std::shared_ptr<Expr>, std::shared_ptr<Expr>>> entries;
+        if (!check(TokenType::RIGHT_BRACE)) {
+            do {
+                auto key = parseExpression();
+                consume(TokenType::COLON, "Expected ':' after map key.");
+                entries.emplace_back(key, parseExpression());
+            } while (match({TokenType::COMMA}));
+        }
+        consume(TokenType::RIGHT_BRACE, "Expected '}' after map entries.");
+        return at(line, std::make_shared<MapLiteral>(entries));
+    }
     if (match({TokenType::IDENTIFIER})) {
         std::string name = previous().lexeme;
         if (match({TokenType::LEFT_PAREN})) {
@@ -230,9 +538,9 @@ std::shared_ptr<Expr> Parser::parsePrimary() {
                 } while (match({TokenType::COMMA}));
             }
             consume(TokenType::RIGHT_PAREN, "Expected ')' after arguments.");
-            return std::make_shared<Call>(name, args);
+            return at(line, std::make_shared<Call>(name, args));
         }
-        return std::make_shared<Variable>(name);
+        return at(line, std::make_shared<Variable>(name));
     }
     throw std::runtime_error("Expected expression.");
 }
@@ -247,6 +555,7 @@ std::vector<std::shared_ptr<Stmt>> Parser::parseBlock() {
 }
 
 std::vector<std::shared_ptr<Stmt>> Parser::parse() {
+    TraceSpan span("Parser::parse", "phase");
     std::vector<std::shared_ptr<Stmt>> statements;
     while (!isAtEnd()) {
         statements.push_back(parseStatement());
@@ -254,6 +563,70 @@ std::vector<std::shared_ptr<Stmt>> Parser::parse() {
     return statements;
 }
 
+// Cuts the remaining tokens in front of every top-level `function` that
+// starts a new statement (i.e. follows ';' or '}' at brace depth zero).
+// A `function` after `)` or `else` is the body of an if/while and stays put.
+std::vector<std::pair<size_t, size_t>> Parser::splitTopLevel() {
+    std::vector<std::pair<size_t, size_t>> chunks;
+    size_t chunkStart = current;
+    int depth = 0;
+    for (size_t i = current; i < tokens.size() && tokens[i].type != TokenType::END_OF_FILE; ++i) {
+        TokenType type = tokens[i].type;
+        if (type == TokenType::LEFT_BRACE) {
+            depth++;
+        } else if (type == TokenType::RIGHT_BRACE) {
+            depth--;
+        } else if (type == TokenType::FUN && depth == 0 && i > chunkStart) {
+            TokenType before = tokens[i - 1].type;
+            if (before == TokenType::SEMICOLON || before == TokenType::RIGHT_BRACE) {
+                chunks.emplace_back(chunkStart, i);
+                chunkStart = i;
+            }
+        }
+    }
+    size_t last = tokens.size() - 1;
+    if (chunkStart < last) chunks.emplace_back(chunkStart, last);
+    return chunks;
+}
+
+std::vector<std::shared_ptr<Stmt>> Parser::parseParallel(size_t threads) {
+    auto chunks = splitTopLevel();
+    if (threads <= 1 || chunks.size() <= 1) return parse();
+    TraceSpan span("Parser::parseParallel", "phase");
+
+    std::vector<std::vector<std::shared_ptr<Stmt>>> results(chunks.size());
+    std::vector<char> failed(chunks.size(), 0);
+    {
+        ThreadPool pool(std::min(threads, chunks.size()));
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            pool.submit([this, &chunks, &results, &failed, i] {
+                Parser chunk(tokens);
+                chunk.sharedTokens = sharedTokens;
+                chunk.mode = mode;
+                chunk.current = chunks[i].first;
+                chunk.end = chunks[i].second;
+                try {
+                    results[i] = chunk.parse();
+                } catch (const std::exception&) {
+                    failed[i] = 1;
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    for (char chunkFailed : failed) {
+        if (chunkFailed) return parse();
+    }
+
+    std::vector<std::shared_ptr<Stmt>> statements;
+    for (auto& result : results) {
+        statements.insert(statements.end(), result.begin(), result.end());
+    }
+    current = chunks.back().second;
+    return statements;
+}
+
 std::shared_ptr<Stmt> Parser::parseFunction() {
     Token nameToken = consume(TokenType::IDENTIFIER, "Expected function name.");
     consume(TokenType::LEFT_PAREN, "Expected '(' after function name.");
@@ -267,11 +640,75 @@ std::shared_ptr<Stmt> Parser::parseFunction() {
 
     consume(TokenType::RIGHT_PAREN, "Expected ')' after parameters.");
     consume(TokenType::LEFT_BRACE, "Expected '{' before function body.");
+
+    if (mode == ParseMode::LazyFunctions) {
+        size_t bodyStart = current;
+        skipBlock();
+        auto function = std::make_shared<FunctionStmt>(nameToken.lexeme, params, std::vector<std::shared_ptr<Stmt>>{});
+        function->deferredTokens = sharedTokens;
+        function->deferredStart = bodyStart;
+        return function;
+    }
+
+    Loop outer = std::exchange(loop, Loop::None);
     auto body = parseBlock();
+    loop = outer;
 
     return std::make_shared<FunctionStmt>(nameToken.lexeme, params, body);
 }
 
+// Pre-parse of a lazy function body: only the braces are matched, so an
+// unterminated body is still reported here but other syntax errors surface
+// on the first call (use ParseMode::Eager to report them up front).
+void Parser::skipBlock() {
+    int depth = 1;
+    while (!isAtEnd()) {
+        TokenType type = advance().type;
+        if (type == TokenType::LEFT_BRACE) {
+            depth++;
+        } else if (type == TokenType::RIGHT_BRACE && --depth == 0) {
+            return;
+        }
+    }
+    throw std::runtime_error("Expect '}' after block.");
+}
+
+void Parser::parseDeferredBody(const FunctionStmt& function) {
+    Parser parser(function.deferredTokens, ParseMode::LazyFunctions);
+    parser.current = function.deferredStart;
+    function.body = parser.parseBlock();
+    function.deferredTokens.reset();
+}
+
+const std::vector<std::shared_ptr<Stmt>>& FunctionStmt::parsedBody() const {
+    // a syntax error leaves the flag unset, so every call reports it again
+    std::call_once(bodyParsed, [this] {
+        if (deferredTokens) {
+            Parser::parseDeferredBody(*this);
+        } else if (deferredLoad) {
+            body = deferredLoad();
+            deferredLoad = nullptr;
+        }
+    });
+    return body;
+}
+
+std::shared_ptr<Stmt> Parser::parseLoopBody(bool parfor) {
+    Loop outer = std::exchange(loop, parfor ? Loop::Parfor : Loop::Sequential);
+    auto body = parseStatement();
+    loop = outer;
+    return body;
+}
+
+std::shared_ptr<Stmt> Parser::parseJump() {
+    Token keyword = previous();
+    if (loop == Loop::None) throw std::runtime_error("'" + keyword.lexeme + "' outside a loop.");
+    consume(TokenType::SEMICOLON, "Expected ';' after '" + keyword.lexeme + "'.");
+    if (keyword.type == TokenType::CONTINUE) return std::make_shared<ContinueStmt>();
+    if (loop == Loop::Parfor) throw std::runtime_error("Cannot break out of parfor.");
+    return std::make_shared<BreakStmt>();
+}
+
 std::shared_ptr<Stmt> Parser::parseReturn() {
     auto value = parseExpression();
     consume(TokenType::SEMICOLON, "Expected ';' after return value.");
@@ -304,7 +741,7 @@ Token Parser::consume(TokenType type, const std::string& message) {
 }
 
 bool Parser::isAtEnd() {
-    return peek().type == TokenType::END_OF_FILE;
+    return current >= end || peek().type == TokenType::END_OF_FILE;
 }
 
 Token Parser::peek() {
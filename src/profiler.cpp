@@ -0,0 +1,182 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <signal.h>
+#include <sys/time.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+
+namespace {
+
+// Distinct stacks and the frames they hold, both fixed for the whole run;
+// at a few hundred distinct stacks in a typical script neither fills up.
+constexpr size_t kTableSize = 4096;  // power of two
+constexpr size_t kFramePool = 1 << 18;
+
+std::atomic<Profiler*> active{nullptr};
+// Only the thread that started the profiler is sampled; with the setitimer
+// fallback SIGPROF can land on any thread.
+thread_local bool sampledThread = false;
+
+uint64_t mix(uint64_t h, uint64_t x) {
+    h ^= x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+} // namespace
+
+#if defined(__unix__) || defined(__APPLE__)
+
+struct Profiler::Platform {
+    struct sigaction previous;
+#ifdef __linux__
+    timer_t timer;
+#endif
+};
+
+#else
+
+struct Profiler::Platform {};
+
+#endif
+
+Profiler::Profiler(const ShadowStack& stack)
+    : stack(stack), table(new Folded[kTableSize]()), frames(new const char*[kFramePool]) {}
+
+Profiler::~Profiler() {
+    stop();
+}
+
+void Profiler::onSignal(int) {
+    Profiler* profiler = active.load(std::memory_order_relaxed);
+    if (profiler && sampledThread) profiler->record();
+}
+
+void Profiler::record() {
+    int depth = stack.depth.load(std::memory_order_relaxed);
+    std::atomic_signal_fence(std::memory_order_acquire);
+    depth = std::min(depth, ShadowStack::kMaxDepth);
+    if (depth <= 0) return;
+    int line = stack.lines[depth - 1].load(std::memory_order_relaxed);
+
+    uint64_t hash = mix(0, static_cast<uint64_t>(line));
+    for (int i = 0; i < depth; ++i) hash = mix(hash, reinterpret_cast<uintptr_t>(stack.functions[i]));
+
+    taken.fetch_add(1, std::memory_order_relaxed);
+    for (size_t probe = 0, slot = hash & (kTableSize - 1); probe < kTableSize;
+         ++probe, slot = (slot + 1) & (kTableSize - 1)) {
+        Folded& entry = table[slot];
+        if (entry.count == 0) {
+            if (framesUsed + depth > kFramePool) break;
+            std::memcpy(&frames[framesUsed], stack.functions, depth * sizeof(const char*));
+            entry = {hash, 1, static_cast<uint32_t>(framesUsed), depth, line};
+            framesUsed += depth;
+            return;
+        }
+        if (entry.hash == hash && entry.depth == depth && entry.line == line &&
+            std::memcmp(&frames[entry.offset], stack.functions, depth * sizeof(const char*)) == 0) {
+            entry.count++;
+            return;
+        }
+    }
+    lost.fetch_add(1, std::memory_order_relaxed);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+void Profiler::start() {
+    if (running) return;
+    Profiler* expected = nullptr;
+    if (!active.compare_exchange_strong(expected, this)) {
+        throw std::runtime_error("Another profiler is already running.");
+    }
+    platform = std::make_unique<Platform>();
+    sampledThread = true;
+
+    struct sigaction action {};
+    action.sa_handler = onSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &platform->previous);
+
+    long interval = 1000000 / kSampleHz;  // microseconds
+#ifdef __linux__
+    // CPU time of this thread only, so task threads don't speed up sampling
+    struct sigevent event {};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &platform->timer) != 0) {
+        sigaction(SIGPROF, &platform->previous, nullptr);
+        active.store(nullptr);
+        throw std::runtime_error("Could not create the profiling timer.");
+    }
+    struct itimerspec spec {};
+    spec.it_interval.tv_nsec = interval * 1000;
+    spec.it_value = spec.it_interval;
+    timer_settime(platform->timer, 0, &spec, nullptr);
+#else
+    struct itimerval spec {};
+    spec.it_interval.tv_usec = interval;
+    spec.it_value = spec.it_interval;
+    setitimer(ITIMER_PROF, &spec, nullptr);
+#endif
+    running = true;
+}
+
+void Profiler::stop() {
+    if (!running) return;
+#ifdef __linux__
+    timer_delete(platform->timer);
+#else
+    struct itimerval off {};
+    setitimer(ITIMER_PROF, &off, nullptr);
+#endif
+    // a signal already in flight finds no active profiler and does nothing
+    active.store(nullptr);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    sigaction(SIGPROF, &platform->previous, nullptr);
+    sampledThread = false;
+    running = false;
+}
+
+#else
+
+void Profiler::start() {
+    throw std::runtime_error("Profiling is not supported on this platform.");
+}
+
+void Profiler::stop() {}
+
+#endif
+
+void Profiler::writeFolded(std::ostream& out) const {
+    // Different functions can share a name, so stacks are merged by text.
+    std::map<std::string, uint64_t> folded;
+    for (size_t slot = 0; slot < kTableSize; ++slot) {
+        const Folded& entry = table[slot];
+        if (entry.count == 0) continue;
+        std::string line;
+        for (int i = 0; i < entry.depth; ++i) {
+            if (i > 0) line += ';';
+            line += frames[entry.offset + i];
+        }
+        line += ':' + std::to_string(entry.line);
+        folded[line] += entry.count;
+    }
+    for (const auto& [stackLine, count] : folded) out << stackLine << ' ' << count << '\n';
+}
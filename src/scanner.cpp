@@ -1,8 +1,13 @@
 #include "scanner.hpp"
+#include "trace.hpp"
+#include "value.hpp"
 #include <cctype>
+#include <charconv>
+#include <cstdint>
 #include <stdexcept>
 
 std::vector<Token> Scanner::scanTokens() {
+    TraceSpan span("Scanner::scanTokens", "phase");
     tokens.clear();
     while (!isAtEnd()) {
         start = current;
@@ -21,7 +26,7 @@ char Scanner::advance() {
 }
 
 void Scanner::addToken(TokenType type, std::any literal) {
-    std::string text = source.substr(start, current - start);
+    std::string text(source.substr(start, current - start));
     tokens.emplace_back(type, text, literal, line);
 }
 
@@ -30,6 +35,11 @@ char Scanner::peek() {
     return source[current];
 }
 
+char Scanner::peekNext() {
+    if (current + 1 >= source.length()) return '\0';
+    return source[current + 1];
+}
+
 bool Scanner::match(char expected) {
     if (isAtEnd()) return false;
     if (source[current] != expected) return false;
@@ -88,6 +98,9 @@ void Scanner::scanToken() {
         case ')': addToken(TokenType::RIGHT_PAREN); break;
         case '{': addToken(TokenType::LEFT_BRACE); break;
         case '}': addToken(TokenType::RIGHT_BRACE); break;
+        case '[': addToken(TokenType::LEFT_BRACKET); break;
+        case ']': addToken(TokenType::RIGHT_BRACKET); break;
+        case ':': addToken(TokenType::COLON); break;
         default:
             if (isDigit(c)) {
                 number();
@@ -108,26 +121,35 @@ void Scanner::string() {
 
     advance(); 
 
-    std::string value = source.substr(start + 1, current - start - 2);
+    std::string value(source.substr(start + 1, current - start - 2));
     addToken(TokenType::STRING, value);
 }
 
 void Scanner::number() {
     while (isDigit(peek())) advance();
 
-    if (peek() == '.' && isDigit(source[current + 1])) {
+    std::string_view digits = source.substr(start, current - start);
+    if (peek() != '.' || !isDigit(peekNext())) {
+        // an integer literal, unless it's too large for one
+        int64_t value;
+        auto result = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+        if (result.ec == std::errc() && isExactInteger(value)) {
+            addToken(TokenType::NUMBER, value);
+            return;
+        }
+    } else {
         advance();
         while (isDigit(peek())) advance();
     }
 
-    double value = std::stod(source.substr(start, current - start));
+    double value = std::stod(std::string(source.substr(start, current - start)));
     addToken(TokenType::NUMBER, value);
 }
 
 void Scanner::identifier() {
     while (isAlphaNumeric(peek())) advance();
 
-    std::string text = source.substr(start, current - start);
+    std::string text(source.substr(start, current - start));
 
     if (text == "let") {
         addToken(TokenType::LET);
@@ -155,6 +177,11 @@ void Scanner::identifier() {
     else if (text == "for") {
         addToken(TokenType::FOR);
     }
+    else if (text == "spawn") addToken(TokenType::SPAWN);
+    else if (text == "await") addToken(TokenType::AWAIT);
+    else if (text == "parfor") addToken(TokenType::PARFOR);
+    else if (text == "break") addToken(TokenType::BREAK);
+    else if (text == "continue") addToken(TokenType::CONTINUE);
 
     else {
         addToken(TokenType::IDENTIFIER, text);
@@ -0,0 +1,838 @@
+#include "serializer.hpp"
+#include "parser.hpp"
+#include "array.hpp"
+#include "builtins.hpp"
+#include "map.hpp"
+#include "task.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+const char kMagic[4] = {'C', 'L', 'G', 'C'};
+const char kSnapshotMagic[4] = {'C', 'L', 'G', 'S'};
+
+enum class Tag : uint8_t {
+    Null,
+    // statements
+    ExpressionStmt, PrintStmt, VarStmt, BlockStmt, IfStmt, WhileStmt, FunctionStmt, ReturnStmt, ParforStmt,
+    BreakStmt, ContinueStmt,
+    // expressions
+    NumberLiteral, StringLiteral, Variable, Assign, Binary, Unary, Call, Postfix,
+    Spawn, Await, ArrayLiteral, Index, IndexAssign, MapLiteral, Logical, IntegerLiteral,
+};
+
+// Memory for the nodes one Reader builds, carved out of a few large blocks
+// instead of allocated node by node. It counts the nodes (with their
+// reference counts) still in it, plus one for the Reader, and frees the
+// blocks with the last of them. Only the reading thread allocates; nodes may
+// be released on any thread.
+class NodeArena {
+public:
+    static NodeArena* create() { return new NodeArena(); }
+
+    void* allocate(size_t bytes, size_t alignment) {
+        size_t padding = (alignment - reinterpret_cast<uintptr_t>(next) % alignment) % alignment;
+        if (left < padding + bytes) {
+            size_t blockSize = std::max(kBlockSize, bytes + alignment);
+            blocks.push_back(std::make_unique<char[]>(blockSize));
+            next = blocks.back().get();
+            left = blockSize;
+            padding = (alignment - reinterpret_cast<uintptr_t>(next) % alignment) % alignment;
+        }
+        void* at = next + padding;
+        next += padding + bytes;
+        left -= padding + bytes;
+        users.fetch_add(1, std::memory_order_relaxed);
+        return at;
+    }
+
+    void release() {
+        if (users.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+    }
+
+private:
+    NodeArena() = default;
+
+    static constexpr size_t kBlockSize = 64 * 1024;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* next = nullptr;
+    size_t left = 0;
+    std::atomic<size_t> users{1};
+};
+
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    explicit ArenaAllocator(NodeArena* arena) : arena(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) { arena->release(); }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+    NodeArena* arena;
+};
+
+// Snapshot values, and the kinds of object in a snapshot's object table.
+enum class ValueTag : uint8_t { Number, String, Function, Object, Builtin, Integer };
+enum class ObjectKind : uint8_t { NumberArray, Array, Map };
+
+class Writer {
+public:
+    std::string body;
+
+    template <typename T>
+    void raw(T value) {
+        body.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void tag(Tag t) { raw(static_cast<uint8_t>(t)); }
+    // Every node but Null is its tag followed by its source line.
+    void tag(Tag t, int line) {
+        tag(t);
+        raw(static_cast<int32_t>(line));
+    }
+
+    void string(const std::string& s) {
+        auto [it, added] = stringIds.emplace(s, static_cast<uint32_t>(strings.size()));
+        // the table's own copy, as `s` may be a temporary
+        if (added) strings.push_back(&it->first);
+        raw(it->second);
+    }
+
+    void token(const Token& t) {
+        raw(static_cast<uint32_t>(t.type));
+        string(t.lexeme);
+        raw(static_cast<int32_t>(t.line));
+    }
+
+    void expr(const std::shared_ptr<Expr>& e);
+    void stmt(const std::shared_ptr<Stmt>& s);
+
+    void stmts(const std::vector<std::shared_ptr<Stmt>>& list) {
+        raw(static_cast<uint32_t>(list.size()));
+        for (const auto& s : list) stmt(s);
+    }
+
+    std::string finish(uint64_t sourceHash, const char (&magic)[4] = kMagic) {
+        std::string out(magic, sizeof(magic));
+        auto put = [&out](auto value) {
+            out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+        put(kProgramCacheVersion);
+        put(sourceHash);
+        put(static_cast<uint32_t>(strings.size()));
+        for (const std::string* s : strings) {
+            put(static_cast<uint32_t>(s->size()));
+            out.append(*s);
+        }
+        out.append(body);
+        return out;
+    }
+
+private:
+    std::unordered_map<std::string, uint32_t> stringIds;
+    std::vector<const std::string*> strings;
+};
+
+void Writer::expr(const std::shared_ptr<Expr>& e) {
+    if (!e) {
+        tag(Tag::Null);
+    } else if (auto lit = std::dynamic_pointer_cast<Literal>(e)) {
+        if (auto integer = std::get_if<int64_t>(&lit->value)) {
+            tag(Tag::IntegerLiteral, e->line);
+            raw(*integer);
+        } else if (std::holds_alternative<double>(lit->value)) {
+            tag(Tag::NumberLiteral, e->line);
+            raw(std::get<double>(lit->value));
+        } else if (std::holds_alternative<std::string>(lit->value)) {
+            tag(Tag::StringLiteral, e->line);
+            string(std::get<std::string>(lit->value));
+        } else {
+            throw std::runtime_error("Cannot serialize literal value.");
+        }
+    } else if (auto var = std::dynamic_pointer_cast<Variable>(e)) {
+        tag(Tag::Variable, e->line);
+        string(var->name);
+    } else if (auto assign = std::dynamic_pointer_cast<Assign>(e)) {
+        tag(Tag::Assign, e->line);
+        string(assign->name);
+        expr(assign->valueExpr);
+    } else if (auto binary = std::dynamic_pointer_cast<Binary>(e)) {
+        tag(Tag::Binary, e->line);
+        string(binary->op);
+        expr(binary->left);
+        expr(binary->right);
+    } else if (auto logical = std::dynamic_pointer_cast<Logical>(e)) {
+        tag(Tag::Logical, e->line);
+        string(logical->op);
+        expr(logical->left);
+        expr(logical->right);
+    } else if (auto unary = std::dynamic_pointer_cast<Unary>(e)) {
+        tag(Tag::Unary, e->line);
+        token(unary->op);
+        expr(unary->right);
+    } else if (auto call = std::dynamic_pointer_cast<Call>(e)) {
+        tag(Tag::Call, e->line);
+        string(call->callee);
+        raw(static_cast<uint32_t>(call->arguments.size()));
+        for (const auto& arg : call->arguments) expr(arg);
+    } else if (auto postfix = std::dynamic_pointer_cast<Postfix>(e)) {
+        tag(Tag::Postfix, e->line);
+        token(postfix->op);
+        expr(postfix->operand);
+    } else if (auto spawn = std::dynamic_pointer_cast<Spawn>(e)) {
+        tag(Tag::Spawn, e->line);
+        expr(spawn->call);
+    } else if (auto await = std::dynamic_pointer_cast<Await>(e)) {
+        tag(Tag::Await, e->line);
+        expr(await->task);
+    } else if (auto literal = std::dynamic_pointer_cast<ArrayLiteral>(e)) {
+        tag(Tag::ArrayLiteral, e->line);
+        raw(static_cast<uint32_t>(literal->elements.size()));
+        for (const auto& element : literal->elements) expr(element);
+    } else if (auto map = std::dynamic_pointer_cast<MapLiteral>(e)) {
+        tag(Tag::MapLiteral, e->line);
+        raw(static_cast<uint32_t>(map->entries.size()));
+        for (const auto& [key, value] : map->entries) {
+            expr(key);
+            expr(value);
+        }
+    } else if (auto index = std::dynamic_pointer_cast<Index>(e)) {
+        tag(Tag::Index, e->line);
+        expr(index->array);
+        expr(index->index);
+    } else if (auto store = std::dynamic_pointer_cast<IndexAssign>(e)) {
+        tag(Tag::IndexAssign, e->line);
+        expr(store->array);
+        expr(store->index);
+        expr(store->valueExpr);
+    } else {
+        throw std::runtime_error("Cannot serialize expression node.");
+    }
+}
+
+void Writer::stmt(const std::shared_ptr<Stmt>& s) {
+    if (!s) {
+        tag(Tag::Null);
+    } else if (auto exprStmt = std::dynamic_pointer_cast<ExpressionStmt>(s)) {
+        tag(Tag::ExpressionStmt, s->line);
+        expr(exprStmt->expression);
+    } else if (auto print = std::dynamic_pointer_cast<PrintStmt>(s)) {
+        tag(Tag::PrintStmt, s->line);
+        expr(print->expression);
+    } else if (auto var = std::dynamic_pointer_cast<VarStmt>(s)) {
+        tag(Tag::VarStmt, s->line);
+        string(var->name);
+        expr(var->initializer);
+    } else if (auto block = std::dynamic_pointer_cast<BlockStmt>(s)) {
+        tag(Tag::BlockStmt, s->line);
+        stmts(block->statements);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<IfStmt>(s)) {
+        tag(Tag::IfStmt, s->line);
+        expr(ifStmt->condition);
+        stmt(ifStmt->thenBranch);
+        stmt(ifStmt->elseBranch);
+    } else if (auto whileStmt = std::dynamic_pointer_cast<WhileStmt>(s)) {
+        tag(Tag::WhileStmt, s->line);
+        expr(whileStmt->condition);
+        stmt(whileStmt->body);
+        expr(whileStmt->increment);
+    } else if (auto function = std::dynamic_pointer_cast<FunctionStmt>(s)) {
+        tag(Tag::FunctionStmt, s->line);
+        string(function->name);
+        raw(static_cast<uint32_t>(function->params.size()));
+        for (const auto& param : function->params) string(param);
+        stmts(function->parsedBody());
+    } else if (auto ret = std::dynamic_pointer_cast<ReturnStmt>(s)) {
+        tag(Tag::ReturnStmt, s->line);
+        expr(ret->value);
+    } else if (std::dynamic_pointer_cast<BreakStmt>(s)) {
+        tag(Tag::BreakStmt, s->line);
+    } else if (std::dynamic_pointer_cast<ContinueStmt>(s)) {
+        tag(Tag::ContinueStmt, s->line);
+    } else if (auto parfor = std::dynamic_pointer_cast<ParforStmt>(s)) {
+        tag(Tag::ParforStmt, s->line);
+        string(parfor->var);
+        expr(parfor->start);
+        string(parfor->comparison);
+        expr(parfor->bound);
+        expr(parfor->step);
+        raw(static_cast<uint32_t>(parfor->reductions.size()));
+        for (const auto& reduction : parfor->reductions) {
+            string(reduction.op);
+            string(reduction.name);
+        }
+        stmt(parfor->body);
+    } else {
+        throw std::runtime_error("Cannot serialize statement node.");
+    }
+}
+
+// Reads straight out of the (usually memory-mapped) cache; every read is
+// bounds-checked so a truncated or corrupt file is rejected, not trusted.
+class Reader {
+public:
+    Reader(const char* data, size_t size) : data(data), size(size) {}
+    // Reads a part of an image whose string table another reader read.
+    Reader(const char* data, size_t size, std::shared_ptr<const std::vector<std::string>> table)
+        : data(data), size(size), strings(std::move(table)) {}
+    ~Reader() { arena->release(); }
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    template <typename T>
+    T raw() {
+        if (size - pos < sizeof(T)) throw std::out_of_range("truncated program cache");
+        T value;
+        std::memcpy(&value, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    Tag tag() { return static_cast<Tag>(raw<uint8_t>()); }
+
+    void readStrings() {
+        uint32_t count = raw<uint32_t>();
+        if (count > size - pos) throw std::out_of_range("corrupt string table");
+        auto table = std::make_shared<std::vector<std::string>>();
+        table->reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t length = raw<uint32_t>();
+            if (size - pos < length) throw std::out_of_range("truncated program cache");
+            table->emplace_back(data + pos, length);
+            pos += length;
+        }
+        strings = std::move(table);
+    }
+
+    const std::string& string() {
+        uint32_t id = raw<uint32_t>();
+        if (id >= strings->size()) throw std::out_of_range("bad string id");
+        return (*strings)[id];
+    }
+
+    Token token() {
+        auto type = static_cast<TokenType>(raw<uint32_t>());
+        const std::string& lexeme = string();
+        int line = raw<int32_t>();
+        return Token(type, lexeme, std::any(), line);
+    }
+
+    uint32_t count() {
+        uint32_t n = raw<uint32_t>();
+        // every element takes at least one byte, which bounds bogus counts
+        if (n > size - pos) throw std::out_of_range("corrupt element count");
+        return n;
+    }
+
+    std::shared_ptr<Expr> expr() {
+        Tag t = tag();
+        if (t == Tag::Null) return nullptr;
+        int line = raw<int32_t>();
+        auto node = exprNode(t);
+        node->line = line;
+        return node;
+    }
+    std::shared_ptr<Stmt> stmt() {
+        Tag t = tag();
+        if (t == Tag::Null) return nullptr;
+        int line = raw<int32_t>();
+        auto node = stmtNode(t);
+        node->line = line;
+        return node;
+    }
+
+    std::vector<std::shared_ptr<Stmt>> stmts() {
+        uint32_t n = count();
+        std::vector<std::shared_ptr<Stmt>> list;
+        list.reserve(n);
+        for (uint32_t i = 0; i < n; ++i) list.push_back(stmt());
+        return list;
+    }
+
+    // `n` numbers stored back to back, copied out in one go.
+    std::vector<double> numbers(uint32_t n) {
+        if ((size - pos) / sizeof(double) < n) throw std::out_of_range("truncated number array");
+        std::vector<double> values(n);
+        if (n != 0) std::memcpy(values.data(), data + pos, n * sizeof(double));
+        pos += n * sizeof(double);
+        return values;
+    }
+
+    // Skips `n` bytes and returns where they start.
+    const char* skip(size_t n) {
+        if (size - pos < n) throw std::out_of_range("truncated program cache");
+        pos += n;
+        return data + pos - n;
+    }
+    const std::shared_ptr<const std::vector<std::string>>& stringTable() const { return strings; }
+
+    bool atEnd() const { return pos == size; }
+
+private:
+    std::shared_ptr<Expr> exprNode(Tag t);
+    std::shared_ptr<Stmt> stmtNode(Tag t);
+
+    // Node and reference count in one piece of the arena.
+    template <typename Node, typename... Args>
+    std::shared_ptr<Node> make(Args&&... args) {
+        return std::allocate_shared<Node>(ArenaAllocator<Node>(arena), std::forward<Args>(args)...);
+    }
+
+    const char* data;
+    size_t size;
+    size_t pos = 0;
+    std::shared_ptr<const std::vector<std::string>> strings = std::make_shared<std::vector<std::string>>();
+    NodeArena* arena = NodeArena::create();
+};
+
+std::shared_ptr<Expr> Reader::exprNode(Tag t) {
+    switch (t) {
+        case Tag::NumberLiteral: return make<Literal>(raw<double>());
+        case Tag::IntegerLiteral: return make<Literal>(raw<int64_t>());
+        case Tag::StringLiteral: return make<Literal>(string());
+        case Tag::Variable: return make<Variable>(string());
+        case Tag::Assign: {
+            const std::string& name = string();
+            return make<Assign>(name, expr());
+        }
+        case Tag::Binary: {
+            const std::string& op = string();
+            auto left = expr();
+            return make<Binary>(left, op, expr());
+        }
+        case Tag::Logical: {
+            const std::string& op = string();
+            auto left = expr();
+            return make<Logical>(left, op, expr());
+        }
+        case Tag::Unary: {
+            Token op = token();
+            return make<Unary>(op, expr());
+        }
+        case Tag::Call: {
+            const std::string& callee = string();
+            uint32_t n = count();
+            std::vector<std::shared_ptr<Expr>> args;
+            args.reserve(n);
+            for (uint32_t i = 0; i < n; ++i) args.push_back(expr());
+            return make<Call>(callee, std::move(args));
+        }
+        case Tag::Postfix: {
+            Token op = token();
+            return make<Postfix>(expr(), op);
+        }
+        case Tag::Spawn: {
+            auto call = std::dynamic_pointer_cast<Call>(expr());
+            if (!call) throw std::out_of_range("spawn of a non-call");
+            return make<Spawn>(call);
+        }
+        case Tag::Await: return make<Await>(expr());
+        case Tag::ArrayLiteral: {
+            uint32_t n = count();
+            std::vector<std::shared_ptr<Expr>> elements;
+            elements.reserve(n);
+            for (uint32_t i = 0; i < n; ++i) elements.push_back(expr());
+            return make<ArrayLiteral>(std::move(elements));
+        }
+        case Tag::MapLiteral: {
+            uint32_t n = count();
+            std::vector<std::pair<std::shared_ptr<Expr>, std::shared_ptr<Expr>>> entries;
+            entries.reserve(n);
+            for (uint32_t i = 0; i < n; ++i) {
+                auto key = expr();
+                entries.emplace_back(key, expr());
+            }
+            return make<MapLiteral>(std::move(entries));
+        }
+        case Tag::Index: {
+            auto array = expr();
+            return make<Index>(array, expr());
+        }
+        case Tag::IndexAssign: {
+            auto array = expr();
+            auto index = expr();
+            return make<IndexAssign>(array, index, expr());
+        }
+        default:
+            throw std::out_of_range("unknown expression tag");
+    }
+}
+
+std::shared_ptr<Stmt> Reader::stmtNode(Tag t) {
+    switch (t) {
+        case Tag::ExpressionStmt: return make<ExpressionStmt>(expr());
+        case Tag::PrintStmt: return make<PrintStmt>(expr());
+        case Tag::VarStmt: {
+            const std::string& name = string();
+            return make<VarStmt>(name, expr());
+        }
+        case Tag::BlockStmt: return make<BlockStmt>(stmts());
+        case Tag::IfStmt: {
+            auto condition = expr();
+            auto thenBranch = stmt();
+            return make<IfStmt>(condition, thenBranch, stmt());
+        }
+        case Tag::WhileStmt: {
+            auto condition = expr();
+            auto body = stmt();
+            return make<WhileStmt>(condition, body, expr());
+        }
+        case Tag::FunctionStmt: {
+            const std::string& name = string();
+            uint32_t n = count();
+            std::vector<std::string> params;
+            params.reserve(n);
+            for (uint32_t i = 0; i < n; ++i) params.push_back(string());
+            return make<FunctionStmt>(name, std::move(params), stmts());
+        }
+        case Tag::ReturnStmt: return make<ReturnStmt>(expr());
+        case Tag::BreakStmt: return make<BreakStmt>();
+        case Tag::ContinueStmt: return make<ContinueStmt>();
+        case Tag::ParforStmt: {
+            std::string var = string();
+            auto start = expr();
+            std::string comparison = string();
+            auto bound = expr();
+            auto step = expr();
+            uint32_t n = count();
+            std::vector<ParforStmt::Reduction> reductions;
+            for (uint32_t i = 0; i < n; ++i) {
+                std::string op = string();
+                reductions.push_back({op, string()});
+            }
+            auto body = stmt();
+            return make<ParforStmt>(var, start, comparison, bound, step, std::move(reductions), body);
+        }
+        default:
+            throw std::out_of_range("unknown statement tag");
+    }
+}
+
+// Writes a snapshot's body: first every function and array/map reachable
+// from the globals gets an index, then they are written in index order, so
+// values can refer to any of them, including objects that refer back.
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(Writer& out) : out(out) {}
+
+    void write(const Environment& globals) {
+        std::vector<const std::pair<const std::string, Value>*> sorted;
+        for (const auto& global : globals) {
+            sorted.push_back(&global);
+            collect(global.second, global.first);
+        }
+        // sorted so that the same state always gives the same image
+        std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+
+        out.raw(static_cast<uint32_t>(functions.size()));
+        for (const auto& function : functions) {
+            out.tag(Tag::FunctionStmt, function->line);
+            out.string(function->name);
+            out.raw(static_cast<uint32_t>(function->params.size()));
+            for (const auto& param : function->params) out.string(param);
+            // the body's length first, so loading can skip it
+            size_t start = out.body.size();
+            out.raw(uint32_t(0));
+            out.stmts(function->parsedBody());
+            uint32_t length = static_cast<uint32_t>(out.body.size() - start - sizeof(uint32_t));
+            std::memcpy(&out.body[start], &length, sizeof(length));
+        }
+        // the kinds, and the numbers of numeric arrays, come first so that
+        // every object exists before anything refers to it
+        out.raw(static_cast<uint32_t>(objects.size()));
+        std::vector<bool> filled(objects.size());
+        for (size_t i = 0; i < objects.size(); ++i) {
+            if (auto array = std::get_if<std::shared_ptr<Array>>(&objects[i])) {
+                filled[i] = (*array)->readNumbers([this](const double* data, size_t n) {
+                    out.raw(ObjectKind::NumberArray);
+                    out.raw(static_cast<uint32_t>(n));
+                    out.body.append(reinterpret_cast<const char*>(data), n * sizeof(double));
+                });
+                if (!filled[i]) out.raw(ObjectKind::Array);
+            } else {
+                out.raw(ObjectKind::Map);
+            }
+        }
+        for (size_t i = 0; i < objects.size(); ++i) {
+            if (filled[i]) continue;
+            if (auto array = std::get_if<std::shared_ptr<Array>>(&objects[i])) {
+                auto elements = (*array)->elements();
+                out.raw(static_cast<uint32_t>(elements.size()));
+                for (const Value& element : elements) value(element);
+            } else {
+                auto entries = std::get<std::shared_ptr<Map>>(objects[i])->entries();
+                out.raw(static_cast<uint32_t>(entries.size()));
+                for (const auto& [key, entry] : entries) {
+                    value(key);
+                    value(entry);
+                }
+            }
+        }
+        out.raw(static_cast<uint32_t>(sorted.size()));
+        for (const auto* global : sorted) {
+            out.string(global->first);
+            value(global->second);
+        }
+    }
+
+private:
+    // Gives `root` and everything reachable from it an index. `name` is the
+    // global it hangs off, for errors.
+    void collect(const Value& root, const std::string& name) {
+        std::vector<Value> pending{root};
+        while (!pending.empty()) {
+            Value current = std::move(pending.back());
+            pending.pop_back();
+            if (std::holds_alternative<std::shared_ptr<const Stmt>>(current)) {
+                auto function = toFunction(current, name);
+                if (functionIds.emplace(function.get(), static_cast<uint32_t>(functions.size())).second) {
+                    functions.push_back(std::move(function));
+                }
+            } else if (auto native = std::get_if<std::shared_ptr<const Native>>(&current)) {
+                // built-ins are saved by name; an embedder's own can't be restored
+                if (findBuiltin((*native)->name) != *native)
+                    throw std::runtime_error("Cannot snapshot a native function: " + name);
+            } else if (std::holds_alternative<std::shared_ptr<Task>>(current) ||
+                       std::holds_alternative<std::shared_ptr<Channel>>(current)) {
+                throw std::runtime_error("Cannot snapshot a task or channel: " + name);
+            } else if (auto array = std::get_if<std::shared_ptr<Array>>(&current)) {
+                if (!objectIds.emplace(array->get(), static_cast<uint32_t>(objects.size())).second) continue;
+                objects.push_back(current);
+                for (Value& element : (*array)->elements()) pending.push_back(std::move(element));
+            } else if (auto map = std::get_if<std::shared_ptr<Map>>(&current)) {
+                if (!objectIds.emplace(map->get(), static_cast<uint32_t>(objects.size())).second) continue;
+                objects.push_back(current);
+                for (auto& [key, entry] : (*map)->entries()) pending.push_back(std::move(entry));
+            }
+        }
+    }
+
+    void value(const Value& v) {
+        if (auto integer = std::get_if<int64_t>(&v)) {
+            out.raw(ValueTag::Integer);
+            out.raw(*integer);
+        } else if (auto number = std::get_if<double>(&v)) {
+            out.raw(ValueTag::Number);
+            out.raw(*number);
+        } else if (auto text = std::get_if<std::string>(&v)) {
+            out.raw(ValueTag::String);
+            out.string(*text);
+        } else if (auto stmt = std::get_if<std::shared_ptr<const Stmt>>(&v)) {
+            out.raw(ValueTag::Function);
+            out.raw(functionIds.at(static_cast<const FunctionStmt*>(stmt->get())));
+        } else if (auto native = std::get_if<std::shared_ptr<const Native>>(&v)) {
+            out.raw(ValueTag::Builtin);
+            out.string((*native)->name);
+        } else if (auto array = std::get_if<std::shared_ptr<Array>>(&v)) {
+            out.raw(ValueTag::Object);
+            out.raw(objectIds.at(array->get()));
+        } else {
+            out.raw(ValueTag::Object);
+            out.raw(objectIds.at(std::get<std::shared_ptr<Map>>(v).get()));
+        }
+    }
+
+    Writer& out;
+    std::unordered_map<const FunctionStmt*, uint32_t> functionIds;
+    std::vector<std::shared_ptr<const FunctionStmt>> functions;
+    std::unordered_map<const void*, uint32_t> objectIds;
+    std::vector<Value> objects;
+};
+
+// Reads what SnapshotWriter wrote, building the objects before filling them.
+class SnapshotReader {
+public:
+    SnapshotReader(Reader& in, std::shared_ptr<const void> owner) : in(in), owner(std::move(owner)) {}
+
+    void read(Environment& globals) {
+        uint32_t n = in.count();
+        functions.reserve(n);
+        for (uint32_t i = 0; i < n; ++i) functions.push_back(function());
+        n = in.count();
+        objects.reserve(n);
+        std::vector<bool> filled(n);
+        for (uint32_t i = 0; i < n; ++i) {
+            switch (in.raw<ObjectKind>()) {
+                case ObjectKind::NumberArray:
+                    objects.push_back(std::make_shared<Array>(in.numbers(in.raw<uint32_t>())));
+                    filled[i] = true;
+                    break;
+                case ObjectKind::Array: objects.push_back(std::make_shared<Array>()); break;
+                case ObjectKind::Map: objects.push_back(std::make_shared<Map>()); break;
+                default: throw std::out_of_range("unknown object kind");
+            }
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            if (filled[i]) continue;
+            uint32_t count = in.count();
+            if (auto array = std::get_if<std::shared_ptr<Array>>(&objects[i])) {
+                for (uint32_t j = 0; j < count; ++j) (*array)->push(value());
+            } else {
+                auto& map = std::get<std::shared_ptr<Map>>(objects[i]);
+                for (uint32_t j = 0; j < count; ++j) {
+                    Value key = value();
+                    map->set(key, value());
+                }
+            }
+        }
+        n = in.count();
+        globals.reserve(n);
+        for (uint32_t i = 0; i < n; ++i) {
+            const std::string& name = in.string();
+            setVariable(globals, name, value());
+        }
+    }
+
+    // Charges the arrays and maps read to `interpreter`'s memory cap.
+    void charge(Interpreter* interpreter) {
+        for (auto& object : objects) {
+            if (auto array = std::get_if<std::shared_ptr<Array>>(&object)) {
+                (*array)->charge(interpreter);
+            } else {
+                std::get<std::shared_ptr<Map>>(object)->charge(interpreter);
+            }
+        }
+    }
+
+private:
+    // A function whose body stays in the image until its first call.
+    Value function() {
+        if (in.tag() != Tag::FunctionStmt) throw std::out_of_range("snapshot function is not a function");
+        int line = in.raw<int32_t>();
+        std::string name = in.string();
+        uint32_t n = in.count();
+        std::vector<std::string> params;
+        params.reserve(n);
+        for (uint32_t i = 0; i < n; ++i) params.push_back(in.string());
+        uint32_t length = in.raw<uint32_t>();
+        const char* body = in.skip(length);
+
+        auto function = std::make_shared<FunctionStmt>(std::move(name), std::move(params),
+                                                       std::vector<std::shared_ptr<Stmt>>{});
+        function->line = line;
+        function->deferredLoad = [owner = owner, strings = in.stringTable(), body, length] {
+            try {
+                Reader reader(body, length, strings);
+                auto statements = reader.stmts();
+                if (!reader.atEnd()) throw std::out_of_range("trailing bytes");
+                return statements;
+            } catch (const std::out_of_range& e) {
+                throw std::runtime_error(std::string("Corrupt snapshot: ") + e.what());
+            }
+        };
+        return std::static_pointer_cast<const Stmt>(function);
+    }
+
+    Value value() {
+        switch (in.raw<ValueTag>()) {
+            case ValueTag::Number: return in.raw<double>();
+            case ValueTag::Integer: return in.raw<int64_t>();
+            case ValueTag::String: return in.string();
+            case ValueTag::Function: return at(functions, in.raw<uint32_t>());
+            case ValueTag::Object: return at(objects, in.raw<uint32_t>());
+            case ValueTag::Builtin: {
+                const auto& builtin = findBuiltin(in.string());
+                if (!builtin) throw std::out_of_range("unknown built-in");
+                return builtin;
+            }
+            default: throw std::out_of_range("unknown value tag");
+        }
+    }
+
+    static const Value& at(const std::vector<Value>& table, uint32_t id) {
+        if (id >= table.size()) throw std::out_of_range("bad snapshot reference");
+        return table[id];
+    }
+
+    Reader& in;
+    std::shared_ptr<const void> owner;  // of the image, for deferred bodies
+    std::vector<Value> functions;
+    std::vector<Value> objects;
+};
+
+// Reads and checks the header that Writer::finish() wrote.
+bool readHeader(Reader& reader, const char (&magic)[4], uint64_t sourceHash) {
+    char found[sizeof(magic)];
+    for (char& c : found) c = reader.raw<char>();
+    if (std::memcmp(found, magic, sizeof(magic)) != 0) return false;
+    if (reader.raw<uint32_t>() != kProgramCacheVersion) return false;
+    if (reader.raw<uint64_t>() != sourceHash) return false;
+    reader.readStrings();
+    return true;
+}
+
+} // namespace
+
+uint64_t hashSource(std::string_view source) {
+    // FNV-1a, 64-bit
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : source) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string serializeProgram(const std::vector<std::shared_ptr<Stmt>>& statements, uint64_t sourceHash) {
+    Writer writer;
+    writer.stmts(statements);
+    return writer.finish(sourceHash);
+}
+
+bool deserializeProgram(const char* data, size_t size, uint64_t sourceHash,
+                        std::vector<std::shared_ptr<Stmt>>& statements) {
+    statements.clear();
+    try {
+        Reader reader(data, size);
+        if (!readHeader(reader, kMagic, sourceHash)) return false;
+        statements = reader.stmts();
+        if (!reader.atEnd()) {
+            statements.clear();
+            return false;
+        }
+        return true;
+    } catch (const std::out_of_range&) {
+        statements.clear();
+        return false;
+    }
+}
+
+std::string serializeSnapshot(const Environment& globals) {
+    Writer writer;
+    SnapshotWriter(writer).write(globals);
+    return writer.finish(0, kSnapshotMagic);
+}
+
+bool deserializeSnapshot(const char* data, size_t size, std::shared_ptr<const void> owner, Environment& globals) {
+    Environment restored;  // no interpreter: charged once, when moved into `globals`
+    try {
+        Reader reader(data, size);
+        if (!readHeader(reader, kSnapshotMagic, 0)) return false;
+        SnapshotReader snapshot(reader, std::move(owner));
+        snapshot.read(restored);
+        if (!reader.atEnd()) return false;
+        snapshot.charge(globals.interpreter);
+    } catch (const std::out_of_range&) {
+        return false;
+    } catch (const LimitError&) {
+        throw;  // a valid snapshot that doesn't fit under the memory cap
+    } catch (const std::runtime_error&) {
+        return false;  // e.g. a map key no map would hold
+    }
+    globals.reserve(globals.size() + restored.size());
+    for (auto& [name, value] : restored) setVariable(globals, name, std::move(value));
+    return true;
+}
@@ -0,0 +1,59 @@
+#include "stats.hpp"
+#include <cstdio>
+#include <ostream>
+#include <string>
+
+namespace {
+
+const char* const kNodeKindNames[] = {
+    "Literal", "Variable", "Assign", "Binary", "Logical", "Unary", "Call", "Postfix", "Spawn", "Await",
+    "ArrayLiteral", "Index", "IndexAssign", "MapLiteral",
+    "ExpressionStmt", "PrintStmt", "VarStmt", "BlockStmt", "IfStmt", "WhileStmt", "FunctionStmt", "ReturnStmt",
+    "ParforStmt", "BreakStmt", "ContinueStmt",
+};
+static_assert(sizeof(kNodeKindNames) / sizeof(kNodeKindNames[0]) == static_cast<size_t>(NodeKind::Count),
+              "a name for every node kind");
+
+std::string millis(double ms) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.3f", ms);
+    return text;
+}
+
+} // namespace
+
+const char* nodeKindName(NodeKind kind) {
+    return kNodeKindNames[static_cast<size_t>(kind)];
+}
+
+void Stats::writeText(std::ostream& out) const {
+    out << "scan            " << millis(scanMs) << " ms\n"
+        << "parse           " << millis(parseMs) << " ms" << (cached ? " (from cache)" : "") << "\n"
+        << "execute         " << millis(executeMs) << " ms\n"
+        << "calls           " << calls << " (max depth " << maxDepth << ")\n"
+        << "environments    " << environments << " (" << environmentBytes << " bytes copied)\n"
+        << "strings         " << strings << " (" << stringBytes << " bytes)\n"
+        << "lookups         " << lookups << "\n"
+        << "loop iterations " << loopIterations << "\n"
+        << "nodes evaluated:\n";
+    for (size_t kind = 0; kind < static_cast<size_t>(NodeKind::Count); ++kind) {
+        if (nodes[kind] == 0) continue;
+        out << "  " << nodeKindName(static_cast<NodeKind>(kind)) << " " << nodes[kind] << "\n";
+    }
+}
+
+void Stats::writeJson(std::ostream& out) const {
+    out << "{\"scan_ms\": " << millis(scanMs) << ", \"parse_ms\": " << millis(parseMs)
+        << ", \"execute_ms\": " << millis(executeMs) << ", \"cached\": " << (cached ? "true" : "false")
+        << ", \"calls\": " << calls << ", \"max_depth\": " << maxDepth << ", \"environments\": " << environments
+        << ", \"environment_bytes\": " << environmentBytes << ", \"strings\": " << strings
+        << ", \"string_bytes\": " << stringBytes << ", \"lookups\": " << lookups
+        << ", \"loop_iterations\": " << loopIterations << ", \"nodes\": {";
+    const char* separator = "";
+    for (size_t kind = 0; kind < static_cast<size_t>(NodeKind::Count); ++kind) {
+        if (nodes[kind] == 0) continue;
+        out << separator << "\"" << nodeKindName(static_cast<NodeKind>(kind)) << "\": " << nodes[kind];
+        separator = ", ";
+    }
+    out << "}}";
+}
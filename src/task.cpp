@@ -0,0 +1,182 @@
+#include "task.hpp"
+#include "stmt.hpp"
+#include "vm.hpp"
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+// Set by the worker that is currently resuming a task's fiber.
+thread_local Task* runningTask = nullptr;
+}
+
+TaskScheduler::TaskScheduler(size_t threads) : pool(threads) {}
+
+void TaskScheduler::schedule(std::shared_ptr<Task> task) {
+    runnable++;
+    pool.submit([this, task = std::move(task)] {
+        // woken so quickly that it hasn't finished suspending yet
+        while (task->switchingOut.load(std::memory_order_acquire)) std::this_thread::yield();
+        runningTask = task.get();
+        task->fiber->resume();
+        runningTask = nullptr;
+        // Back here because the task either parked or finished. Once a
+        // parked task's flag is cleared it may be resumed elsewhere, so
+        // nothing of it is touched after that.
+        if (task->fiber->finished()) {
+            task->fiber.reset();
+        } else {
+            task->switchingOut.store(false, std::memory_order_release);
+        }
+        runnable--;
+    });
+}
+
+// Not inlined: a parked task resumes on another thread, so the address of
+// the thread-local must be looked up again on every call.
+#if defined(_MSC_VER)
+__declspec(noinline)
+#else
+__attribute__((noinline))
+#endif
+Task* Task::current() {
+    return runningTask;
+}
+
+void WaitList::block(std::unique_lock<std::mutex>& lock, TaskScheduler* scheduler) {
+    if (Task* task = Task::current()) {
+        task->switchingOut.store(true, std::memory_order_relaxed);
+        tasks.push_back(task->shared_from_this());
+        lock.unlock();
+        task->fiber->suspend();
+        lock.lock();
+        return;
+    }
+    if (!scheduler || scheduler->idle()) {
+        throw std::runtime_error("Deadlock: all tasks are blocked");
+    }
+    threads.wait_for(lock, std::chrono::milliseconds(10));
+}
+
+void WaitList::wakeAll() {
+    for (auto& task : tasks) task->scheduler->schedule(std::move(task));
+    tasks.clear();
+    threads.notify_all();
+}
+
+Task::Task(Interpreter& parent, std::shared_ptr<const FunctionStmt> function, std::vector<Value> args)
+    : function(std::move(function)), args(std::move(args)), scheduler(&parent.taskScheduler()),
+      interpreter(std::make_unique<Interpreter>(buffer)),
+      fiber(std::make_unique<Fiber>([this] { run(); }, kTaskStackSize)) {
+    interpreter->maxSteps = parent.maxSteps;
+    interpreter->stepPool = parent.shareSteps();
+    interpreter->maxMemory = parent.maxMemory;
+    interpreter->stackless = parent.stackless;
+    interpreter->maxDepth = parent.maxDepth;
+    interpreter->output.setLimit(parent.output.limitBytes());
+    interpreter->scheduler = scheduler;
+}
+
+Task::~Task() = default;
+
+std::shared_ptr<Task> Task::spawn(Interpreter& parent, std::shared_ptr<const FunctionStmt> function,
+                                  std::vector<Value> args, const Environment& env) {
+    if (args.size() != function->params.size()) {
+        throw std::runtime_error("Expected " + std::to_string(function->params.size()) +
+                                 " arguments but got " + std::to_string(args.size()) + ".");
+    }
+    std::shared_ptr<Task> task(new Task(parent, std::move(function), std::move(args)));
+    task->interpreter->environment = env;
+    task->interpreter->environment.interpreter = task->interpreter.get();
+
+    // drop tasks that were already awaited each time the list doubles, so a
+    // long spawn/await loop doesn't keep every finished task alive
+    auto& spawned = parent.spawned;
+    if (spawned.size() >= 64 && (spawned.size() & (spawned.size() - 1)) == 0) {
+        std::vector<std::shared_ptr<Task>> pending;
+        for (auto& other : spawned) {
+            std::lock_guard<std::mutex> lock(other->mutex);
+            if (!other->collected) pending.push_back(std::move(other));
+        }
+        spawned.swap(pending);
+    }
+    spawned.push_back(task);
+    task->scheduler->schedule(task);
+    return task;
+}
+
+void Task::run() {
+    Interpreter& self = *interpreter;
+    try {
+        self.step();
+        Environment& frame = self.environment;
+        FrameMemory frameMemory(frame);
+        for (size_t i = 0; i < args.size(); ++i) {
+            setVariable(frame, function->params[i], std::move(args[i]));
+        }
+        if (self.stackless) {
+            result = Vm(self).run(function->compiled(), frame);
+        } else {
+            try {
+                for (const auto& stmt : function->parsedBody()) stmt->execute(frame);
+            } catch (const Value& returned) {
+                result = returned;
+            }
+        }
+        self.joinSpawned();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    self.output.flush();
+    std::string text = buffer.str();
+    steps = self.steps;
+    interpreter.reset();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    output = std::move(text);
+    done = true;
+    waiters.wakeAll();
+}
+
+Value Task::await(Interpreter& waiter) {
+    return finish(waiter, true);
+}
+
+void Task::join(Interpreter& waiter) {
+    finish(waiter, false);
+}
+
+Value Task::finish(Interpreter& waiter, bool always) {
+    std::string text;
+    bool first;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        waiters.waitUntil(lock, scheduler, [this] { return done; });
+        first = !collected;
+        collected = true;
+        text = std::move(output);
+    }
+    if (!first && !always) return {};
+    if (first) {
+        waiter.output.write(text);
+        waiter.chargeSteps(steps);
+    }
+    if (error) std::rethrow_exception(error);
+    return result;
+}
+
+void Channel::send(Value value, TaskScheduler* scheduler) {
+    std::unique_lock<std::mutex> lock(mutex);
+    senders.waitUntil(lock, scheduler, [this] { return items.size() < capacity; });
+    items.push_back(std::move(value));
+    receivers.wakeAll();
+}
+
+Value Channel::recv(TaskScheduler* scheduler) {
+    std::unique_lock<std::mutex> lock(mutex);
+    receivers.waitUntil(lock, scheduler, [this] { return !items.empty(); });
+    Value value = std::move(items.front());
+    items.pop_front();
+    senders.wakeAll();
+    return value;
+}
@@ -0,0 +1,87 @@
+#include "thread_pool.hpp"
+
+namespace {
+// The pool and queue index of the worker running on this thread, if any.
+thread_local ThreadPool* currentPool = nullptr;
+thread_local size_t currentQueue = 0;
+}
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) threads = 1;
+    for (size_t i = 0; i < threads; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> job) {
+    size_t index = currentPool == this ? currentQueue : nextQueue++ % queues.size();
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->jobs.push_back(std::move(job));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending++;
+        queued++;
+    }
+    jobAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    allDone.wait(lock, [this] { return pending == 0; });
+}
+
+bool ThreadPool::takeJob(size_t index, std::function<void()>& job) {
+    {
+        Queue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    for (size_t offset = 1; offset < queues.size(); ++offset) {
+        Queue& victim = *queues[(index + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    currentPool = this;
+    currentQueue = index;
+    while (true) {
+        std::function<void()> job;
+        if (takeJob(index, job)) {
+            job();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0) allDone.notify_all();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        jobAvailable.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued <= 0) return;
+    }
+}
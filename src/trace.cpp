@@ -0,0 +1,160 @@
+#include "trace.hpp"
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+std::atomic<uint64_t> nextTracerId{1};
+
+void writeString(std::ostream& out, const char* text) {
+    out << '"';
+    for (const char* c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            out << '\\' << *c;
+        } else if (static_cast<unsigned char>(*c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+            out << escaped;
+        } else {
+            out << *c;
+        }
+    }
+    out << '"';
+}
+
+// Trace timestamps are in microseconds.
+void writeMicros(std::ostream& out, uint64_t nanos) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.3f", static_cast<double>(nanos) / 1000);
+    out << text;
+}
+
+} // namespace
+
+std::atomic<Tracer*> Tracer::running{nullptr};
+
+// Newest events of one kind on one thread. Only that thread writes, and
+// `written` is published after each event, so a reader sees whole events
+// (once writing has stopped).
+struct Tracer::Ring {
+    explicit Ring(size_t capacity) : events(capacity) {}
+
+    void push(const char* name, const char* category, uint64_t start, uint64_t end, int64_t line) {
+        uint64_t n = written.load(std::memory_order_relaxed);
+        Event& event = events[n % events.size()];
+        std::strncpy(event.name, name, kMaxName);
+        event.name[kMaxName] = '\0';
+        event.category = category;
+        event.start = start;
+        event.duration = end - start;
+        event.line = line;
+        written.store(n + 1, std::memory_order_release);
+    }
+    uint64_t dropped() const {
+        uint64_t n = written.load(std::memory_order_acquire);
+        return n > events.size() ? n - events.size() : 0;
+    }
+
+    std::vector<Event> events;
+    std::atomic<uint64_t> written{0};  // ever recorded; the newest are kept
+};
+
+struct Tracer::Buffer {
+    Buffer(size_t capacity, size_t thread) : spans(capacity), calls(capacity), thread(thread) {}
+
+    Ring spans;
+    Ring calls;
+    size_t thread;         // registration order, 0 is the tracing thread
+    uint32_t callsSeen = 0;  // for sampling
+};
+
+Tracer::Tracer(uint32_t callSample, size_t capacity)
+    : id(nextTracerId++), callSample(callSample), capacity(capacity == 0 ? 1 : capacity) {}
+
+Tracer::~Tracer() {
+    stop();
+}
+
+void Tracer::start() {
+    Tracer* expected = nullptr;
+    if (!running.compare_exchange_strong(expected, this) && expected != this) {
+        throw std::runtime_error("Another tracer is already running.");
+    }
+    threadBuffer();  // the starting thread is listed first
+}
+
+void Tracer::stop() {
+    Tracer* expected = this;
+    running.compare_exchange_strong(expected, nullptr);
+}
+
+// Not inlined: a span in a task can start on one pool thread and finish on
+// another once the task resumes, so the buffer must be that of the thread
+// recording, never a thread-local address the caller computed earlier.
+#if defined(_MSC_VER)
+__declspec(noinline)
+#else
+__attribute__((noinline))
+#endif
+Tracer::Buffer& Tracer::threadBuffer() {
+    thread_local uint64_t cachedTracer = 0;
+    thread_local Buffer* cachedBuffer = nullptr;
+    if (cachedTracer != id) {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(std::make_unique<Buffer>(capacity, buffers.size()));
+        cachedBuffer = buffers.back().get();
+        cachedTracer = id;
+    }
+    return *cachedBuffer;
+}
+
+bool Tracer::sampleCall() {
+    if (callSample == 0) return false;
+    return threadBuffer().callsSeen++ % callSample == 0;
+}
+
+void Tracer::record(const char* name, const char* category, uint64_t start, uint64_t end, int64_t line) {
+    Buffer& buffer = threadBuffer();
+    Ring& ring = category == kCallCategory ? buffer.calls : buffer.spans;
+    ring.push(name, category, start, end, line);
+}
+
+uint64_t Tracer::dropped() const {
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    uint64_t lost = 0;
+    for (const auto& buffer : buffers) lost += buffer->spans.dropped() + buffer->calls.dropped();
+    return lost;
+}
+
+void Tracer::writeJson(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    const char* separator = "";
+    for (const auto& buffer : buffers) {
+        out << separator << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->thread
+            << ", \"args\": {\"name\": \"" << (buffer->thread == 0 ? "main" : "thread " + std::to_string(buffer->thread))
+            << "\"}}";
+        separator = ",\n";
+        for (const Ring* ring : {&buffer->spans, &buffer->calls}) {
+            uint64_t n = ring->written.load(std::memory_order_acquire);
+            for (uint64_t i = ring->dropped(); i < n; ++i) {
+                const Event& event = ring->events[i % capacity];
+                out << ",\n{\"name\": ";
+                writeString(out, event.name);
+                out << ", \"cat\": ";
+                writeString(out, event.category);
+                out << ", \"ph\": \"X\", \"ts\": ";
+                writeMicros(out, event.start);
+                out << ", \"dur\": ";
+                writeMicros(out, event.duration);
+                out << ", \"pid\": 1, \"tid\": " << buffer->thread;
+                if (event.line != 0) out << ", \"args\": {\"line\": " << event.line << "}";
+                out << "}";
+            }
+        }
+    }
+    out << "\n]}\n";
+}
@@ -0,0 +1,532 @@
+#include "vm.hpp"
+#include "expr.hpp"
+#include "stmt.hpp"
+#include "task.hpp"
+#include "array.hpp"
+#include "map.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+class Compiler {
+public:
+    // `function` is set when compiling a function body, where `return`
+    // returns to the caller; elsewhere it ends the program.
+    Compiler(Chunk& chunk, bool function) : chunk(chunk), function(function) {}
+
+    void statement(const Stmt& stmt) {
+        if (auto s = dynamic_cast<const ExpressionStmt*>(&stmt)) {
+            expression(*s->expression);
+            drop();
+        } else if (auto s = dynamic_cast<const PrintStmt*>(&stmt)) {
+            expression(*s->expression);
+            emit(Op::Print);
+        } else if (auto s = dynamic_cast<const VarStmt*>(&stmt)) {
+            expression(*s->initializer);
+            emit(Op::Store, string(s->name));
+            drop();
+        } else if (auto s = dynamic_cast<const BlockStmt*>(&stmt)) {
+            statements(s->statements);
+        } else if (auto s = dynamic_cast<const IfStmt*>(&stmt)) {
+            expression(*s->condition);
+            size_t toElse = emit(Op::JumpIfFalse);
+            statement(*s->thenBranch);
+            if (s->elseBranch) {
+                size_t toEnd = emit(Op::Jump);
+                patch(toElse);
+                statement(*s->elseBranch);
+                patch(toEnd);
+            } else {
+                patch(toElse);
+            }
+        } else if (auto s = dynamic_cast<const WhileStmt*>(&stmt)) {
+            uint32_t start = here();
+            expression(*s->condition);
+            size_t toEnd = emit(Op::JumpIfFalse);
+            emit(Op::Step);
+            loops.emplace_back();
+            statement(*s->body);
+            Loop loop = std::move(loops.back());
+            loops.pop_back();
+            for (size_t at : loop.continues) patch(at);
+            if (s->increment) {
+                expression(*s->increment);
+                drop();
+            }
+            emit(Op::Jump, start);
+            patch(toEnd);
+            for (size_t at : loop.breaks) patch(at);
+        } else if (auto s = dynamic_cast<const FunctionStmt*>(&stmt)) {
+            emit(Op::Constant, constant(std::static_pointer_cast<const Stmt>(s->shared_from_this())));
+            emit(Op::Store, string(s->name));
+            drop();
+        } else if (auto s = dynamic_cast<const ReturnStmt*>(&stmt); s && function) {
+            expression(*s->value);
+            emit(Op::Return);
+        } else if (dynamic_cast<const BreakStmt*>(&stmt)) {
+            if (loops.empty()) throw std::runtime_error("'break' outside a loop.");
+            loops.back().breaks.push_back(emit(Op::Jump));
+        } else if (dynamic_cast<const ContinueStmt*>(&stmt)) {
+            if (loops.empty()) throw std::runtime_error("'continue' outside a loop.");
+            loops.back().continues.push_back(emit(Op::Jump));
+        } else {
+            // includes a return outside a function, which throws its value
+            // out of the Vm to Interpreter::interpret, as in the tree walker
+            chunk.statements.push_back(&stmt);
+            emit(Op::Execute, static_cast<uint32_t>(chunk.statements.size() - 1));
+        }
+    }
+
+    void statements(const std::vector<std::shared_ptr<Stmt>>& list) {
+        for (const auto& stmt : list) {
+            emit(Op::Line, static_cast<uint32_t>(stmt->line));
+            statement(*stmt);
+        }
+    }
+
+    void expression(const Expr& expr) {
+        if (auto e = dynamic_cast<const Literal*>(&expr)) {
+            emit(Op::Constant, constant(e->value));
+        } else if (auto e = dynamic_cast<const Variable*>(&expr)) {
+            emit(Op::Load, string(e->name));
+        } else if (auto e = dynamic_cast<const Assign*>(&expr)) {
+            expression(*e->valueExpr);
+            emit(Op::Store, string(e->name));
+        } else if (auto e = dynamic_cast<const Binary*>(&expr)) {
+            expression(*e->left);
+            expression(*e->right);
+            emit(Op::Binary, string(e->op));
+        } else if (auto e = dynamic_cast<const Logical*>(&expr)) {
+            bool isOr = e->op == "or";
+            expression(*e->left);
+            size_t decided = emit(isOr ? Op::JumpIfTrue : Op::JumpIfFalse);
+            expression(*e->right);
+            emit(Op::Truth);
+            size_t toEnd = emit(Op::Jump);
+            patch(decided);
+            emit(Op::Constant, constant(isOr ? 1.0 : 0.0));
+            patch(toEnd);
+        } else if (auto e = dynamic_cast<const Unary*>(&expr); e && (e->op.lexeme == "-" || e->op.lexeme == "!")) {
+            expression(*e->right);
+            emit(e->op.lexeme == "-" ? Op::Negate : Op::Not);
+        } else if (auto e = dynamic_cast<const Call*>(&expr)) {
+            uint32_t call = node(expr);
+            emit(Op::Resolve, call);
+            for (const auto& argument : e->arguments) expression(*argument);
+            emit(Op::Call, static_cast<uint32_t>(e->arguments.size()), call);
+        } else if (auto e = dynamic_cast<const Spawn*>(&expr)) {
+            for (const auto& argument : e->call->arguments) expression(*argument);
+            emit(Op::Spawn, node(expr), static_cast<uint32_t>(e->call->arguments.size()));
+        } else if (auto e = dynamic_cast<const Await*>(&expr)) {
+            expression(*e->task);
+            emit(Op::Await);
+        } else if (auto e = dynamic_cast<const ArrayLiteral*>(&expr)) {
+            for (const auto& element : e->elements) expression(*element);
+            emit(Op::Array, static_cast<uint32_t>(e->elements.size()));
+        } else if (auto e = dynamic_cast<const MapLiteral*>(&expr)) {
+            for (const auto& [key, value] : e->entries) {
+                expression(*key);
+                expression(*value);
+            }
+            emit(Op::Map, static_cast<uint32_t>(e->entries.size()));
+        } else if (auto e = dynamic_cast<const Index*>(&expr)) {
+            expression(*e->array);
+            expression(*e->index);
+            emit(Op::Index);
+        } else if (auto e = dynamic_cast<const IndexAssign*>(&expr)) {
+            expression(*e->array);
+            expression(*e->index);
+            expression(*e->valueExpr);
+            emit(Op::IndexStore);
+        } else {
+            emit(Op::Evaluate, node(expr));
+        }
+    }
+
+    // A parfor body: `continue` goes to the end, which ends the iteration.
+    // It can't `break` (the parser rejects that too).
+    void loopBody(const Stmt& body) {
+        loops.emplace_back();
+        statement(body);
+        if (!loops.back().breaks.empty()) throw std::runtime_error("Cannot break out of parfor.");
+        for (size_t at : loops.back().continues) patch(at);
+        loops.pop_back();
+    }
+
+    void finish() {
+        emit(Op::Constant, constant(0.0));
+        emit(Op::Return);
+    }
+
+private:
+    struct Loop {
+        std::vector<size_t> breaks;
+        std::vector<size_t> continues;
+    };
+
+    size_t emit(Op op, uint32_t a = 0, uint32_t b = 0) {
+        chunk.code.push_back({op, a, b});
+        return chunk.code.size() - 1;
+    }
+    // Discards the value on top, folding it into a Store that left it there.
+    void drop() {
+        if (chunk.code.back().op == Op::Store) {
+            chunk.code.back().b = 1;
+        } else {
+            emit(Op::Pop);
+        }
+    }
+    uint32_t here() const { return static_cast<uint32_t>(chunk.code.size()); }
+    // Points the jump at `at` to the next instruction.
+    void patch(size_t at) { chunk.code[at].a = here(); }
+
+    uint32_t constant(Value value) {
+        chunk.constants.push_back(std::move(value));
+        return static_cast<uint32_t>(chunk.constants.size() - 1);
+    }
+    uint32_t string(const std::string& text) {
+        auto [it, added] = strings.emplace(text, static_cast<uint32_t>(chunk.strings.size()));
+        if (added) chunk.strings.push_back(text);
+        return it->second;
+    }
+    uint32_t node(const Expr& expr) {
+        chunk.nodes.push_back(&expr);
+        return static_cast<uint32_t>(chunk.nodes.size() - 1);
+    }
+
+    Chunk& chunk;
+    bool function;
+    std::vector<Loop> loops;
+    std::unordered_map<std::string, uint32_t> strings;
+};
+
+} // namespace
+
+std::shared_ptr<const Chunk> compileStatement(const std::shared_ptr<Stmt>& statement) {
+    auto chunk = std::make_shared<Chunk>();
+    Compiler compiler(*chunk, false);
+    compiler.statement(*statement);
+    compiler.finish();
+    return chunk;
+}
+
+std::shared_ptr<const Chunk> compileLoopBody(const std::shared_ptr<Stmt>& body) {
+    auto chunk = std::make_shared<Chunk>();
+    Compiler compiler(*chunk, false);
+    compiler.loopBody(*body);
+    compiler.finish();
+    return chunk;
+}
+
+const Chunk& FunctionStmt::compiled() const {
+    const auto& statements = parsedBody();
+    std::call_once(bodyCompiled, [&] {
+        auto chunk = std::make_shared<Chunk>();
+        Compiler compiler(*chunk, true);
+        compiler.statements(statements);
+        compiler.finish();
+        code = std::move(chunk);
+    });
+    return *code;
+}
+
+struct Vm::Frame {
+    const Chunk* code;
+    size_t pc = 0;
+    size_t base = 0;  // operands below this belong to the caller
+    // A call's variables live in `locals`; the frame start() pushes uses
+    // the environment it was given.
+    Environment locals;
+    Environment* given = nullptr;
+    std::shared_ptr<const FunctionStmt> function;  // null for start()'s frame
+    int line = 0;                                  // of the call
+    bool charged = false;                          // locals count against maxMemory
+    Tracer* tracer = nullptr;
+    uint64_t started = 0;
+
+    Environment& variables() { return given ? *given : locals; }
+};
+
+Vm::Vm(Interpreter& interpreter) : interpreter(interpreter) {}
+
+Vm::~Vm() {
+    unwind();
+}
+
+size_t Vm::depth() const {
+    return frames.size();
+}
+
+Value Vm::run(const Chunk& code, Environment& env) {
+    start(code, env);
+    resume();
+    return std::move(returned);
+}
+
+void Vm::start(const Chunk& code, Environment& env) {
+    unwind();
+    returned = Value{};
+    frames.emplace_back();
+    frames.back().code = &code;
+    frames.back().given = &env;
+}
+
+// Pops the function and `argc` arguments above it and pushes the callee's
+// frame. A built-in runs right away and its result replaces them.
+void Vm::call(size_t argc) {
+    size_t base = stack.size() - argc - 1;
+    if (auto native = std::get_if<std::shared_ptr<const Native>>(&stack[base])) {
+        std::shared_ptr<const Native> held = std::move(*native);
+        Value result = held->function(*held, stack.data() + base + 1, frames.back().variables());
+        stack.resize(base);
+        stack.push_back(std::move(result));
+        return;
+    }
+    auto function = std::static_pointer_cast<const FunctionStmt>(std::get<std::shared_ptr<const Stmt>>(stack[base]));
+    if (argc != function->params.size()) {
+        throw std::runtime_error("Expected " + std::to_string(function->params.size()) + " arguments but got " +
+                                 std::to_string(argc) + ".");
+    }
+    const Chunk& code = function->compiled();
+    interpreter.step();
+    if (frames.size() > interpreter.maxDepth) throw LimitError("Stack overflow");
+
+    Frame& caller = frames.back();
+    Frame frame;
+    frame.code = &code;
+    frame.base = base;
+    frame.locals = caller.variables();
+    frame.function = std::move(function);
+    frame.line = static_cast<int>(caller.code->nodes[caller.code->code[caller.pc - 1].b]->line);
+    interpreter.count([&](Stats& stats) {
+        stats.calls++;
+        stats.environments++;
+        stats.environmentBytes += environmentFootprint(frame.locals);
+        stats.maxDepth = std::max(stats.maxDepth, ++stats.depth);
+    });
+    try {
+        if (interpreter.maxMemory != 0) {
+            interpreter.chargeMemory(environmentFootprint(frame.locals));
+            frame.charged = true;
+        }
+        for (size_t i = 0; i < argc; ++i) {
+            setVariable(frame.locals, frame.function->params[i], std::move(stack[base + 1 + i]));
+        }
+    } catch (...) {
+        release(frame);
+        throw;
+    }
+    stack.resize(base);
+    if (interpreter.shadowStack) interpreter.shadowStack->push(frame.function->name.c_str());
+    frame.tracer = Tracer::forCall();
+    if (frame.tracer) frame.started = frame.tracer->now();
+    frames.push_back(std::move(frame));
+}
+
+// Gives back a call frame's memory charge and call depth.
+void Vm::release(Frame& frame) {
+    if (frame.charged) interpreter.releaseMemory(environmentFootprint(frame.locals));
+    frame.charged = false;
+    interpreter.count([](Stats& stats) { stats.depth--; });
+}
+
+// Ends the call on top of the stack, returning or unwinding.
+void Vm::leave() {
+    Frame& frame = frames.back();
+    if (frame.function) {
+        if (interpreter.shadowStack) interpreter.shadowStack->pop();
+        if (frame.tracer) {
+            frame.tracer->record(frame.function->name.c_str(), Tracer::kCallCategory, frame.started,
+                                 frame.tracer->now(), frame.line);
+        }
+        release(frame);
+    }
+    frames.pop_back();
+}
+
+void Vm::unwind() {
+    while (!frames.empty()) leave();
+    stack.clear();
+}
+
+bool Vm::resume(uint64_t budget) {
+    if (frames.empty()) return true;
+    try {
+        Frame* frame = &frames.back();
+        const Chunk* chunk = frame->code;
+        Environment* env = &frame->variables();
+        auto enter = [&] {
+            frame = &frames.back();
+            chunk = frame->code;
+            env = &frame->variables();
+        };
+        auto pop = [this] {
+            Value value = std::move(stack.back());
+            stack.pop_back();
+            return value;
+        };
+
+        for (; budget > 0; --budget) {
+            const Instruction& in = chunk->code[frame->pc++];
+            switch (in.op) {
+            case Op::Constant:
+                stack.push_back(chunk->constants[in.a]);
+                break;
+            case Op::Load: {
+                auto it = env->find(chunk->strings[in.a]);
+                if (it != env->end()) {
+                    stack.push_back(it->second);
+                } else if (const auto& builtin = findBuiltin(chunk->strings[in.a])) {
+                    stack.push_back(builtin);
+                } else {
+                    throw std::runtime_error("Undefined variable: " + chunk->strings[in.a]);
+                }
+                break;
+            }
+            case Op::Store:
+                if (in.b) {
+                    setVariable(*env, chunk->strings[in.a], pop());
+                } else {
+                    setVariable(*env, chunk->strings[in.a], stack.back());
+                }
+                break;
+            case Op::Pop:
+                stack.pop_back();
+                break;
+            case Op::Binary: {
+                Value& left = stack[stack.size() - 2];
+                left = Binary::apply(chunk->strings[in.a], left, stack.back(), &interpreter);
+                stack.pop_back();
+                break;
+            }
+            case Op::Negate:
+                stack.back() = Unary::negate(stack.back());
+                break;
+            case Op::Not:
+                stack.back() = Unary::logicalNot(stack.back());
+                break;
+            case Op::Truth:
+                stack.back() = isTruthy(stack.back()) ? 1.0 : 0.0;
+                break;
+            case Op::Jump:
+                frame->pc = in.a;
+                break;
+            case Op::JumpIfFalse:
+                if (!isTruthy(stack.back())) frame->pc = in.a;
+                stack.pop_back();
+                break;
+            case Op::JumpIfTrue:
+                if (isTruthy(stack.back())) frame->pc = in.a;
+                stack.pop_back();
+                break;
+            case Op::Print:
+                interpreter.output.print(stack.back());
+                stack.pop_back();
+                break;
+            case Op::Line:
+                interpreter.atLine(static_cast<int>(in.a));
+                break;
+            case Op::Step:
+                interpreter.step();
+                interpreter.count([](Stats& stats) { stats.loopIterations++; });
+                break;
+            case Op::Resolve: {
+                const auto& call = static_cast<const Call&>(*chunk->nodes[in.a]);
+                auto it = env->find(call.callee);
+                if (it == env->end()) {
+                    if (!call.builtin) throw std::runtime_error("Undefined function: " + call.callee);
+                    stack.push_back(call.builtin);
+                } else if (std::holds_alternative<std::shared_ptr<const Native>>(it->second)) {
+                    stack.push_back(it->second);
+                } else {
+                    stack.push_back(std::static_pointer_cast<const Stmt>(toFunction(it->second, call.callee)));
+                    break;
+                }
+                // a built-in's argument count is checked before they are evaluated
+                checkArity(*std::get<std::shared_ptr<const Native>>(stack.back()), call.arguments.size());
+                break;
+            }
+            case Op::Call:
+                call(in.a);
+                enter();
+                break;
+            case Op::Return: {
+                Value value = pop();
+                if (frames.size() == 1) {
+                    returned = std::move(value);
+                    frames.clear();
+                    stack.clear();
+                    return true;
+                }
+                stack.resize(frame->base);
+                leave();
+                enter();
+                stack.push_back(std::move(value));
+                break;
+            }
+            case Op::Spawn: {
+                const auto& spawn = static_cast<const Spawn&>(*chunk->nodes[in.a]);
+                auto it = env->find(spawn.call->callee);
+                if (it == env->end()) throw std::runtime_error("Undefined function: " + spawn.call->callee);
+                auto function = toFunction(it->second, spawn.call->callee);
+                std::vector<Value> args(std::make_move_iterator(stack.end() - in.b),
+                                        std::make_move_iterator(stack.end()));
+                stack.resize(stack.size() - in.b);
+                stack.push_back(Task::spawn(interpreter, std::move(function), std::move(args), *env));
+                break;
+            }
+            case Op::Await: {
+                Value task = pop();
+                if (!std::holds_alternative<std::shared_ptr<Task>>(task))
+                    throw std::runtime_error("Can only await a task.");
+                stack.push_back(std::get<std::shared_ptr<Task>>(task)->await(interpreter));
+                break;
+            }
+            case Op::Array: {
+                std::vector<Value> values(std::make_move_iterator(stack.end() - in.a),
+                                          std::make_move_iterator(stack.end()));
+                stack.resize(stack.size() - in.a);
+                interpreter.checkAllocation(values.size() * sizeof(Value));
+                auto array = std::make_shared<Array>(std::move(values));
+                array->charge(&interpreter);
+                stack.push_back(std::move(array));
+                break;
+            }
+            case Op::Map: {
+                auto map = std::make_shared<Map>();
+                size_t first = stack.size() - 2 * size_t(in.a);
+                for (size_t i = first; i < stack.size(); i += 2) map->set(stack[i], stack[i + 1]);
+                stack.resize(first);
+                map->charge(&interpreter);
+                stack.push_back(std::move(map));
+                break;
+            }
+            case Op::Index: {
+                Value key = pop();
+                stack.back() = Index::apply(stack.back(), key);
+                break;
+            }
+            case Op::IndexStore: {
+                Value value = pop();
+                Value key = pop();
+                IndexAssign::apply(*env, stack.back(), key, value);
+                stack.back() = std::move(value);
+                break;
+            }
+            case Op::Evaluate:
+                stack.push_back(chunk->nodes[in.a]->evaluate(*env));
+                break;
+            case Op::Execute:
+                chunk->statements[in.a]->execute(*env);
+                break;
+            }
+        }
+        return false;
+    } catch (...) {
+        unwind();
+        throw;
+    }
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include "codelang.h"
+
+namespace {
+
+void appendOutput(void* userData, const char* data, size_t length) {
+    static_cast<std::string*>(userData)->append(data, length);
+}
+
+codelang_program* compile(codelang_context* ctx, const char* source) {
+    return codelang_compile(ctx, source, std::strlen(source));
+}
+
+// hypot(a, b), failing unless both are numbers
+void hypotFunction(void* userData, codelang_call* call) {
+    ++*static_cast<int*>(userData);
+    if (codelang_arg_type(call, 0) != CODELANG_NUMBER || codelang_arg_type(call, 1) != CODELANG_NUMBER) {
+        codelang_fail(call, "hypot() expects numbers.");
+        return;
+    }
+    double a = codelang_arg_number(call, 0);
+    double b = codelang_arg_number(call, 1);
+    codelang_return_number(call, std::sqrt(a * a + b * b));
+}
+
+void shoutFunction(void*, codelang_call* call) {
+    size_t length = 0;
+    const char* text = codelang_arg_string(call, 0, &length);
+    std::string loud(text ? text : "", text ? length : 0);
+    loud += "!";
+    codelang_return_string(call, loud.data(), loud.size());
+}
+
+} // namespace
+
+TEST(CApiTest, CompilesOnceAndRunsRepeatedly) {
+    codelang_context* ctx = codelang_context_new();
+    codelang_program* program = compile(ctx, R"(
+        let total = 0;
+        for (let i = 1; i <= 4; i = i + 1) { total = total + i; }
+        print "total " + "is";
+        print total;
+    )");
+    ASSERT_NE(program, nullptr);
+
+    for (int run = 0; run < 3; ++run) {
+        std::string output;
+        EXPECT_EQ(codelang_run(ctx, program, appendOutput, &output), CODELANG_OK);
+        EXPECT_EQ(output, "total is\n10\n");
+        EXPECT_STREQ(codelang_last_error(ctx), "");
+        EXPECT_EQ(codelang_last_steps(ctx), 4u);
+    }
+
+    codelang_program_free(program);
+    codelang_context_free(ctx);
+}
+
+TEST(CApiTest, ReportsSyntaxErrors) {
+    codelang_context* ctx = codelang_context_new();
+    EXPECT_EQ(compile(ctx, "let = 1;"), nullptr);
+    EXPECT_STREQ(codelang_last_error(ctx), "Expected variable name.");
+    codelang_context_free(ctx);
+}
+
+TEST(CApiTest, ReportsRuntimeErrorsAfterEarlierOutput) {
+    codelang_context* ctx = codelang_context_new();
+    codelang_program* program = compile(ctx, "print 1; print missing;");
+    ASSERT_NE(program, nullptr);
+
+    std::string output;
+    EXPECT_EQ(codelang_run(ctx, program, appendOutput, &output), CODELANG_ERROR);
+    EXPECT_EQ(output, "1\n");
+    EXPECT_STREQ(codelang_last_error(ctx), "Undefined variable: missing");
+
+    codelang_program_free(program);
+    codelang_context_free(ctx);
+}
+
+TEST(CApiTest, TopLevelReturnEndsTheRun) {
+    codelang_context* ctx = codelang_context_new();
+    codelang_program* program = compile(ctx, "print 1; if (1) { return 2; } print 3;");
+    ASSERT_NE(program, nullptr);
+
+    std::string output;
+    EXPECT_EQ(codelang_run(ctx, program, appendOutput, &output), CODELANG_OK);
+    EXPECT_EQ(output, "1\n");
+    EXPECT_STREQ(codelang_last_error(ctx), "");
+
+    codelang_program_free(program);
+    codelang_context_free(ctx);
+}
+
+TEST(CApiTest, EnforcesStepBudget) {
+    codelang_context* ctx = codelang_context_new();
+    codelang_set_step_budget(ctx, 1000);
+    codelang_program* program = compile(ctx, "while (1) { }");
+    ASSERT_NE(program, nullptr);
+
+    EXPECT_EQ(codelang_run(ctx, program, nullptr, nullptr), CODELANG_LIMIT);
+    EXPECT_STREQ(codelang_last_error(ctx), "Step limit exceeded");
+
+    codelang_program_free(program);
+    codelang_context_free(ctx);
+}
+
+TEST(CApiTest, CallsNativeFunctions) {
+    codelang_context* ctx = codelang_context_new();
+    int calls = 0;
+    codelang_define_function(ctx, "hypot", 2, hypotFunction, &calls);
+    codelang_define_function(ctx, "shout", 1, shoutFunction, nullptr);
+    codelang_program* program = compile(ctx, R"(
+        print hypot(3, 4);
+        let f = shout;
+        print f("hey");
+        print shout(1);
+    )");
+    ASSERT_NE(program, nullptr);
+
+    std::string output;
+    EXPECT_EQ(codelang_run(ctx, program, appendOutput, &output), CODELANG_OK);
+    EXPECT_EQ(output, "5\nhey!\n!\n");
+    EXPECT_EQ(calls, 1);
+    codelang_program_free(program);
+
+    program = compile(ctx, "print hypot(1, \"x\");");
+    EXPECT_EQ(codelang_run(ctx, program, nullptr, nullptr), CODELANG_ERROR);
+    EXPECT_STREQ(codelang_last_error(ctx), "hypot() expects numbers.");
+    codelang_program_free(program);
+
+    program = compile(ctx, "hypot(1);");
+    EXPECT_EQ(codelang_run(ctx, program, nullptr, nullptr), CODELANG_ERROR);
+    EXPECT_STREQ(codelang_last_error(ctx), "hypot() expects 2 arguments.");
+    codelang_program_free(program);
+    codelang_context_free(ctx);
+}
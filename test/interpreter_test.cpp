@@ -1,8 +1,10 @@
 #include <gtest/gtest.h>
 #include <sstream>
+#include <thread>
 #include "scanner.hpp"
 #include "parser.hpp"
 #include "interpreter.hpp"
+#include "array.hpp"
 
 std::vector<std::shared_ptr<Stmt>> parseSource(const std::string& source) {
     Scanner scanner(source);
@@ -85,3 +87,352 @@ TEST(InterpreterTest, HandlesFunctionDefinitionAndCall) {
 
     EXPECT_EQ(output, "12\n");
 }
+
+TEST(InterpreterTest, LazyFunctionsParseOnFirstCall) {
+    Interpreter interpreter;
+    std::string source = R"(
+        function fib(n) {
+            if (n < 2) { return n; }
+            return fib(n - 1) + fib(n - 2);
+        }
+        function unused() { print ; }
+        print fib(10);
+    )";
+    Scanner scanner(source);
+    auto tokens = std::make_shared<const std::vector<Token>>(scanner.scanTokens());
+    Parser parser(tokens, ParseMode::LazyFunctions);
+    auto stmts = parser.parse();
+
+    StdoutCapture capture;
+    capture.start();
+    interpreter.interpret(stmts);
+    auto output = capture.stop();
+
+    EXPECT_EQ(output, "55\n");
+}
+
+TEST(InterpreterTest, LogicalOperatorsShortCircuit) {
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    // `missing` is undefined: evaluating it would throw
+    interpreter.interpret(parseSource(R"(
+        let calls = 0;
+        function touch(v) { calls = calls + 1; return v; }
+        print 0 and missing;
+        print 1 or missing;
+        print 2 and "yes" == "yes";
+        print 0 or 0;
+        print 1 and touch(0) or touch(3);
+    )"));
+    EXPECT_EQ(out.str(), "0\n1\n1\n0\n1\n");
+    // functions run on a copy of the environment, so count via steps instead
+    interpreter.steps = 0;
+    interpreter.interpret(parseSource("let x = 0 and touch(1); let y = 1 or touch(1);"));
+    EXPECT_EQ(interpreter.steps, 0u);
+    EXPECT_THROW(interpreter.interpret(parseSource("print 1 and missing;")), std::runtime_error);
+}
+
+TEST(InterpreterTest, BreakAndContinueLeaveLoopsEarly) {
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    interpreter.interpret(parseSource(R"(
+        let i = 0;
+        while (1) {
+            i = i + 1;
+            if (i == 3) { continue; }
+            if (i > 5) { break; }
+            print i;
+        }
+        for (let j = 0; j < 10; j++) {
+            if (j < 7) continue;
+            for (;;) { break; print "never"; }
+            print j;
+        }
+        function firstOver(limit) {
+            let n = 1;
+            while (1) { n = n * 2; if (n > limit) break; }
+            return n;
+        }
+        print firstOver(100);
+    )"));
+    EXPECT_EQ(out.str(), "1\n2\n4\n5\n7\n8\n9\n128\n");
+    // a continue still runs the for loop's increment, and stops costing steps
+    // once the loop is left
+    interpreter.steps = 0;
+    interpreter.interpret(parseSource("for (let k = 0; k < 1000; k++) { if (k == 4) break; continue; }"));
+    EXPECT_EQ(interpreter.steps, 5u);
+}
+
+TEST(InterpreterTest, IntegersBehaveLikeDoublesAndPromoteOutOfRange) {
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    interpreter.interpret(parseSource(R"(
+        let n = 2 * 3 + 1;
+        let big = 9007199254740992;
+        let wrapped = big + 1;
+        let counter = big;
+        counter++;
+        print n;
+        print big;
+        print wrapped == big;
+        print 9007199254740993 == big;
+        print counter;
+        print 999999 + 1;
+        print 1234567 * 1000;
+        print 7 / 2;
+        print 6 / 3;
+        print -0;
+        print 0 * -5;
+        print 1 == 1.0;
+        let m = {1: "one"};
+        print m[1.0];
+    )"));
+    EXPECT_EQ(out.str(), "7\n9.0072e+15\n1\n1\n9.0072e+15\n1e+06\n1.23457e+09\n3.5\n2\n-0\n-0\n1\none\n");
+    EXPECT_EQ(std::get<int64_t>(interpreter.environment["n"]), 7);
+    EXPECT_TRUE(std::holds_alternative<double>(interpreter.environment["wrapped"]));
+    EXPECT_TRUE(std::holds_alternative<double>(interpreter.environment["counter"]));
+}
+
+TEST(InterpreterTest, StopsAtStepLimit) {
+    Interpreter interpreter;
+    interpreter.maxSteps = 100;
+    auto stmts = parseSource("let i = 0; while (1) { i = i + 1; }");
+    EXPECT_THROW(interpreter.interpret(stmts), LimitError);
+    EXPECT_EQ(std::get<int64_t>(interpreter.environment["i"]), 100);
+}
+
+TEST(InterpreterTest, CountsCallsAsSteps) {
+    Interpreter interpreter;
+    auto stmts = parseSource(R"(
+        function f(n) { if (n > 0) { return f(n - 1); } return 0; }
+        f(9);
+    )");
+    interpreter.interpret(stmts);
+    EXPECT_EQ(interpreter.steps, 10);
+}
+
+TEST(InterpreterTest, StopsAtMemoryLimitForGrowingString) {
+    Interpreter interpreter;
+    interpreter.maxMemory = 64 * 1024;
+    auto stmts = parseSource(R"(
+        let s = "xxxxxxxxxxxxxxxx";
+        while (1) { s = s + s; }
+    )");
+    try {
+        interpreter.interpret(stmts);
+        FAIL() << "expected LimitError";
+    } catch (const LimitError& e) {
+        EXPECT_STREQ(e.what(), "Memory limit exceeded");
+    }
+    EXPECT_LE(interpreter.memoryUsed, interpreter.maxMemory);
+}
+
+TEST(InterpreterTest, ReleasesCallFrameMemoryOnReturn) {
+    Interpreter interpreter;
+    interpreter.maxMemory = 1 << 20;
+    auto stmts = parseSource(R"(
+        let big = "0123456789012345678901234567890123456789";
+        function depth(n) { let copy = big + big; if (n > 0) { return depth(n - 1); } return 0; }
+    )");
+    interpreter.interpret(stmts);
+    size_t before = interpreter.memoryUsed;
+    interpreter.interpret(parseSource("depth(20);"));
+    EXPECT_EQ(interpreter.memoryUsed, before);
+
+    interpreter.maxMemory = before + 2000;
+    EXPECT_THROW(interpreter.interpret(parseSource("depth(100);")), LimitError);
+}
+
+TEST(InterpreterTest, ArraysIndexPushAndPop) {
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    interpreter.interpret(parseSource(R"(
+        let a = [1, 2, 3];
+        push(a, 4);
+        a[0] = a[1] * 10;
+        print a;
+        print len(a) + pop(a);
+        let nested = [a, "x", []];
+        print nested[0][2];
+        print nested;
+    )"));
+    EXPECT_EQ(out.str(), "[20, 2, 3, 4]\n8\n3\n[[20, 2, 3], x, []]\n");
+}
+
+TEST(InterpreterTest, ArraysStayNumericUntilANonNumberIsStored) {
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    interpreter.interpret(parseSource("let a = []; let i = 0; while (i < 1000) { push(a, i); i = i + 1; }"));
+    auto array = std::get<std::shared_ptr<Array>>(interpreter.environment["a"]);
+    EXPECT_TRUE(array->numeric());
+    interpreter.interpret(parseSource("a[500] = \"x\"; print a[499] + a[501]; print a[500];"));
+    EXPECT_FALSE(array->numeric());
+    EXPECT_EQ(out.str(), "1000\nx\n");
+}
+
+TEST(InterpreterTest, ReportsBadArrayIndex) {
+    auto error = [](const std::string& source) {
+        std::ostringstream out;
+        Interpreter interpreter(out);
+        try {
+            interpreter.interpret(parseSource(source));
+        } catch (const std::runtime_error& e) {
+            return std::string(e.what());
+        }
+        return std::string();
+    };
+    EXPECT_EQ(error("let a = [1]; print a[1];"), "Array index out of range.");
+    EXPECT_EQ(error("let a = [1]; print a[0.5];"), "Array index must be a whole number.");
+    EXPECT_EQ(error("let a = 1; print a[0];"), "Can only index arrays and maps.");
+    EXPECT_EQ(error("pop([]);"), "pop() on an empty array.");
+}
+
+TEST(InterpreterTest, StopsAtMemoryLimitForGrowingArray) {
+    Interpreter interpreter;
+    interpreter.maxMemory = 64 * 1024;
+    EXPECT_THROW(interpreter.interpret(parseSource("let a = []; while (1) { push(a, \"x\"); }")), LimitError);
+}
+
+TEST(InterpreterTest, ChargesEveryArrayAndMapAgainstTheMemoryCap) {
+    const std::string helpers = R"(
+        function numbers(n) { let a = []; let i = 0; while (i < n) { push(a, i); i = i + 1; } return a; }
+        function table(n) { let m = {}; let i = 0; while (i < n) { m[i] = i; i = i + 1; } return m; }
+    )";
+    for (bool stackless : {false, true}) {
+        // each array (160 KB) fits, but ten of them don't
+        Interpreter interpreter;
+        interpreter.stackless = stackless;
+        interpreter.maxMemory = 1 << 20;
+        EXPECT_THROW(interpreter.interpret(parseSource(
+                         helpers + "let kept = []; while (len(kept) < 10) { push(kept, numbers(20000)); }")),
+                     LimitError);
+        EXPECT_THROW(interpreter.interpret(parseSource(
+                         helpers + "let kept = []; while (len(kept) < 10) { push(kept, table(2000)); }")),
+                     LimitError);
+
+        // storage is given back when the last reference goes
+        Interpreter reusing;
+        reusing.stackless = stackless;
+        reusing.maxMemory = 1 << 20;
+        reusing.interpret(parseSource(helpers + R"(
+            let k = 0;
+            while (k < 10) { let a = numbers(20000); let m = table(2000); k = k + 1; }
+            let a = 0;
+            let m = 0;
+        )"));
+        ASSERT_NE(reusing.containerMemory, nullptr);
+        EXPECT_EQ(reusing.containerMemory->used, 0u);
+    }
+}
+
+TEST(InterpreterTest, BulkArrayBuiltins) {
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    interpreter.interpret(parseSource(R"(
+        let a = [1, 2, 3, 4];
+        let b = [10, 20, 30, 40];
+        print sum(a);
+        print dot(a, b);
+        print min(b) + max(a);
+        print map_add(a, b);
+        print map_mul(a, 2);
+        print scale(b, 0.5);
+        print prefix_sum(a);
+        print sum([]);
+    )"));
+    EXPECT_EQ(out.str(), "10\n300\n14\n[11, 22, 33, 44]\n[2, 4, 6, 8]\n[5, 10, 15, 20]\n[1, 3, 6, 10]\n0\n");
+
+    EXPECT_THROW(interpreter.interpret(parseSource("sum([1, \"x\"]);")), std::runtime_error);
+    EXPECT_THROW(interpreter.interpret(parseSource("dot([1, 2], [1]);")), std::runtime_error);
+    EXPECT_THROW(interpreter.interpret(parseSource("min([]);")), std::runtime_error);
+    EXPECT_THROW(interpreter.interpret(parseSource("scale([1], [1]);")), std::runtime_error);
+}
+
+TEST(InterpreterTest, MathAndStringBuiltins) {
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    interpreter.interpret(parseSource(R"(
+        print sqrt(16) + floor(2.7) + abs(-3);
+        print substr("interpreter", 5, 3) + substr("abc", 1, 10) + substr("abc", 3, 1);
+        print to_string(1.5) + "/" + to_string(1000000) + "/" + to_string("s");
+        let started = clock();
+        print clock() >= started;
+        let root = sqrt;
+        print root(9);
+        function abs(x) { return "mine"; }
+        print abs(-1);
+    )"));
+    EXPECT_EQ(out.str(), "9\nprebc\n1.5/1e+06/s\n1\n3\nmine\n");
+
+    EXPECT_THROW(interpreter.interpret(parseSource("sqrt(1, 2);")), std::runtime_error);
+    EXPECT_THROW(interpreter.interpret(parseSource("floor(\"x\");")), std::runtime_error);
+    EXPECT_THROW(interpreter.interpret(parseSource("substr(\"abc\", 4, 1);")), std::runtime_error);
+    EXPECT_THROW(interpreter.interpret(parseSource("substr(\"abc\", 0.5, 1);")), std::runtime_error);
+    EXPECT_THROW(interpreter.interpret(parseSource("spawn root(1);")), std::runtime_error);
+    try {
+        interpreter.interpret(parseSource("clock(1);"));
+        FAIL() << "expected an arity error";
+    } catch (const std::runtime_error& e) {
+        EXPECT_STREQ(e.what(), "clock() expects 0 arguments.");
+    }
+}
+
+TEST(InterpreterTest, MapsLookUpAndIterateInInsertionOrder) {
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    interpreter.interpret(parseSource(R"(
+        let ages = {"bob": 31, "al": 40};
+        ages["cy"] = 25;
+        set(ages, "bob", 32);
+        print ages;
+        print get(ages, "al") + ages["cy"];
+        print has(ages, "dee") + has(ages, "bob");
+        print delete(ages, "al");
+        print keys(ages);
+        print len(ages);
+        let squares = {};
+        let i = 0;
+        while (i < 100) { squares[i] = i * i; i = i + 1; }
+        print squares[99];
+    )"));
+    EXPECT_EQ(out.str(), "{bob: 32, al: 40, cy: 25}\n65\n1\n1\n[bob, cy]\n2\n9801\n");
+
+    try {
+        interpreter.interpret(parseSource("print ages[\"zed\"];"));
+        FAIL() << "expected an error";
+    } catch (const std::runtime_error& e) {
+        EXPECT_STREQ(e.what(), "Map has no key: zed");
+    }
+}
+
+TEST(InterpreterTest, RunsOneProgramOnManyThreads) {
+    // one lazily parsed program shared by every thread, so the first calls
+    // race to parse the same bodies; run under -DCODELANG_TSAN=ON to check
+    std::string source = R"(
+        function fib(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }
+        function twice(s) { return s + s; }
+        let total = 0;
+        let i = 0;
+        while (i < 20) { total = total + fib(i); i = i + 1; }
+        print total;
+        print twice("ab");
+    )";
+    Scanner scanner(source);
+    auto tokens = std::make_shared<const std::vector<Token>>(scanner.scanTokens());
+    Parser parser(tokens, ParseMode::LazyFunctions);
+    const auto program = parser.parse();
+
+    std::vector<std::string> outputs(8);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < outputs.size(); ++t) {
+        threads.emplace_back([&program, &outputs, t] {
+            std::ostringstream out;
+            Interpreter interpreter(out);
+            interpreter.interpret(program);
+            outputs[t] = out.str();
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    for (const auto& output : outputs) EXPECT_EQ(output, "10945\nabab\n");
+}
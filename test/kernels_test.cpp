@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+#include "kernels.hpp"
+
+namespace {
+
+std::vector<double> randomNumbers(size_t n, unsigned seed) {
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> value(-1e6, 1e6);
+    std::vector<double> numbers(n);
+    for (auto& x : numbers) x = value(rng) * std::pow(10.0, static_cast<int>(rng() % 20) - 10);
+    return numbers;
+}
+
+bool sameBits(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+} // namespace
+
+TEST(KernelsTest, SumUsesTheDocumentedLaneOrder) {
+    auto a = randomNumbers(1000, 1);
+    double lanes[kKernelLanes] = {};
+    size_t blocks = a.size() / kKernelLanes * kKernelLanes;
+    for (size_t i = 0; i < blocks; ++i) lanes[i % kKernelLanes] += a[i];
+    for (size_t width = kKernelLanes / 2; width > 0; width /= 2) {
+        for (size_t l = 0; l < width; ++l) lanes[l] += lanes[l + width];
+    }
+    double expected = lanes[0];
+    for (size_t i = blocks; i < a.size(); ++i) expected += a[i];
+    EXPECT_TRUE(sameBits(numericKernels().sum(a.data(), a.size()), expected));
+}
+
+TEST(KernelsTest, Avx2MatchesScalarBitForBit) {
+    const NumericKernels* avx2 = avx2Kernels();
+    if (!avx2) GTEST_SKIP() << "no AVX2 on this machine";
+    const NumericKernels& scalar = scalarKernels();
+    for (size_t n : {1, 3, 15, 16, 17, 33, 100, 1000, 4099}) {
+        auto a = randomNumbers(n, static_cast<unsigned>(n));
+        auto b = randomNumbers(n, static_cast<unsigned>(n) + 7);
+        a[n / 2] = -0.0;
+        if (n > 20) a[n / 3] = std::numeric_limits<double>::quiet_NaN();
+
+        EXPECT_TRUE(sameBits(avx2->sum(b.data(), n), scalar.sum(b.data(), n))) << n;
+        EXPECT_TRUE(sameBits(avx2->dot(a.data(), b.data(), n), scalar.dot(a.data(), b.data(), n))) << n;
+        EXPECT_TRUE(sameBits(avx2->min(a.data(), n), scalar.min(a.data(), n))) << n;
+        EXPECT_TRUE(sameBits(avx2->max(a.data(), n), scalar.max(a.data(), n))) << n;
+
+        std::vector<double> fast(n), slow(n);
+        avx2->add(a.data(), b.data(), fast.data(), n);
+        scalar.add(a.data(), b.data(), slow.data(), n);
+        EXPECT_EQ(std::memcmp(fast.data(), slow.data(), n * sizeof(double)), 0) << n;
+        avx2->mulScalar(b.data(), 0.1, fast.data(), n);
+        scalar.mulScalar(b.data(), 0.1, slow.data(), n);
+        EXPECT_EQ(std::memcmp(fast.data(), slow.data(), n * sizeof(double)), 0) << n;
+    }
+}
+
+TEST(KernelsTest, MinAndMaxFindExtremes) {
+    std::vector<double> a = {3, -2, 8, 5, 0, 7, 1, 4, 6, 9, -1, 2, 11, -5, 10, 12, 13, -3, 14};
+    EXPECT_EQ(numericKernels().min(a.data(), a.size()), -5);
+    EXPECT_EQ(numericKernels().max(a.data(), a.size()), 14);
+    EXPECT_EQ(numericKernels().max(a.data(), 3), 8);
+}
+
+TEST(KernelsTest, PrefixSumAddsLeftToRight) {
+    std::vector<double> a = {0.1, 0.2, 0.3, 1e16, -1e16};
+    std::vector<double> out(a.size());
+    prefixSum(a.data(), out.data(), a.size());
+    double s = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        s += a[i];
+        EXPECT_TRUE(sameBits(out[i], s)) << i;
+    }
+}
@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <string>
+#include "map.hpp"
+
+TEST(MapTest, SetGetHasAndErase) {
+    Map map;
+    map.set(1.0, std::string("one"));
+    map.set(std::string("1"), 2.0);
+    Value value;
+    ASSERT_TRUE(map.get(1.0, value));
+    EXPECT_EQ(std::get<std::string>(value), "one");
+    ASSERT_TRUE(map.get(std::string("1"), value));
+    EXPECT_EQ(std::get<double>(value), 2.0);
+    EXPECT_TRUE(map.has(-0.0 + 1.0));
+    EXPECT_FALSE(map.has(2.0));
+
+    EXPECT_TRUE(map.erase(1.0));
+    EXPECT_FALSE(map.erase(1.0));
+    EXPECT_FALSE(map.has(1.0));
+    EXPECT_EQ(map.size(), 1);
+}
+
+TEST(MapTest, KeepsInsertionOrder) {
+    Map map;
+    for (const char* key : {"c", "a", "b", "d"}) map.set(std::string(key), 0.0);
+    map.set(std::string("a"), 1.0);  // stays in place
+    map.erase(std::string("b"));
+    map.set(std::string("b"), 2.0);  // goes to the end
+    std::string order;
+    for (const auto& key : map.keys()) order += std::get<std::string>(key);
+    EXPECT_EQ(order, "cadb");
+}
+
+TEST(MapTest, GrowsAndReusesDeletedSlots) {
+    Map map;
+    for (int i = 0; i < 10000; ++i) map.set(static_cast<double>(i), static_cast<double>(i * 2));
+    for (int i = 0; i < 10000; i += 2) map.erase(static_cast<double>(i));
+    for (int i = 0; i < 5000; ++i) map.set("k" + std::to_string(i), static_cast<double>(i));
+    EXPECT_EQ(map.size(), 10000);
+
+    Value value;
+    for (int i = 1; i < 10000; i += 2) {
+        ASSERT_TRUE(map.get(static_cast<double>(i), value)) << i;
+        EXPECT_EQ(std::get<double>(value), i * 2);
+    }
+    EXPECT_FALSE(map.has(4.0));
+    ASSERT_TRUE(map.get(std::string("k4999"), value));
+    EXPECT_EQ(std::get<double>(value), 4999);
+    auto keys = map.keys();
+    EXPECT_EQ(std::get<double>(keys.front()), 1.0);
+    EXPECT_EQ(std::get<std::string>(keys.back()), "k4999");
+}
+
+TEST(MapTest, ZeroIsOneKeyAndNaNIsRejected) {
+    Map map;
+    map.set(-0.0, 1.0);
+    EXPECT_TRUE(map.has(0.0));
+    EXPECT_THROW(map.set(std::nan(""), 1.0), std::runtime_error);
+    EXPECT_THROW(map.has(std::make_shared<Map>()), std::runtime_error);
+}
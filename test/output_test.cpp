@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include "output.hpp"
+
+TEST(OutputTest, FormatsNumbersLikeOstream) {
+    const double values[] = {0.0, -0.0, 1.0, -7.0, 0.1 + 0.2, 3.14159265, 123456.0, 1234567.0,
+                             1e21, 1e-7, 0.0001, 2.5e-300, 1.0 / 3.0, -99999.95,
+                             std::numeric_limits<double>::infinity()};
+    for (double value : values) {
+        std::ostringstream expected;
+        expected << value;
+        char digits[kMaxNumberChars];
+        EXPECT_EQ(std::string(digits, formatNumber(value, digits)), expected.str()) << value;
+    }
+}
+
+TEST(OutputTest, BuffersUntilFlush) {
+    std::ostringstream out;
+    OutputSink sink(out);
+    sink.print(42.0);
+    sink.print(std::string("hi"));
+    EXPECT_EQ(out.str(), "");
+    sink.flush();
+    EXPECT_EQ(out.str(), "42\nhi\n");
+}
+
+TEST(OutputTest, LineBufferedWritesEachLine) {
+    std::ostringstream out;
+    OutputSink sink(out, OutputSink::Mode::LineBuffered);
+    sink.print(1.5);
+    EXPECT_EQ(out.str(), "1.5\n");
+}
+
+TEST(OutputTest, FlushesWhenBufferFills) {
+    std::ostringstream out;
+    OutputSink sink(out, OutputSink::Mode::FullyBuffered, 8);
+    sink.print(std::string("abc"));
+    sink.print(std::string("defg"));
+    EXPECT_EQ(out.str(), "abc\ndefg");
+    sink.print(std::string("a long line that exceeds the buffer"));
+    EXPECT_EQ(out.str(), "abc\ndefg\na long line that exceeds the buffer");
+    sink.flush();
+    EXPECT_EQ(out.str(), "abc\ndefg\na long line that exceeds the buffer\n");
+}
+
+TEST(OutputTest, StopsAtOutputLimit) {
+    std::ostringstream out;
+    OutputSink sink(out);
+    sink.setLimit(6);
+    sink.print(std::string("abc"));
+    EXPECT_THROW(sink.print(std::string("defg")), OutputLimitError);
+    EXPECT_TRUE(sink.truncated());
+    sink.flush();
+    EXPECT_EQ(out.str(), "abc\nde");
+}
@@ -27,7 +27,7 @@ TEST(ParserTest, ParsesLetDeclaration) {
     EXPECT_EQ(varStmt->name, "x");
     auto literal = std::dynamic_pointer_cast<Literal>(varStmt->initializer);
     ASSERT_NE(literal, nullptr);
-    EXPECT_EQ(std::get<double>(literal->value), 42.0);
+    EXPECT_EQ(std::get<int64_t>(literal->value), 42);
 }
 
 TEST(ParserTest, ParsesVarDeclaration) {
@@ -121,7 +121,7 @@ TEST(ParserTest, ParsesReturnStatement) {
     ASSERT_NE(retStmt, nullptr);
     auto literal = std::dynamic_pointer_cast<Literal>(retStmt->value);
     ASSERT_NE(literal, nullptr);
-    EXPECT_EQ(std::get<double>(literal->value), 123.0);
+    EXPECT_EQ(std::get<int64_t>(literal->value), 123);
 }
 
 TEST(ParserTest, ParsesAssignmentExpression) {
@@ -137,8 +137,56 @@ TEST(ParserTest, ParsesLogicalOrAndAnd) {
     auto stmt = parseSingleStatement("print a or b and c;");
     auto printStmt = std::dynamic_pointer_cast<PrintStmt>(stmt);
     ASSERT_NE(printStmt, nullptr);
-    auto orExpr = std::dynamic_pointer_cast<Binary>(printStmt->expression);
+    auto orExpr = std::dynamic_pointer_cast<Logical>(printStmt->expression);
     ASSERT_NE(orExpr, nullptr);
+    EXPECT_EQ(orExpr->op, "or");
+    auto andExpr = std::dynamic_pointer_cast<Logical>(orExpr->right);
+    ASSERT_NE(andExpr, nullptr);
+    EXPECT_EQ(andExpr->op, "and");
+}
+
+TEST(ParserTest, ForLoopKeepsItsIncrementForContinue) {
+    auto stmt = parseSingleStatement("for (;; i = i + 1) { if (i > 3) continue; break; }");
+    auto whileStmt = std::dynamic_pointer_cast<WhileStmt>(stmt);
+    ASSERT_NE(whileStmt, nullptr);
+    EXPECT_NE(std::dynamic_pointer_cast<Assign>(whileStmt->increment), nullptr);
+    auto body = std::dynamic_pointer_cast<BlockStmt>(whileStmt->body);
+    ASSERT_NE(body, nullptr);
+    EXPECT_NE(std::dynamic_pointer_cast<BreakStmt>(body->statements[1]), nullptr);
+}
+
+TEST(ParserTest, ThrowsOnBreakOrContinueOutsideALoop) {
+    EXPECT_THROW(parseSingleStatement("break;"), std::runtime_error);
+    EXPECT_THROW(parseSingleStatement("if (1) continue;"), std::runtime_error);
+    // a function body is not inside the loop that defines it
+    EXPECT_THROW(parseSingleStatement("while (1) { function f() { break; } }"), std::runtime_error);
+    EXPECT_THROW(parseSingleStatement("parfor (let i = 0; i < 9; i++) { break; }"), std::runtime_error);
+    EXPECT_NO_THROW(parseSingleStatement("parfor (let i = 0; i < 9; i++) { continue; }"));
+    EXPECT_NO_THROW(parseSingleStatement("parfor (let i = 0; i < 9; i++) { while (1) break; }"));
+}
+
+TEST(ParserTest, RejectsTooDeeplyNestedSource) {
+    EXPECT_NO_THROW(parseSingleStatement("print " + std::string(200, '(') + "1" + std::string(200, ')') + ";"));
+    EXPECT_THROW(parseSingleStatement("print " + std::string(20000, '(') + "1" + std::string(20000, ')') + ";"),
+                 std::runtime_error);
+    EXPECT_THROW(parseSingleStatement("print " + std::string(20000, '-') + "1;"), std::runtime_error);
+    EXPECT_THROW(parseSingleStatement(std::string(20000, '{') + std::string(20000, '}')), std::runtime_error);
+
+    // long assignment and operator chains nest as deeply as parentheses
+    std::string assignments;
+    for (int i = 0; i < 200000; ++i) assignments += "a = ";
+    std::string sum = "1";
+    for (int i = 0; i < 300000; ++i) sum += " + 1";
+    for (const std::string& source : {"let a = 0; " + assignments + "1;", "print " + sum + ";"}) {
+        try {
+            parseStatements(source);
+            FAIL() << "expected an error";
+        } catch (const std::runtime_error& e) {
+            EXPECT_STREQ(e.what(), "Too deeply nested.");
+        }
+    }
+    EXPECT_NO_THROW(parseSingleStatement("print " + sum.substr(0, 1 + 4 * 500) + ";"));
+    EXPECT_NO_THROW(parseSingleStatement("a = a = a = 1 and 2 or 3 * 4 * 5 - 6 - 7;"));
 }
 
 TEST(ParserTest, ParsesEqualityAndComparison) {
@@ -248,3 +296,160 @@ TEST(ParserTest, ThrowsOnUnexpectedToken) {
 TEST(ParserTest, ThrowsOnExpectedExpression) {
     EXPECT_THROW(parseSingleStatement("print ;"), std::runtime_error);
 }
+
+std::vector<std::shared_ptr<Stmt>> parseLazy(const std::string& source) {
+    Scanner scanner(source);
+    auto tokens = std::make_shared<const std::vector<Token>>(scanner.scanTokens());
+    Parser parser(tokens, ParseMode::LazyFunctions);
+    return parser.parse();
+}
+
+TEST(ParserTest, LazyModeDefersFunctionBody) {
+    auto stmts = parseLazy("function add(a, b) { if (a) { return a + b; } return b; } print 1;");
+    ASSERT_EQ(stmts.size(), 2);
+    auto funcStmt = std::dynamic_pointer_cast<FunctionStmt>(stmts[0]);
+    ASSERT_NE(funcStmt, nullptr);
+    EXPECT_EQ(funcStmt->params.size(), 2);
+    EXPECT_TRUE(funcStmt->body.empty());
+    ASSERT_NE(funcStmt->deferredTokens, nullptr);
+
+    funcStmt->parsedBody();
+    EXPECT_EQ(funcStmt->deferredTokens, nullptr);
+    ASSERT_EQ(funcStmt->body.size(), 2);
+    EXPECT_NE(std::dynamic_pointer_cast<IfStmt>(funcStmt->body[0]), nullptr);
+}
+
+TEST(ParserTest, LazyModeThrowsOnUnterminatedBody) {
+    EXPECT_THROW(parseLazy("function f() { print 1;"), std::runtime_error);
+}
+
+TEST(ParserTest, LazyModeReportsBodyErrorsOnDeferredParse) {
+    auto stmts = parseLazy("function f() { print ; }");
+    auto funcStmt = std::dynamic_pointer_cast<FunctionStmt>(stmts[0]);
+    ASSERT_NE(funcStmt, nullptr);
+    EXPECT_THROW(Parser::parseDeferredBody(*funcStmt), std::runtime_error);
+    EXPECT_THROW(parseStatements("function f() { print ; }"), std::runtime_error);
+}
+
+TEST(ParserTest, ParallelParseMatchesSequentialParse) {
+    std::string source = R"(
+        let x = 1;
+        function a(n) { return n + 1; }
+        function b(n) { if (n) { return a(n); } return 0; }
+        print b(x);
+        if (x) function c() { return 1; }
+        function d() { while (x < 3) { x = x + 1; } return x; }
+    )";
+    auto sequential = parseStatements(source);
+
+    Scanner scanner(source);
+    auto tokens = scanner.scanTokens();
+    Parser parser(tokens);
+    auto parallel = parser.parseParallel(4);
+
+    ASSERT_EQ(parallel.size(), sequential.size());
+    for (size_t i = 0; i < parallel.size(); ++i) {
+        EXPECT_EQ(typeid(*parallel[i]), typeid(*sequential[i]));
+    }
+}
+
+TEST(ParserTest, ParallelParseReportsFirstErrorInSourceOrder) {
+    std::string source = R"(
+        function a() { return 1; }
+        function b() { print ; }
+        function c() { return 1 }
+    )";
+    std::string sequentialError;
+    try {
+        parseStatements(source);
+    } catch (const std::runtime_error& e) {
+        sequentialError = e.what();
+    }
+
+    Scanner scanner(source);
+    auto tokens = scanner.scanTokens();
+    Parser parser(tokens);
+    try {
+        parser.parseParallel(4);
+        FAIL() << "expected a syntax error";
+    } catch (const std::runtime_error& e) {
+        EXPECT_EQ(std::string(e.what()), sequentialError);
+    }
+}
+
+TEST(ParserTest, ParsesParforWithReductions) {
+    auto stmt = parseSingleStatement("parfor (let i = 0; i < 10; i = i + 2) reduce(+, sum), reduce(*, p) { let t = i; sum = sum + t; }");
+    auto parfor = std::dynamic_pointer_cast<ParforStmt>(stmt);
+    ASSERT_NE(parfor, nullptr);
+    EXPECT_EQ(parfor->var, "i");
+    EXPECT_EQ(parfor->comparison, "<");
+    ASSERT_EQ(parfor->reductions.size(), 2);
+    EXPECT_EQ(parfor->reductions[0].op, "+");
+    EXPECT_EQ(parfor->reductions[0].name, "sum");
+    EXPECT_EQ(parfor->reductions[1].op, "*");
+}
+
+TEST(ParserTest, ParforRejectsSharedWrites) {
+    EXPECT_THROW(parseStatements("let g = 0; parfor (let i = 0; i < 3; i++) { g = i; }"), std::runtime_error);
+    EXPECT_THROW(parseStatements("parfor (let i = 0; i < 3; i++) { i = 5; }"), std::runtime_error);
+    EXPECT_THROW(parseStatements("function f() { parfor (let i = 0; i < 3; i++) { return i; } }"), std::runtime_error);
+    EXPECT_THROW(parseStatements("parfor (let i = 0; i < 3; i = i * 2) { }"), std::runtime_error);
+    EXPECT_NO_THROW(parseStatements("parfor (let i = 0; i < 3; i++) { let x = i; x = x + 1; }"));
+}
+
+TEST(ParserTest, ParforRejectsChangesToSharedContainers) {
+    for (const char* body : {"push(out, i);", "pop(out);", "set(m, i, 1);", "delete(m, i);", "out[0] = i;",
+                             "out[i + 1] = i;", "grid[i][0] = 1;", "push(grid[i], 1);",
+                             "parfor (let j = 0; j < 3; j++) { out[j] = j; }"}) {
+        std::string source = std::string("let out = [0, 0, 0, 0]; let m = {}; let grid = [[0]];\n"
+                                         "parfor (let i = 0; i < 3; i++) { ") + body + " }";
+        try {
+            parseStatements(source);
+            FAIL() << body;
+        } catch (const std::runtime_error& e) {
+            EXPECT_NE(std::string(e.what()).find("parfor body cannot change"), std::string::npos) << body;
+        }
+    }
+    // each iteration writes only its own slot, and locals are its own
+    EXPECT_NO_THROW(parseStatements("let out = [0, 0, 0]; parfor (let i = 0; i < 3; i++) { out[i] = i * 2; }"));
+    EXPECT_NO_THROW(parseStatements("parfor (let i = 0; i < 3; i++) { let a = []; push(a, i); a[0] = 1; }"));
+    EXPECT_NO_THROW(parseStatements(
+        "let out = [0, 0, 0]; parfor (let i = 0; i < 3; i++) { parfor (let j = 0; j < 3; j++) { let x = out[i]; } }"));
+}
+
+TEST(ParserTest, ParsesArrayLiteralIndexAndIndexAssignment) {
+    auto literal = std::dynamic_pointer_cast<ArrayLiteral>(
+        std::dynamic_pointer_cast<VarStmt>(parseSingleStatement("let a = [1, \"x\", []];"))->initializer);
+    ASSERT_NE(literal, nullptr);
+    EXPECT_EQ(literal->elements.size(), 3);
+
+    auto stmt = std::dynamic_pointer_cast<ExpressionStmt>(parseSingleStatement("a[i][0] = 2;"));
+    ASSERT_NE(stmt, nullptr);
+    auto store = std::dynamic_pointer_cast<IndexAssign>(stmt->expression);
+    ASSERT_NE(store, nullptr);
+    EXPECT_NE(std::dynamic_pointer_cast<Index>(store->array), nullptr);
+    EXPECT_THROW(parseSingleStatement("print a[1;"), std::runtime_error);
+}
+
+TEST(ParserTest, ParsesMapLiteral) {
+    auto literal = std::dynamic_pointer_cast<MapLiteral>(
+        std::dynamic_pointer_cast<VarStmt>(parseSingleStatement("let m = {\"a\": 1, 2: [3]};"))->initializer);
+    ASSERT_NE(literal, nullptr);
+    ASSERT_EQ(literal->entries.size(), 2);
+    EXPECT_NE(std::dynamic_pointer_cast<ArrayLiteral>(literal->entries[1].second), nullptr);
+    EXPECT_NE(std::dynamic_pointer_cast<BlockStmt>(parseSingleStatement("{ print 1; }")), nullptr);
+    EXPECT_THROW(parseSingleStatement("let m = {\"a\" 1};"), std::runtime_error);
+}
+
+TEST(ParserTest, RecordsSourceLines) {
+    auto stmts = parseStatements("let x = 1;\n\nfunction f(a) {\n  return a\n    + 1;\n}\nfor (;;) { }\n");
+    ASSERT_EQ(stmts.size(), 3);
+    EXPECT_EQ(stmts[0]->line, 1);
+    EXPECT_EQ(std::dynamic_pointer_cast<VarStmt>(stmts[0])->initializer->line, 1);
+    auto function = std::dynamic_pointer_cast<FunctionStmt>(stmts[1]);
+    EXPECT_EQ(function->line, 3);
+    auto ret = std::dynamic_pointer_cast<ReturnStmt>(function->parsedBody()[0]);
+    EXPECT_EQ(ret->line, 4);
+    EXPECT_EQ(ret->value->line, 5);  // the '+'
+    EXPECT_EQ(stmts[2]->line, 7);
+}
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <sstream>
+#include "scanner.hpp"
+#include "parser.hpp"
+#include "interpreter.hpp"
+#include "profiler.hpp"
+#include "stmt.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+
+namespace {
+
+// Burns CPU time, which is what the profiling timer counts.
+void spin(std::chrono::milliseconds duration) {
+    auto end = std::chrono::steady_clock::now() + duration;
+    volatile double x = 0;
+    while (std::chrono::steady_clock::now() < end) x = x + 1;
+}
+
+} // namespace
+
+TEST(ProfilerTest, CountsSamplesPerStackAndLine) {
+    ShadowStack stack;
+    Profiler profiler(stack);
+    profiler.start();
+    {
+        ShadowFrame outer(&stack, "outer");
+        stack.setLine(3);
+        ShadowFrame inner(&stack, "inner");
+        stack.setLine(7);
+        spin(std::chrono::milliseconds(200));
+    }
+    stack.setLine(12);
+    spin(std::chrono::milliseconds(100));
+    profiler.stop();
+
+    std::ostringstream out;
+    profiler.writeFolded(out);
+    std::string folded = out.str();
+    EXPECT_GT(profiler.samples(), 0u);
+    EXPECT_EQ(profiler.dropped(), 0u);
+    EXPECT_NE(folded.find("main;outer;inner:7 "), std::string::npos) << folded;
+    EXPECT_NE(folded.find("main:12 "), std::string::npos) << folded;
+}
+
+TEST(ProfilerTest, SamplesARunningScript) {
+    std::string source =
+        "function fib(n) {\n"
+        "    if (n < 2) { return n; }\n"
+        "    return fib(n - 1) + fib(n - 2);\n"
+        "}\n"
+        "let total = 0;\n"
+        "while (total < 100000) {\n"
+        "    total = total + fib(15);\n"
+        "}\n"
+        "print total;\n";
+    Scanner scanner(source);
+    auto tokens = std::make_shared<const std::vector<Token>>(scanner.scanTokens());
+    Parser parser(tokens, ParseMode::Eager);
+    auto statements = parser.parse();
+
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    ShadowStack stack;
+    interpreter.shadowStack = &stack;
+    Profiler profiler(stack);
+    profiler.start();
+    interpreter.interpret(statements);
+    profiler.stop();
+
+    std::ostringstream folded;
+    profiler.writeFolded(folded);
+    EXPECT_GT(profiler.samples(), 0u);
+    EXPECT_NE(folded.str().find("main;fib;fib"), std::string::npos) << folded.str();
+    // every stack starts at main and ends in a line of the script
+    std::istringstream lines(folded.str());
+    for (std::string line; std::getline(lines, line);) {
+        EXPECT_EQ(line.rfind("main", 0), 0u) << line;
+        EXPECT_NE(line.find(':'), std::string::npos) << line;
+    }
+}
+
+TEST(ProfilerTest, OnlyOneProfilerRunsAtATime) {
+    ShadowStack stack;
+    Profiler first(stack);
+    Profiler second(stack);
+    first.start();
+    EXPECT_THROW(second.start(), std::runtime_error);
+    first.stop();
+    EXPECT_NO_THROW(second.start());
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include "scanner.hpp"
+#include "value.hpp"
 
 TEST(ScannerTest, SingleCharacterTokens) {
     Scanner scanner("()+-*/;{},");
@@ -42,11 +43,20 @@ TEST(ScannerTest, NumberLiteral) {
     auto tokens = scanner.scanTokens();
     ASSERT_EQ(tokens.size(), 3);
     EXPECT_EQ(tokens[0].type, TokenType::NUMBER);
-    EXPECT_DOUBLE_EQ(std::any_cast<double>(tokens[0].literal), 123);
+    EXPECT_EQ(std::any_cast<int64_t>(tokens[0].literal), 123);
     EXPECT_EQ(tokens[1].type, TokenType::NUMBER);
     EXPECT_DOUBLE_EQ(std::any_cast<double>(tokens[1].literal), 45.67);
 }
 
+TEST(ScannerTest, IntegerLiteralTooLargeIsADouble) {
+    Scanner scanner("9007199254740992 9007199254740993 99999999999999999999");
+    auto tokens = scanner.scanTokens();
+    ASSERT_EQ(tokens.size(), 4);
+    EXPECT_EQ(std::any_cast<int64_t>(tokens[0].literal), kMaxExactInteger);
+    EXPECT_DOUBLE_EQ(std::any_cast<double>(tokens[1].literal), 9007199254740992.0);
+    EXPECT_DOUBLE_EQ(std::any_cast<double>(tokens[2].literal), 1e20);
+}
+
 TEST(ScannerTest, IdentifiersAndKeywords) {
     Scanner scanner("let var foo");
     auto tokens = scanner.scanTokens();
@@ -69,3 +79,15 @@ TEST(ScannerTest, Whitespace) {
     EXPECT_EQ(tokens[2].type, TokenType::PRINT);
     EXPECT_EQ(tokens[3].type, TokenType::END_OF_FILE);
 }
+
+TEST(ScannerTest, DoesNotReadPastEndOfView) {
+    // viewing "7." out of "7.5": the '.' must not be taken as a decimal point
+    std::string buffer = "7.5";
+    Scanner scanner(std::string_view(buffer.data(), 2));
+    EXPECT_THROW(scanner.scanTokens(), std::runtime_error);
+
+    Scanner whole(std::string_view(buffer.data(), 1));
+    auto tokens = whole.scanTokens();
+    ASSERT_EQ(tokens.size(), 2);
+    EXPECT_EQ(std::any_cast<int64_t>(tokens[0].literal), 7);
+}
@@ -0,0 +1,205 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include "scanner.hpp"
+#include "parser.hpp"
+#include "interpreter.hpp"
+#include "serializer.hpp"
+
+namespace {
+
+const std::string kProgram = R"(
+    function fib(n) {
+        if (n < 2) { return n; }
+        return fib(n - 1) + fib(n - 2);
+    }
+    let label = "fib";
+    for (let i = 0; i < 5; i = i + 1) {
+        print label + " " + "x";
+        print fib(i) * -1;
+    }
+    let k = 3;
+    k++;
+    while (k > 0) k = k - 1;
+    print !k;
+    for (let j = 0; j < 9; j++) {
+        if (j == 1 or j == 3) continue;
+        if (j > 4 and k == 0) break;
+        print j;
+    }
+    let xs = [1, 2, "three"];
+    xs[0] = xs[1] + 10;
+    print xs;
+    let m = {"a": 1, 2: xs};
+    m["b"] = 3;
+    print m;
+    let total = 0;
+    parfor (let i = 0; i < 10; i++) reduce(+, total) { total = total + i; }
+    print total;
+)";
+
+std::vector<std::shared_ptr<Stmt>> compile(const std::string& source, ParseMode mode) {
+    Scanner scanner(source);
+    auto tokens = std::make_shared<const std::vector<Token>>(scanner.scanTokens());
+    Parser parser(tokens, mode);
+    return parser.parse();
+}
+
+std::string run(const std::vector<std::shared_ptr<Stmt>>& statements) {
+    std::stringstream ss;
+    std::streambuf* old = std::cout.rdbuf(ss.rdbuf());
+    Interpreter interpreter;
+    interpreter.interpret(statements);
+    std::cout.rdbuf(old);
+    return ss.str();
+}
+
+} // namespace
+
+TEST(SerializerTest, RoundTripRunsIdentically) {
+    auto original = compile(kProgram, ParseMode::LazyFunctions);
+    uint64_t hash = hashSource(kProgram);
+    std::string image = serializeProgram(original, hash);
+
+    std::vector<std::shared_ptr<Stmt>> loaded;
+    ASSERT_TRUE(deserializeProgram(image.data(), image.size(), hash, loaded));
+    ASSERT_EQ(loaded.size(), original.size());
+    EXPECT_EQ(run(loaded), run(compile(kProgram, ParseMode::Eager)));
+}
+
+TEST(SerializerTest, RoundTripKeepsSourceLines) {
+    auto original = compile(kProgram, ParseMode::Eager);
+    std::string image = serializeProgram(original, hashSource(kProgram));
+
+    std::vector<std::shared_ptr<Stmt>> loaded;
+    ASSERT_TRUE(deserializeProgram(image.data(), image.size(), hashSource(kProgram), loaded));
+    ASSERT_EQ(loaded.size(), original.size());
+    for (size_t i = 0; i < loaded.size(); ++i) EXPECT_EQ(loaded[i]->line, original[i]->line);
+    auto fib = std::dynamic_pointer_cast<FunctionStmt>(loaded[0]);
+    ASSERT_NE(fib, nullptr);
+    EXPECT_EQ(fib->line, 2);
+    EXPECT_EQ(fib->parsedBody()[1]->line, 4);
+    EXPECT_EQ(std::dynamic_pointer_cast<ReturnStmt>(fib->parsedBody()[1])->value->line, 4);
+}
+
+TEST(SerializerTest, LoadedNodesOutliveTheProgram) {
+    auto original = compile(kProgram, ParseMode::Eager);
+    std::string image = serializeProgram(original, hashSource(kProgram));
+
+    std::vector<std::shared_ptr<Stmt>> loaded;
+    ASSERT_TRUE(deserializeProgram(image.data(), image.size(), hashSource(kProgram), loaded));
+    auto fib = std::dynamic_pointer_cast<FunctionStmt>(loaded[0]);
+    ASSERT_NE(fib, nullptr);
+    loaded.clear();
+    image.clear();
+    EXPECT_EQ(run({fib, compile("print fib(10);", ParseMode::Eager)[0]}), "55\n");
+}
+
+TEST(SerializerTest, RejectsCacheForDifferentSource) {
+    auto program = compile(kProgram, ParseMode::Eager);
+    std::string image = serializeProgram(program, hashSource(kProgram));
+
+    std::vector<std::shared_ptr<Stmt>> loaded;
+    EXPECT_FALSE(deserializeProgram(image.data(), image.size(), hashSource(kProgram + " "), loaded));
+    EXPECT_TRUE(loaded.empty());
+}
+
+TEST(SerializerTest, RejectsTruncatedOrCorruptCache) {
+    auto program = compile(kProgram, ParseMode::Eager);
+    uint64_t hash = hashSource(kProgram);
+    std::string image = serializeProgram(program, hash);
+
+    std::vector<std::shared_ptr<Stmt>> loaded;
+    for (size_t size : {size_t(0), size_t(3), size_t(20), image.size() / 2, image.size() - 1}) {
+        EXPECT_FALSE(deserializeProgram(image.data(), size, hash, loaded)) << "size " << size;
+    }
+    std::string badVersion = image;
+    badVersion[4] ^= 0x7f;
+    EXPECT_FALSE(deserializeProgram(badVersion.data(), badVersion.size(), hash, loaded));
+}
+
+TEST(SerializerTest, ThrowsOnSyntaxErrorInLazyBody) {
+    std::string source = "function broken() { print ; } print 1;";
+    auto program = compile(source, ParseMode::LazyFunctions);
+    EXPECT_THROW(serializeProgram(program, hashSource(source)), std::runtime_error);
+}
+
+namespace {
+
+const std::string kPrelude = R"(
+    function scaled(x) { return x * factor; }
+    function greet(name) { return greeting + name; }
+    let factor = 3;
+    let greeting = "hi ";
+    let alias = scaled;
+    let numbers = [1.5, 2, 3];
+    let shared = {"count": 0, 1: "one"};
+    let mixed = ["a", shared, numbers];
+    let cycle = [];
+    push(cycle, cycle);
+    let root = sqrt;
+)";
+
+const std::string kAfterPrelude = R"(
+    print scaled(2) + alias(1);
+    print greet("there");
+    print numbers;
+    mixed[1]["count"] = 5;
+    print shared;
+    mixed[2][0] = 10;
+    print numbers[0];
+    print len(cycle[0][0]);
+    print root(16);
+)";
+
+std::string snapshotOf(const std::string& prelude) {
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    interpreter.interpret(compile(prelude, ParseMode::LazyFunctions));
+    return serializeSnapshot(interpreter.environment);
+}
+
+} // namespace
+
+TEST(SerializerTest, SnapshotRestoresGlobals) {
+    auto image = std::make_shared<const std::string>(snapshotOf(kPrelude));
+    EXPECT_EQ(snapshotOf(kPrelude), *image);
+
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    ASSERT_TRUE(deserializeSnapshot(image->data(), image->size(), image, interpreter.environment));
+    image.reset();  // function bodies are read on first call, from the image it keeps alive
+    interpreter.interpret(compile(kAfterPrelude, ParseMode::LazyFunctions));
+    EXPECT_EQ(out.str(), "9\nhi there\n[1.5, 2, 3]\n{count: 5, 1: one}\n10\n1\n4\n");
+    EXPECT_EQ(out.str(), run(compile(kPrelude + kAfterPrelude, ParseMode::LazyFunctions)));
+}
+
+TEST(SerializerTest, SnapshotChargesTheMemoryCap) {
+    std::string image = snapshotOf(kPrelude);
+    Interpreter interpreter;
+    interpreter.maxMemory = 1 << 20;
+    ASSERT_TRUE(deserializeSnapshot(image.data(), image.size(), nullptr, interpreter.environment));
+    EXPECT_EQ(interpreter.memoryUsed, environmentFootprint(interpreter.environment));
+    // and so do its arrays and maps
+    ASSERT_NE(interpreter.containerMemory, nullptr);
+    EXPECT_GT(interpreter.containerMemory->used, 0u);
+}
+
+TEST(SerializerTest, RejectsTruncatedOrCorruptSnapshot) {
+    std::string image = snapshotOf(kPrelude);
+    Environment globals;
+    for (size_t size = 0; size < image.size(); ++size) {
+        EXPECT_FALSE(deserializeSnapshot(image.data(), size, nullptr, globals)) << "size " << size;
+    }
+    EXPECT_TRUE(globals.empty());
+
+    auto program = compile(kProgram, ParseMode::Eager);
+    std::string cache = serializeProgram(program, 0);
+    EXPECT_FALSE(deserializeSnapshot(cache.data(), cache.size(), nullptr, globals));
+    std::vector<std::shared_ptr<Stmt>> loaded;
+    EXPECT_FALSE(deserializeProgram(image.data(), image.size(), 0, loaded));
+}
+
+TEST(SerializerTest, SnapshotRejectsTasksAndChannels) {
+    EXPECT_THROW(snapshotOf("let ch = channel(1);"), std::runtime_error);
+    EXPECT_THROW(snapshotOf("function f() { return 1; } let boxed = [spawn f()];"), std::runtime_error);
+}
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include "scanner.hpp"
+#include "parser.hpp"
+#include "interpreter.hpp"
+#include "stats.hpp"
+#include "stmt.hpp"
+
+namespace {
+
+Stats runWithStats(const std::string& source) {
+    Scanner scanner(source);
+    auto tokens = scanner.scanTokens();
+    Parser parser(tokens);
+    auto statements = parser.parse();
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    Stats stats;
+    interpreter.stats = &stats;
+    interpreter.interpret(statements);
+    return stats;
+}
+
+uint64_t nodes(const Stats& stats, NodeKind kind) {
+    return stats.nodes[static_cast<size_t>(kind)];
+}
+
+} // namespace
+
+TEST(StatsTest, CountsCallsDepthAndEnvironments) {
+    if (!kStatsEnabled) GTEST_SKIP() << "built with CODELANG_STATS off";
+    Stats stats = runWithStats(
+        "function fib(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }\n"
+        "print fib(5);\n");
+    EXPECT_EQ(stats.calls, 15u);
+    EXPECT_EQ(stats.maxDepth, 5u);
+    EXPECT_EQ(stats.depth, 0u);
+    EXPECT_EQ(stats.environments, 15u);
+    EXPECT_GT(stats.environmentBytes, 0u);
+    EXPECT_EQ(nodes(stats, NodeKind::Call), 15u);
+    EXPECT_EQ(nodes(stats, NodeKind::IfStmt), 15u);
+    EXPECT_EQ(nodes(stats, NodeKind::FunctionStmt), 1u);
+    EXPECT_EQ(nodes(stats, NodeKind::PrintStmt), 1u);
+}
+
+TEST(StatsTest, CountsStringsLookupsAndLoops) {
+    if (!kStatsEnabled) GTEST_SKIP() << "built with CODELANG_STATS off";
+    Stats stats = runWithStats(
+        "let s = \"\";\n"
+        "let i = 0;\n"
+        "while (i < 4) { s = s + \"ab\"; i = i + 1; }\n"
+        "let total = 0;\n"
+        "parfor (let j = 0; j < 10; j++) reduce(+, total) { total = total + j; }\n");
+    EXPECT_EQ(stats.loopIterations, 14u);
+    EXPECT_EQ(stats.strings, 4u);
+    EXPECT_EQ(stats.stringBytes, 2u + 4u + 6u + 8u);
+    // 3 lets, 5 loop tests of i, then 4 iterations reading and writing s and i
+    EXPECT_GE(stats.lookups, 3u + 5u + 4 * 4u);
+    EXPECT_EQ(stats.calls, 0u);
+}
+
+TEST(StatsTest, WritesJson) {
+    Stats stats;
+    stats.calls = 3;
+    stats.nodes[static_cast<size_t>(NodeKind::Binary)] = 7;
+    std::ostringstream json;
+    stats.writeJson(json);
+    EXPECT_NE(json.str().find("\"calls\": 3"), std::string::npos) << json.str();
+    EXPECT_NE(json.str().find("\"nodes\": {\"Binary\": 7}"), std::string::npos) << json.str();
+    EXPECT_EQ(json.str().find('\n'), std::string::npos);
+}
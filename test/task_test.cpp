@@ -0,0 +1,254 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include "scanner.hpp"
+#include "parser.hpp"
+#include "interpreter.hpp"
+#include "fiber.hpp"
+#include "task.hpp"
+
+namespace {
+
+std::string runTasks(const std::string& source, uint64_t maxSteps = 0) {
+    Scanner scanner(source);
+    auto tokens = scanner.scanTokens();
+    Parser parser(tokens);
+    auto stmts = parser.parse();
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    interpreter.taskThreads = 4;
+    interpreter.maxSteps = maxSteps;
+    interpreter.interpret(stmts);
+    return out.str();
+}
+
+} // namespace
+
+TEST(FiberTest, SuspendsAndResumes) {
+    std::string trace;
+    Fiber* self = nullptr;
+    Fiber fiber([&] {
+        trace += "a";
+        self->suspend();
+        trace += "c";
+    }, 64 * 1024);
+    self = &fiber;
+
+    fiber.resume();
+    trace += "b";
+    EXPECT_FALSE(fiber.finished());
+    fiber.resume();
+    EXPECT_TRUE(fiber.finished());
+    EXPECT_EQ(trace, "abc");
+}
+
+TEST(TaskTest, AwaitReturnsTheTaskResult) {
+    auto output = runTasks(R"(
+        function fib(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }
+        let a = spawn fib(15);
+        let b = spawn fib(16);
+        print await a + await b;
+    )");
+    EXPECT_EQ(output, "1597\n");
+}
+
+TEST(TaskTest, TaskOutputIsWrittenWhenAwaited) {
+    auto output = runTasks(R"(
+        function work(name) { print name; return 0; }
+        let t = spawn work("task");
+        print "main";
+        await t;
+        spawn work("never awaited");
+    )");
+    EXPECT_EQ(output, "main\ntask\nnever awaited\n");
+}
+
+TEST(TaskTest, ChannelsPassValuesBetweenTasks) {
+    auto output = runTasks(R"(
+        function produce(ch, n) {
+            let i = 1;
+            while (i <= n) { send(ch, i); i = i + 1; }
+            send(ch, 0);
+            return n;
+        }
+        function consume(input, output) {
+            let sum = 0;
+            let v = recv(input);
+            while (v != 0) { sum = sum + v; v = recv(input); }
+            send(output, sum);
+            return 0;
+        }
+        let numbers = channel(4);
+        let results = channel(1);
+        spawn produce(numbers, 100);
+        spawn consume(numbers, results);
+        print recv(results);
+    )");
+    EXPECT_EQ(output, "5050\n");
+}
+
+TEST(TaskTest, GlobalsAreCopiedIntoTasks) {
+    auto output = runTasks(R"(
+        let x = 1;
+        function bump() { x = x + 10; return x; }
+        print await spawn bump();
+        print x;
+    )");
+    EXPECT_EQ(output, "11\n1\n");
+}
+
+TEST(TaskTest, TasksShareTheStepBudget) {
+    std::string loop = "function spin(n) { let i = 0; while (i < n) { i = i + 1; } return i; }\n";
+    EXPECT_EQ(runTasks(loop + "let a = spawn spin(300); let b = spawn spin(300); print await a + await b;", 1000),
+              "600\n");
+    EXPECT_THROW(runTasks(loop + "await spawn spin(2000);", 1000), LimitError);
+    // spawning more tasks doesn't buy more steps
+    EXPECT_THROW(runTasks(loop + "let a = spawn spin(600); let b = spawn spin(600); print await a + await b;", 1000),
+                 LimitError);
+    EXPECT_THROW(runTasks(loop + "for (let t = 0; t < 10; t++) { spawn spin(300); }", 1000), LimitError);
+    EXPECT_THROW(runTasks(loop + "function fan() { spawn spin(400); spawn spin(400); } spawn fan(); spawn fan();", 1000),
+                 LimitError);
+}
+
+TEST(TaskTest, AwaitAddsTheTaskStepsToTheCount) {
+    Scanner scanner(R"(
+        function spin(n) { let i = 0; while (i < n) { i = i + 1; } return i; }
+        let a = spawn spin(100);
+        let b = spawn spin(200);
+        await a;
+    )");
+    auto tokens = scanner.scanTokens();
+    Parser parser(tokens);
+    auto stmts = parser.parse();
+    for (uint64_t maxSteps : {uint64_t{0}, uint64_t{1000}}) {
+        std::ostringstream out;
+        Interpreter interpreter(out);
+        interpreter.taskThreads = 4;
+        interpreter.maxSteps = maxSteps;
+        interpreter.interpret(stmts);
+        // each task: one step for the call, one per iteration
+        EXPECT_EQ(interpreter.steps, 302u);
+    }
+}
+
+TEST(TaskTest, ErrorsSurfaceAtAwait) {
+    try {
+        runTasks("function bad() { return missing; } let t = spawn bad(); await t;");
+        FAIL() << "expected an error";
+    } catch (const std::runtime_error& e) {
+        EXPECT_STREQ(e.what(), "Undefined variable: missing");
+    }
+}
+
+TEST(TaskTest, ReportsDeadlock) {
+    try {
+        runTasks("let ch = channel(1); recv(ch);");
+        FAIL() << "expected a deadlock";
+    } catch (const std::runtime_error& e) {
+        EXPECT_STREQ(e.what(), "Deadlock: all tasks are blocked");
+    }
+    EXPECT_THROW(runTasks(R"(
+        function wait(ch) { return recv(ch); }
+        await spawn wait(channel(1));
+    )"), std::runtime_error);
+}
+
+TEST(ParforTest, ReductionsMatchASequentialLoop) {
+    auto output = runTasks(R"(
+        let sum = 0;
+        let product = 1;
+        let text = "";
+        parfor (let i = 1; i <= 200; i = i + 1) reduce(+, sum), reduce(*, product), reduce(+, text) {
+            sum = sum + i / 7;
+            if (i <= 10) { product = product * i; }
+            if (i == 1) { text = text + "a"; }
+            if (i == 100) { text = text + "b"; }
+            if (i == 200) { text = text + "c"; }
+        }
+        print sum;
+        print product;
+        print text;
+    )");
+    std::ostringstream expected;
+    double sum = 0;
+    for (int i = 1; i <= 200; ++i) sum += i / 7.0;
+    expected << sum << "\n3.6288e+06\nabc\n";
+    EXPECT_EQ(output, expected.str());
+}
+
+TEST(ParforTest, OutputIsInIterationOrder) {
+    auto output = runTasks(R"(
+        parfor (let i = 9; i >= 0; i--) { print i; }
+    )");
+    EXPECT_EQ(output, "9\n8\n7\n6\n5\n4\n3\n2\n1\n0\n");
+}
+
+TEST(ParforTest, CountsTowardTheStepBudget) {
+    std::string loop = "parfor (let i = 0; i < 600; i++) { let x = i; }\n";
+    EXPECT_EQ(runTasks(loop + "print 1;", 1000), "1\n");
+    EXPECT_THROW(runTasks(loop + loop, 1000), LimitError);
+}
+
+TEST(ParforTest, ErrorsStopTheLoop) {
+    try {
+        runTasks("parfor (let i = 0; i < 100; i++) { if (i == 70) { print missing; } }");
+        FAIL() << "expected an error";
+    } catch (const std::runtime_error& e) {
+        EXPECT_STREQ(e.what(), "Undefined variable: missing");
+    }
+}
+
+TEST(ParforTest, RejectsRangesItCannotCount) {
+    const std::string numbers =
+        "let e = 1000000; let big = e * e * e * e * e * e * e * e * e * e;\n"
+        "let huge = big * big * big * big * big; let inf = huge * huge;\n";  // 1e300 and infinity
+    const std::pair<const char*, const char*> cases[] = {
+        {"parfor (let i = 0; i < huge; i++) { }", "parfor has too many iterations."},
+        {"parfor (let i = 0; i < 1; i = i + 1 / huge) { }", "parfor has too many iterations."},
+        {"parfor (let i = -huge * 100000000; i < huge * 100000000; i = i + 1) { }", "parfor has too many iterations."},
+        {"parfor (let i = 0; i < inf; i++) { }", "parfor start, bound and step must be finite."},
+        {"parfor (let i = -inf; i < 0; i++) { }", "parfor start, bound and step must be finite."},
+        {"parfor (let i = 0; i < 1; i = i + inf) { }", "parfor start, bound and step must be finite."},
+    };
+    for (const auto& [loop, message] : cases) {
+        try {
+            runTasks(numbers + loop);
+            FAIL() << loop;
+        } catch (const std::runtime_error& e) {
+            EXPECT_STREQ(e.what(), message) << loop;
+        }
+    }
+}
+
+TEST(ParforTest, RejectsBreak) {
+    EXPECT_THROW(runTasks("parfor (let i = 0; i < 4; i++) { if (i == 1) break; }"), std::runtime_error);
+
+    // a body the parser didn't check, as a corrupt cache might hold
+    auto body = std::make_shared<BlockStmt>(std::vector<std::shared_ptr<Stmt>>{
+        std::make_shared<PrintStmt>(std::make_shared<Variable>("i")), std::make_shared<BreakStmt>()});
+    auto parfor = std::make_shared<ParforStmt>("i", std::make_shared<Literal>(int64_t{0}), "<",
+                                               std::make_shared<Literal>(int64_t{4}),
+                                               std::make_shared<Literal>(int64_t{1}),
+                                               std::vector<ParforStmt::Reduction>{}, body);
+    for (bool stackless : {false, true}) {
+        std::ostringstream out;
+        Interpreter interpreter(out);
+        interpreter.stackless = stackless;
+        try {
+            interpreter.interpret({parfor});
+            FAIL() << "expected an error, stackless = " << stackless;
+        } catch (const std::runtime_error& e) {
+            EXPECT_STREQ(e.what(), "Cannot break out of parfor.");
+        }
+    }
+}
+
+TEST(ParforTest, FillsASharedArray) {
+    auto output = runTasks(R"(
+        let squares = [];
+        let i = 0;
+        while (i < 100) { push(squares, 0); i = i + 1; }
+        parfor (let i = 0; i < 100; i++) { squares[i] = i * i; }
+        print squares[99] + squares[7];
+    )");
+    EXPECT_EQ(output, "9850\n");
+}
@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include "thread_pool.hpp"
+
+TEST(ThreadPoolTest, RunsEverySubmittedJob) {
+    ThreadPool pool(4);
+    std::atomic<int> sum{0};
+    for (int i = 1; i <= 100; ++i) {
+        pool.submit([&sum, i] { sum += i; });
+    }
+    pool.wait();
+    EXPECT_EQ(sum.load(), 5050);
+}
+
+TEST(ThreadPoolTest, CanBeReusedAfterWait) {
+    ThreadPool pool(2);
+    std::atomic<int> count{0};
+    pool.submit([&count] { count++; });
+    pool.wait();
+    pool.submit([&count] { count++; });
+    pool.wait();
+    EXPECT_EQ(count.load(), 2);
+}
+
+TEST(ThreadPoolTest, RunsJobsSubmittedFromWorkers) {
+    ThreadPool pool(3);
+    std::atomic<int> leaves{0};
+    for (int i = 0; i < 8; ++i) {
+        pool.submit([&pool, &leaves] {
+            for (int j = 0; j < 8; ++j) {
+                pool.submit([&leaves] { leaves++; });
+            }
+        });
+    }
+    pool.wait();
+    EXPECT_EQ(leaves.load(), 64);
+}
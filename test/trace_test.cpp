@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <thread>
+#include "scanner.hpp"
+#include "parser.hpp"
+#include "interpreter.hpp"
+#include "stmt.hpp"
+#include "trace.hpp"
+
+namespace {
+
+size_t countOf(const std::string& text, const std::string& part) {
+    size_t n = 0;
+    for (size_t at = text.find(part); at != std::string::npos; at = text.find(part, at + 1)) n++;
+    return n;
+}
+
+std::string traceRun(const std::string& source, uint32_t callSample,
+                     size_t capacity = Tracer::kDefaultCapacity) {
+    Tracer tracer(callSample, capacity);
+    tracer.start();
+    {
+        Scanner scanner(source);
+        auto tokens = scanner.scanTokens();
+        Parser parser(tokens);
+        auto statements = parser.parse();
+        std::ostringstream out;
+        Interpreter interpreter(out);
+        interpreter.taskThreads = 4;
+        interpreter.interpret(statements);
+    }
+    tracer.stop();
+    std::ostringstream json;
+    tracer.writeJson(json);
+    return json.str();
+}
+
+const std::string kProgram =
+    "function twice(x) { return x * 2; }\n"
+    "let a = twice(1);\n"
+    "let b = twice(a) + twice(a);\n";
+
+} // namespace
+
+TEST(TraceTest, RecordsPhasesStatementsAndCalls) {
+    std::string json = traceRun(kProgram, 1);
+    EXPECT_EQ(json.rfind("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [", 0), 0u);
+    EXPECT_EQ(countOf(json, "\"name\": \"Scanner::scanTokens\""), 1u);
+    EXPECT_EQ(countOf(json, "\"name\": \"Parser::parse\""), 1u);
+    EXPECT_EQ(countOf(json, "\"cat\": \"statement\""), 3u);
+    EXPECT_EQ(countOf(json, "\"name\": \"twice\""), 3u);
+    EXPECT_NE(json.find("\"args\": {\"line\": 3}"), std::string::npos);
+    EXPECT_NE(json.find("\"args\": {\"name\": \"main\"}"), std::string::npos);
+}
+
+TEST(TraceTest, SamplesCalls) {
+    EXPECT_EQ(countOf(traceRun(kProgram, 2), "\"name\": \"twice\""), 2u);
+    EXPECT_EQ(countOf(traceRun(kProgram, 0), "\"name\": \"twice\""), 0u);
+}
+
+TEST(TraceTest, CallsDoNotPushOutOtherEvents) {
+    std::string json = traceRun(kProgram + "let i = 0;\nwhile (i < 20) { i = twice(i) + 1; }\n", 1, 8);
+    EXPECT_EQ(countOf(json, "\"name\": \"Scanner::scanTokens\""), 1u);
+    EXPECT_EQ(countOf(json, "\"cat\": \"statement\""), 5u);
+    EXPECT_EQ(countOf(json, "\"name\": \"twice\""), 8u);
+}
+
+TEST(TraceTest, RecordsNothingWhenStopped) {
+    Tracer tracer;
+    { TraceSpan span("before", "test"); }
+    tracer.start();
+    { TraceSpan span("during", "test"); }
+    tracer.stop();
+    { TraceSpan span("after", "test"); }
+    std::ostringstream json;
+    tracer.writeJson(json);
+    EXPECT_EQ(countOf(json.str(), "\"cat\": \"test\""), 1u);
+    EXPECT_NE(json.str().find("\"during\""), std::string::npos);
+}
+
+TEST(TraceTest, KeepsTheNewestEventsOfEachThread) {
+    Tracer tracer(1, 4);
+    tracer.start();
+    for (int i = 0; i < 10; ++i) TraceSpan span(i < 6 ? "old" : "new", "test");
+    std::thread other([] { TraceSpan span("other thread", "test"); });
+    other.join();
+    tracer.stop();
+    std::ostringstream json;
+    tracer.writeJson(json);
+    EXPECT_EQ(countOf(json.str(), "\"name\": \"new\""), 4u);
+    EXPECT_EQ(countOf(json.str(), "\"name\": \"old\""), 0u);
+    EXPECT_EQ(countOf(json.str(), "\"name\": \"other thread\", \"cat\": \"test\", \"ph\": \"X\""), 1u);
+    EXPECT_NE(json.str().find("\"args\": {\"name\": \"thread 1\"}"), std::string::npos);
+    EXPECT_EQ(tracer.dropped(), 6u);
+}
+
+TEST(TraceTest, RecordsCallsThatSuspendInATask) {
+    // take() parks in recv() and may resume on another pool thread, where
+    // its span ends and is recorded
+    std::string json = traceRun(
+        "let ch = channel(1);\n"
+        "function take() { return recv(ch); }\n"
+        "function produce(n) { for (let i = 0; i < n; i++) { send(ch, i); } return n; }\n"
+        "function consume(n) { let total = 0; for (let i = 0; i < n; i++) { total = total + take(); } return total; }\n"
+        "let first = spawn consume(200);\n"
+        "let second = spawn consume(200);\n"
+        "let producer = spawn produce(400);\n"
+        "let total = await first + await second + await producer;\n",
+        1);
+    EXPECT_EQ(countOf(json, "\"name\": \"take\""), 400u);
+    EXPECT_EQ(countOf(json, "\"cat\": \"statement\""), 8u);
+}
@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include "scanner.hpp"
+#include "parser.hpp"
+#include "interpreter.hpp"
+#include "stmt.hpp"
+#include "vm.hpp"
+
+namespace {
+
+std::vector<std::shared_ptr<Stmt>> parseProgram(const std::string& source) {
+    Scanner scanner(source);
+    auto tokens = scanner.scanTokens();
+    Parser parser(tokens);
+    return parser.parse();
+}
+
+std::string runProgram(const std::string& source, bool stackless) {
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    interpreter.stackless = stackless;
+    interpreter.interpret(parseProgram(source));
+    return out.str();
+}
+
+const std::string kProgram =
+    "function fib(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }\n"
+    "function greet(name) { return \"hi \" + name; }\n"
+    "function noResult() { let unused = 1; }\n"
+    "print fib(15);\n"
+    "print greet(\"vm\");\n"
+    "print noResult();\n"
+    "let total = 0;\n"
+    "for (let i = 0; i < 10; i++) {\n"
+    "    if (i == 2 or i == 4) { continue; }\n"
+    "    if (i > 7 and total > 0) { break; }\n"
+    "    total = total + i;\n"
+    "}\n"
+    "print total;\n"
+    "print -total;\n"
+    "print !total;\n"
+    "let a = [1, 2, fib(5)];\n"
+    "a[0] = 10;\n"
+    "push(a, len(a));\n"
+    "print a[0] + a[2] + a[3];\n"
+    "let m = {\"x\": 1, \"y\": greet(\"map\")};\n"
+    "m[\"z\"] = 3;\n"
+    "print m[\"y\"];\n"
+    "print m[\"x\"] + m[\"z\"];\n"
+    "let t = spawn fib(10);\n"
+    "print await t;\n"
+    "let sum = 0;\n"
+    "parfor (let j = 0; j < 20; j = j + 1) reduce(+, sum) {\n"
+    "    if (j == 3) { continue; }\n"
+    "    sum = sum + fib(j);\n"
+    "}\n"
+    "print sum;\n";
+
+} // namespace
+
+TEST(VmTest, RunsProgramsLikeTheTreeWalker) {
+    std::string expected = runProgram(kProgram, false);
+    EXPECT_EQ(expected, "610\nhi vm\n0\n22\n-22\n0\n18\nhi map\n4\n55\n10943\n");
+    EXPECT_EQ(runProgram(kProgram, true), expected);
+}
+
+TEST(VmTest, TopLevelReturnEndsTheProgramInBothModes) {
+    const std::string program =
+        "function f() { return 1; }\n"
+        "print f();\n"
+        "for (let i = 0; i < 5; i++) { if (i == 2) { return i; } print i; }\n"
+        "print 3;\n";
+    EXPECT_EQ(runProgram(program, false), "1\n0\n1\n");
+    EXPECT_EQ(runProgram(program, true), "1\n0\n1\n");
+}
+
+TEST(VmTest, RecursesFarDeeperThanTheNativeStack) {
+    std::string source =
+        "function down(n) { if (n == 0) { return 0; } return down(n - 1) + 1; }\n"
+        "print down(300000);\n";
+    EXPECT_EQ(runProgram(source, true), "300000\n");
+}
+
+TEST(VmTest, ReportsStackOverflowPastMaxDepth) {
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    interpreter.stackless = true;
+    interpreter.maxDepth = 1000;
+    interpreter.maxMemory = 1 << 26;
+    interpreter.interpret(parseProgram("function down(n) { if (n == 0) { return 0; } return down(n - 1); }"));
+    size_t before = interpreter.memoryUsed;
+    try {
+        interpreter.interpret(parseProgram("down(2000);"));
+        FAIL() << "expected LimitError";
+    } catch (const LimitError& e) {
+        EXPECT_STREQ(e.what(), "Stack overflow");
+    }
+    EXPECT_EQ(interpreter.memoryUsed, before);
+    interpreter.interpret(parseProgram("print down(999);"));
+    EXPECT_EQ(out.str(), "0\n");
+}
+
+TEST(VmTest, RecursesThroughBuiltInArguments) {
+    // a call in a built-in's arguments stays on the Vm's frames
+    std::string source =
+        "function down(n) { if (n == 0) { return 0; } return abs(down(n - 1)) + 1; }\n"
+        "print down(200000);\n";
+    EXPECT_EQ(runProgram(source, true), "200000\n");
+
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    interpreter.stackless = true;
+    interpreter.maxDepth = 100;
+    try {
+        interpreter.interpret(parseProgram(source));
+        FAIL() << "expected LimitError";
+    } catch (const LimitError& e) {
+        EXPECT_STREQ(e.what(), "Stack overflow");
+    }
+    try {
+        runProgram("print abs(1, 2);", true);
+        FAIL() << "expected an arity error";
+    } catch (const std::runtime_error& e) {
+        EXPECT_STREQ(e.what(), "abs() expects 1 argument.");
+    }
+}
+
+TEST(VmTest, ChecksArity) {
+    EXPECT_THROW(runProgram("function f(a, b) { return a; } f(1);", true), std::runtime_error);
+    for (bool stackless : {false, true}) {
+        for (const char* call : {"f(1);", "f(1, 2, 3);"}) {
+            try {
+                runProgram(std::string("function f(a, b) { return a; } ") + call, stackless);
+                FAIL() << call << " ran with stackless = " << stackless;
+            } catch (const std::runtime_error& e) {
+                EXPECT_EQ(std::string(e.what()).substr(0, 20), "Expected 2 arguments") << call;
+            }
+        }
+    }
+}
+
+TEST(VmTest, SuspendsAndResumes) {
+    std::ostringstream out;
+    Interpreter interpreter(out);
+    interpreter.interpret(parseProgram("function count(n) { let i = 0; while (i < n) { i = i + 1; } return i; }"));
+    auto statements = parseProgram("print count(50);");
+    auto code = compileStatement(statements[0]);
+
+    Vm vm(interpreter);
+    vm.start(*code, interpreter.environment);
+    size_t slices = 1;
+    while (!vm.resume(10)) {
+        EXPECT_GE(vm.depth(), 1u);
+        slices++;
+    }
+    interpreter.output.flush();
+    EXPECT_EQ(out.str(), "50\n");
+    EXPECT_GT(slices, 20u);
+    EXPECT_EQ(vm.depth(), 0u);
+}
@@ -10,10 +10,11 @@ export function registerCodelang(monaco) {
 
   monaco.languages.setLanguageConfiguration(LANG_ID, {
     comments: { lineComment: '//' },
-    brackets: [['{', '}'], ['(', ')']],
+    brackets: [['{', '}'], ['(', ')'], ['[', ']']],
     autoClosingPairs: [
       { open: '{', close: '}' },
       { open: '(', close: ')' },
+      { open: '[', close: ']' },
       { open: '"', close: '"' },
     ],
   })
@@ -21,7 +22,8 @@ export function registerCodelang(monaco) {
   monaco.languages.setMonarchTokensProvider(LANG_ID, {
     keywords: [
       'let', 'var', 'print', 'function', 'return',
-      'if', 'else', 'while', 'for', 'true', 'false', 'and', 'or',
+      'if', 'else', 'while', 'for', 'break', 'continue', 'true', 'false', 'and', 'or',
+      'spawn', 'await', 'parfor', 'reduce',
     ],
     tokenizer: {
       root: [
@@ -31,7 +33,7 @@ export function registerCodelang(monaco) {
         [/\d+(\.\d+)?/, 'number'],
         [/[a-zA-Z_]\w*/, { cases: { '@keywords': 'keyword', '@default': 'identifier' } }],
         [/(\+\+|--|==|!=|<=|>=|[+\-*/=<>!])/, 'operator'],
-        [/[;,(){}]/, 'delimiter'],
+        [/[;,:(){}[\]]/, 'delimiter'],
       ],
       string: [
         [/[^"]+/, 'string'],
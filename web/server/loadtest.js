@@ -0,0 +1,65 @@
+// Load test for the run path: p50/p99 latency and requests/sec.
+//   node loadtest.js                      compare spawn-per-run vs the worker
+//                                         pool directly (no HTTP, no express)
+//   node loadtest.js http://localhost:8001  hit a running server's /api/run
+// Options: --requests N (default 500), --concurrency C (default 8).
+import path from 'path'
+import { fileURLToPath } from 'url'
+import { WorkerPool, runOnce } from './workers.js'
+
+const __dirname = path.dirname(fileURLToPath(import.meta.url))
+const BIN = process.env.CODELANG_BIN || path.join(__dirname, 'bin', 'codelang')
+
+const argv = process.argv.slice(2)
+const option = (name, fallback) => {
+  const i = argv.indexOf(name)
+  return i >= 0 ? Number(argv[i + 1]) : fallback
+}
+const REQUESTS = option('--requests', 500)
+const CONCURRENCY = option('--concurrency', 8)
+const url = argv.find((a) => a.startsWith('http'))
+
+const PROGRAM = `
+function fib(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }
+for (let i = 0; i < 10; i = i + 1) { print fib(i); }
+`
+
+async function measure(label, run) {
+  const latencies = []
+  let next = 0
+  const started = process.hrtime.bigint()
+  const client = async () => {
+    while (next < REQUESTS) {
+      next++
+      const t = process.hrtime.bigint()
+      await run(PROGRAM)
+      latencies.push(Number(process.hrtime.bigint() - t) / 1e6)
+    }
+  }
+  await Promise.all(Array.from({ length: CONCURRENCY }, client))
+  const seconds = Number(process.hrtime.bigint() - started) / 1e9
+  latencies.sort((a, b) => a - b)
+  const pct = (p) => latencies[Math.min(latencies.length - 1, Math.floor(p * latencies.length))]
+  console.log(
+    `${label.padEnd(16)} p50 ${pct(0.5).toFixed(2)} ms  p99 ${pct(0.99).toFixed(2)} ms  ` +
+      `${(REQUESTS / seconds).toFixed(0)} req/s`,
+  )
+}
+
+const options = { bin: BIN, args: ['--strict', '--max-output', '65536'], timeoutMs: 5000 }
+
+if (url) {
+  await measure('http', async (code) => {
+    const res = await fetch(`${url}/api/run`, {
+      method: 'POST',
+      headers: { 'content-type': 'application/json' },
+      body: JSON.stringify({ code }),
+    })
+    await res.json()
+  })
+} else {
+  await measure('spawn per run', (code) => runOnce(options, code))
+  const pool = new WorkerPool({ ...options, size: CONCURRENCY })
+  await measure('worker pool', (code) => pool.run(code))
+  process.exit(0)
+}
@@ -1,14 +1,15 @@
 // Codelang playground server.
-// POST /api/run pipes the submitted program into the compiled C++ interpreter
-// (script mode: `codelang --script` reads the whole program on stdin) and
-// returns whatever it printed. Untrusted code is contained by the language
-// itself (no file/network/system access exists in Codelang) plus a hard
-// timeout and an output cap here.
+// POST /api/run hands the submitted program to the compiled C++ interpreter
+// (a pool of warm `codelang --serve` workers, see workers.js; --strict parses
+// every function body up front so syntax errors show even in functions that
+// are never called) and returns whatever it printed. Untrusted code is
+// contained by the language itself (no file/network/system access exists in
+// Codelang), the interpreter's output/step/memory limits, and a hard timeout here.
 import express from 'express'
-import { spawn } from 'child_process'
 import { existsSync } from 'fs'
 import path from 'path'
 import { fileURLToPath } from 'url'
+import { WorkerPool, runOnce } from './workers.js'
 
 const __dirname = path.dirname(fileURLToPath(import.meta.url))
 
@@ -17,6 +18,22 @@ const BIN = process.env.CODELANG_BIN || path.join(__dirname, 'bin', 'codelang')
 const RUN_TIMEOUT_MS = Number(process.env.RUN_TIMEOUT_MS || 5000)
 const MAX_CODE_BYTES = 64 * 1024
 const MAX_OUTPUT_BYTES = 64 * 1024
+// warm `codelang --serve` processes; 0 spawns a fresh process per run instead
+const WORKER_POOL_SIZE = Number(process.env.WORKER_POOL_SIZE ?? 2)
+// deterministic per-run budgets enforced inside the interpreter; the timeout
+// is only a backstop now
+const MAX_STEPS = Number(process.env.RUN_MAX_STEPS || 50_000_000)
+const MAX_MEMORY_BYTES = Number(process.env.RUN_MAX_MEMORY || 64 * 1024 * 1024)
+const RUN_OPTIONS = {
+  bin: BIN,
+  args: [
+    '--strict',
+    '--max-output', String(MAX_OUTPUT_BYTES),
+    '--max-steps', String(MAX_STEPS),
+    '--max-memory', String(MAX_MEMORY_BYTES),
+  ],
+  timeoutMs: RUN_TIMEOUT_MS,
+}
 
 const app = express()
 app.use(express.json({ limit: MAX_CODE_BYTES }))
@@ -25,8 +42,12 @@ app.get('/api/health', (_req, res) => {
   res.json({ ok: true, interpreter: existsSync(BIN) })
 })
 
-app.post('/api/run', (req, res) => {
+let pool = null
+
+app.post('/api/run', async (req, res) => {
   const code = req.body?.code
+  // { stats: true } adds the interpreter's execution counters (see --stats)
+  const options = { stats: req.body?.stats === true }
   if (typeof code !== 'string' || code.trim().length === 0) {
     return res.status(400).json({ error: 'code (non-empty string) is required' })
   }
@@ -35,47 +56,26 @@ app.post('/api/run', (req, res) => {
   }
 
   const started = process.hrtime.bigint()
-  const child = spawn(BIN, ['--script'], {
-    stdio: ['pipe', 'pipe', 'pipe'],
-    timeout: RUN_TIMEOUT_MS,
-    killSignal: 'SIGKILL',
-  })
-
-  let out = ''
-  let truncated = false
-  const collect = (chunk) => {
-    if (out.length >= MAX_OUTPUT_BYTES) {
-      if (!truncated) {
-        truncated = true
-        child.kill('SIGKILL') // runaway print loop: stop it, keep what we have
-      }
-      return
+  let result
+  try {
+    if (WORKER_POOL_SIZE > 0) {
+      pool ??= new WorkerPool({ ...RUN_OPTIONS, size: WORKER_POOL_SIZE })
+      result = await pool.run(code, options)
+    } else {
+      result = await runOnce(RUN_OPTIONS, code, options)
     }
-    out += chunk.toString('utf8')
+  } catch (err) {
+    return res.status(500).json({ error: `failed to start interpreter: ${err.message}` })
   }
-  child.stdout.on('data', collect)
-  child.stderr.on('data', collect)
-
-  child.on('error', (err) => {
-    res.status(500).json({ error: `failed to start interpreter: ${err.message}` })
-  })
-
-  child.on('close', (exitCode, signal) => {
-    if (res.headersSent) return
-    const durationMs = Number(process.hrtime.bigint() - started) / 1e6
-    const timedOut = signal === 'SIGKILL' && !truncated
-    res.json({
-      output: out.slice(0, MAX_OUTPUT_BYTES),
-      exitCode,
-      timedOut,
-      truncated,
-      durationMs: Math.round(durationMs * 10) / 10,
-    })
+  const durationMs = Number(process.hrtime.bigint() - started) / 1e6
+  res.json({
+    output: result.output.slice(0, MAX_OUTPUT_BYTES),
+    exitCode: result.exitCode,
+    timedOut: result.timedOut,
+    truncated: result.truncated,
+    durationMs: Math.round(durationMs * 10) / 10,
+    ...(result.stats && { stats: result.stats }),
   })
-
-  child.stdin.on('error', () => {}) // process may die before we finish writing
-  child.stdin.write(code)
-  child.stdin.end()
 })
 
 // serve the built playground UI (client/dist locally, ./static in Docker)
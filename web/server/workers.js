@@ -0,0 +1,174 @@
+// Running programs through the C++ interpreter.
+// WorkerPool keeps `codelang --serve` processes warm and feeds them one
+// program at a time over a length-prefixed stdin/stdout protocol (see
+// runServe in main.cpp), so a run costs no fork/exec or process startup.
+// runOnce is the old spawn-per-run path, kept for WORKER_POOL_SIZE=0.
+import { spawn } from 'child_process'
+
+// Exit code the interpreter uses when --max-output cut the program short.
+const EXIT_OUTPUT_LIMIT = 3
+
+// Job flags, the byte before the source.
+const JOB_STATS = 1
+// Reply flags, the byte after the exit code.
+const REPLY_TRUNCATED = 1
+const REPLY_STATS = 2
+
+// Replacing a dead worker waits this long, doubling (up to the max) for every
+// worker that dies before another job completes.
+const RESPAWN_DELAY_MS = 100
+const MAX_RESPAWN_DELAY_MS = 10000
+
+function frame(code, flags) {
+  const body = Buffer.from(code, 'utf8')
+  const header = Buffer.alloc(5)
+  header.writeUInt32LE(body.length + 1)
+  header[4] = flags
+  return Buffer.concat([header, body])
+}
+
+class Worker {
+  constructor(bin, args, onExit) {
+    this.child = spawn(bin, [...args, '--serve'], { stdio: ['pipe', 'pipe', 'ignore'] })
+    this.pending = Buffer.alloc(0)
+    this.job = null
+    this.dead = false
+    this.child.stdout.on('data', (chunk) => this.receive(chunk))
+    this.child.stdin.on('error', () => {}) // reported through 'exit'
+    this.child.on('error', () => this.die(null))
+    this.child.on('exit', (exitCode) => this.die(exitCode))
+    this.onExit = onExit
+  }
+
+  run(code, { stats }, timeoutMs) {
+    return new Promise((resolve) => {
+      this.job = {
+        resolve,
+        timer: setTimeout(() => {
+          this.child.kill('SIGKILL')
+          this.finish({ output: '', exitCode: null, timedOut: true, truncated: false })
+          this.die(null)
+        }, timeoutMs),
+      }
+      this.child.stdin.write(frame(code, stats ? JOB_STATS : 0))
+    })
+  }
+
+  receive(chunk) {
+    this.pending = Buffer.concat([this.pending, chunk])
+    if (this.pending.length < 4) return
+    const length = this.pending.readUInt32LE(0)
+    if (this.pending.length < 4 + length) return
+    const exitCode = this.pending[4]
+    const flags = this.pending[5]
+    let offset = 6
+    let stats
+    if (flags & REPLY_STATS) {
+      const statsLength = this.pending.readUInt32LE(offset)
+      stats = JSON.parse(this.pending.subarray(offset + 4, offset + 4 + statsLength).toString('utf8'))
+      offset += 4 + statsLength
+    }
+    const output = this.pending.subarray(offset, 4 + length).toString('utf8')
+    this.pending = this.pending.subarray(4 + length)
+    this.finish({ output, exitCode, timedOut: false, truncated: (flags & REPLY_TRUNCATED) !== 0, stats })
+  }
+
+  finish(result) {
+    const job = this.job
+    if (!job) return
+    this.job = null
+    clearTimeout(job.timer)
+    job.resolve(result)
+  }
+
+  // Called at most once, on a crash, an exit or a timeout kill.
+  die(exitCode) {
+    if (this.dead) return
+    this.dead = true
+    this.finish({ output: '', exitCode, timedOut: false, truncated: false })
+    this.onExit(this)
+  }
+}
+
+export class WorkerPool {
+  constructor({ bin, args = [], size, timeoutMs }) {
+    this.bin = bin
+    this.args = args
+    this.timeoutMs = timeoutMs
+    this.idle = []
+    this.queue = []
+    this.deaths = 0 // since the last job that completed
+    for (let i = 0; i < size; i++) this.idle.push(this.spawnWorker())
+  }
+
+  spawnWorker() {
+    return new Worker(this.bin, this.args, (worker) => {
+      // crashed or killed on timeout: replace it so the pool stays full, but
+      // back off so programs that keep killing workers can't keep us forking
+      this.idle = this.idle.filter((w) => w !== worker)
+      const delay = Math.min(RESPAWN_DELAY_MS * 2 ** this.deaths, MAX_RESPAWN_DELAY_MS)
+      this.deaths++
+      setTimeout(() => this.release(this.spawnWorker()), delay)
+    })
+  }
+
+  run(code, options = {}) {
+    return new Promise((resolve) => {
+      this.queue.push({ code, options, resolve })
+      if (this.idle.length > 0) this.release(this.idle.pop())
+    })
+  }
+
+  release(worker) {
+    const next = this.queue.shift()
+    if (!next) {
+      this.idle.push(worker)
+      return
+    }
+    worker.run(next.code, next.options, this.timeoutMs).then((result) => {
+      next.resolve(result)
+      if (worker.dead) return
+      this.deaths = 0
+      this.release(worker)
+    })
+  }
+}
+
+// With `stats`, the counters are the last line of stderr (--stats-json).
+export function runOnce({ bin, args = [], timeoutMs }, code, { stats = false } = {}) {
+  return new Promise((resolve, reject) => {
+    const statsArgs = stats ? ['--stats-json'] : []
+    const child = spawn(bin, [...args, ...statsArgs, '--script'], {
+      stdio: ['pipe', 'pipe', 'pipe'],
+      timeout: timeoutMs,
+      killSignal: 'SIGKILL',
+    })
+    let out = ''
+    let err = ''
+    child.stdout.on('data', (chunk) => { out += chunk.toString('utf8') })
+    child.stderr.on('data', (chunk) => { err += chunk.toString('utf8') })
+    child.on('error', reject)
+    child.on('close', (exitCode, signal) => {
+      let counters
+      if (stats) {
+        const lines = err.trimEnd().split('\n')
+        try {
+          counters = JSON.parse(lines.pop())
+          err = lines.length > 0 ? lines.join('\n') + '\n' : ''
+        } catch {
+          counters = undefined // killed before it got to print them
+        }
+      }
+      resolve({
+        output: out + err,
+        stats: counters,
+        exitCode,
+        timedOut: signal === 'SIGKILL',
+        truncated: exitCode === EXIT_OUTPUT_LIMIT,
+      })
+    })
+    child.stdin.on('error', () => {}) // process may die before we finish writing
+    child.stdin.write(code)
+    child.stdin.end()
+  })
+}